@@ -0,0 +1,324 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Mikro-benchmarky sestavení dotazu a zpracování odpovědi (bez sítě)
+    Spuštění: make bench, případně ./dns_bench [soubory s odpověďmi]
+    Každý soubor obsahuje jednu zachycenou DNS odpověď v přenosovém tvaru,
+    bez souborů se použije vestavěný korpus.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <arpa/inet.h>
+
+#include "dns_wire.h"
+
+// počítadlo alokací pro výpis allocs/op, operátory new/delete jsou nahrazeny
+// (GCC jinak varuje, že free() dostává ukazatel z operator new)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = malloc(size ? size : 1);
+    if(!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+/**
+    Zabránění optimalizaci výsledku pryč
+    @param value - Hodnota, která se má považovat za použitou
+*/
+template<typename T>
+static inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+    Spuštění jednoho benchmarku, počet opakování se zvyšuje, dokud měření netrvá aspoň 200 ms
+    @param name - Název benchmarku
+    @param bytes_per_op - Zpracované bajty na jednu operaci (0 = propustnost v op/s)
+    @param op - Měřená operace
+*/
+template<typename Op>
+static void run_bench(const char* name, size_t bytes_per_op, Op&& op)
+{
+    typedef std::chrono::steady_clock clock;
+    const std::chrono::milliseconds min_time(200);
+
+    for(int i = 0; i < 1000; i++)
+    {
+        op();
+    }
+    size_t iterations = 1000;
+    while(true)
+    {
+        size_t allocs_before = allocations.load(std::memory_order_relaxed);
+        clock::time_point start = clock::now();
+        for(size_t i = 0; i < iterations; i++)
+        {
+            op();
+        }
+        clock::duration elapsed = clock::now() - start;
+        size_t allocs = allocations.load(std::memory_order_relaxed) - allocs_before;
+
+        if(elapsed < min_time)
+        {
+            iterations *= 2;
+            continue;
+        }
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        std::cout << "  " << std::left << std::setw(34) << name << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(10) << ns << " ns/op"
+                  << std::setprecision(2) << std::setw(8) << static_cast<double>(allocs) / iterations << " allocs/op";
+        if(bytes_per_op)
+        {
+            std::cout << std::setprecision(1) << std::setw(10) << bytes_per_op * 1e3 / ns << " MB/s";
+        }
+        else
+        {
+            std::cout << std::setprecision(2) << std::setw(10) << 1e3 / ns << " Mop/s";
+        }
+        std::cout << "\n";
+        return;
+    }
+}
+
+/**
+    Sestavení odpovědi do vestavěného korpusu
+    @param qname - Dotazované jméno
+    @param qtype - Typ dotazu
+    @param rcode - Návratový kód
+    @param answers - Answer section
+    @param authority - Authority section
+    @param additional - Additional section
+    @return - Odpověď v přenosovém tvaru (bez komprese)
+*/
+static std::vector<char> make_packet(const std::string& qname, uint16_t qtype, uint16_t rcode, const std::vector<DNS_Record>& answers,
+                                     const std::vector<DNS_Record>& authority = {}, const std::vector<DNS_Record>& additional = {})
+{
+    DNS_Response response;
+    response.id = 70;
+    response.flags = 0x8180 | rcode;
+    response.qdcount = 1;
+    response.qname = qname;
+    response.qtype = qtype;
+    response.qclass = 1;
+    response.answers = answers;
+    response.authority = authority;
+    response.additional = additional;
+    std::vector<char> packet;
+    encode_response(response, packet);
+    return packet;
+}
+
+/**
+    Vestavěný korpus typických odpovědí
+    @return - Seznam odpovědí
+*/
+static std::vector<std::vector<char>> builtin_corpus()
+{
+    std::vector<std::vector<char>> corpus;
+    corpus.push_back(make_packet("www.fit.vut.cz", 1, 0, { { "www.fit.vut.cz", 1, 1, 14400, "147.229.9.26" } }));
+    corpus.push_back(make_packet("www.fit.vut.cz", 28, 0, { { "www.fit.vut.cz", 28, 1, 14400, "2001:67c:1220:809::93e5:91a" } }));
+    corpus.push_back(make_packet("26.9.229.147.in-addr.arpa", 12, 0, { { "26.9.229.147.in-addr.arpa", 12, 1, 14400, "www.fit.vut.cz" } }));
+    corpus.push_back(make_packet("nope.fit.vut.cz", 1, 3, {}, { { "fit.vut.cz", 6, 1, 14400, "guta.fit.vutbr.cz. michal.fit.vutbr.cz. 20231120 10800 3600 691200 86400" } }));
+    corpus.push_back(make_packet("www.example.com", 1, 0,
+        { { "www.example.com", 5, 1, 300, "www.example.com-v4.edgesuite.net" },
+          { "www.example.com-v4.edgesuite.net", 5, 1, 300, "a1422.dscr.akamai.net" },
+          { "a1422.dscr.akamai.net", 1, 1, 20, "23.215.0.136" },
+          { "a1422.dscr.akamai.net", 1, 1, 20, "23.215.0.138" } }));
+    std::vector<DNS_Record> ns, glue;
+    for(char c = 'a'; c <= 'm'; c++)
+    {
+        std::string server = std::string(1, c) + ".gtld-servers.net";
+        ns.push_back({ "com", 2, 1, 172800, server });
+        glue.push_back({ server, 1, 1, 172800, "192." + std::to_string(c) + ".30.30" });
+    }
+    corpus.push_back(make_packet("www.example.com", 1, 0, {}, ns, glue));
+
+    // komprese jmen: odpověď s ukazatelem na otázku (jako od skutečného serveru)
+    const unsigned char compressed[] = {
+        0x00, 0x46, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+        0x03, 'w', 'w', 'w', 0x03, 'f', 'i', 't', 0x03, 'v', 'u', 't', 0x02, 'c', 'z', 0x00,
+        0x00, 0x01, 0x00, 0x01,
+        0xC0, 0x0C, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x0E, 0x10, 0x00, 0x06, 0x03, 'w', 'e', 'b', 0xC0, 0x10,
+        0xC0, 0x2C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x38, 0x40, 0x00, 0x04, 0x93, 0xE5, 0x09, 0x1A
+    };
+    corpus.push_back(std::vector<char>(compressed, compressed + sizeof(compressed)));
+    return corpus;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::vector<char>> corpus;
+    for(int i = 1; i < argc; i++)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "Soubor " << argv[i] << " nelze otevřít." << std::endl;
+            return EXIT_FAILURE;
+        }
+        corpus.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if(corpus.empty())
+    {
+        corpus = builtin_corpus();
+    }
+    size_t corpus_bytes = 0;
+    size_t corpus_records = 0;
+    for(const std::vector<char>& packet : corpus)
+    {
+        DNS_MessageView message;
+        if(!parse_message_view(packet.data(), packet.size(), message))
+        {
+            std::cerr << "Odpověď v korpusu je poškozená." << std::endl;
+            return EXIT_FAILURE;
+        }
+        corpus_bytes += packet.size();
+        corpus_records += message.answers.size() + message.authority.size() + message.additional.size();
+    }
+    std::cout << "Korpus: " << corpus.size() << " odpovědí, " << corpus_records << " záznamů, " << corpus_bytes << " B" << std::endl;
+
+    std::cout << "Sestavení dotazu" << std::endl;
+    std::string qname = "www.fit.vut.cz";
+    char converted[256];
+    run_bench("Convert_question", qname.size(), [&]()
+    {
+        size_t length = Convert_question(qname, converted, sizeof(converted));
+        keep(length);
+        keep(converted);
+    });
+    char query[512];
+    DNS_header header;
+    header_constr(&header, 70);
+    run_bench("build_query (+ EDNS OPT)", 0, [&]()
+    {
+        size_t length = build_query(query, sizeof(query), header, qname, 1, 1, 1232);
+        keep(length);
+        keep(query);
+    });
+    run_bench("extend_ipv6", 0, [&]()
+    {
+        std::string expanded = extend_ipv6("2001:67c:1220:809::93e5:91a");
+        keep(expanded);
+    });
+    run_bench("reverse_address", 0, [&]()
+    {
+        std::string reversed = reverse_address("147.229.9.26");
+        keep(reversed);
+    });
+    run_bench("reverse_ipv6_address", 0, [&]()
+    {
+        std::string reversed = reverse_ipv6_address("2001:67c:1220:809::93e5:91a");
+        keep(reversed);
+    });
+    run_bench("inet_pton + arpa_name (IPv4)", 0, [&]()
+    {
+        unsigned char address[4];
+        char name[max_arpa_length];
+        inet_pton(AF_INET, "147.229.9.26", address);
+        size_t length = arpa_name(AF_INET, address, name, sizeof(name));
+        keep(length);
+        keep(name);
+    });
+    run_bench("inet_pton + arpa_name (IPv6)", 0, [&]()
+    {
+        unsigned char address[16];
+        char name[max_arpa_length];
+        inet_pton(AF_INET6, "2001:67c:1220:809::93e5:91a", address);
+        size_t length = arpa_name(AF_INET6, address, name, sizeof(name));
+        keep(length);
+        keep(name);
+    });
+
+    std::cout << "Zpracování odpovědi (celý korpus na operaci)" << std::endl;
+    run_bench("read_domain_name (otázky)", 0, [&]()
+    {
+        for(const std::vector<char>& packet : corpus)
+        {
+            char* reader = const_cast<char*>(packet.data()) + sizeof(DNS_header);
+            std::string name = read_domain_name(reader, packet);
+            keep(name);
+        }
+    });
+    run_bench("parseDNS_Record", corpus_bytes, [&]()
+    {
+        for(const std::vector<char>& packet : corpus)
+        {
+            DNS_header header;
+            memcpy(&header, packet.data(), sizeof(DNS_header));
+            char* reader = const_cast<char*>(packet.data()) + sizeof(DNS_header);
+            read_domain_name(reader, packet);
+            reader += 4;
+            int records = ntohs(header.DNS_ANCOUNT) + ntohs(header.DNS_NSCOUNT) + ntohs(header.DNS_ARCOUNT);
+            DNS_Record record;
+            for(int r = 0; r < records && parseDNS_Record(reader, packet, record); r++)
+            {
+                keep(record);
+            }
+        }
+    });
+    run_bench("parse_response", corpus_bytes, [&]()
+    {
+        DNS_Response response;
+        for(const std::vector<char>& packet : corpus)
+        {
+            parse_response(packet, response);
+            keep(response);
+        }
+    });
+    DNS_MessageView message;
+    run_bench("parse_message_view", corpus_bytes, [&]()
+    {
+        for(const std::vector<char>& packet : corpus)
+        {
+            parse_message_view(packet.data(), packet.size(), message);
+            keep(message);
+        }
+    });
+    return 0;
+}
@@ -11,472 +11,491 @@
 #include <cstring>
 #include <vector>
 #include <cstdlib>
+#include <fstream>
+#include <deque>
+#include <unordered_set>
+#include <algorithm>
+#include <csignal>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+#include "dns_wire.h"
+#include "dns_engine.h"
+#include "dns_cache.h"
+#include "dns_iterative.h"
+#include "dns_output.h"
+#include "dns_resolver.h"
+#include "dns_server.h"
+#include "dns_metrics.h"
+
+// maximální počet odpovědí držených v cache
+const size_t cache_capacity = DNS_resolver::default_cache_capacity;
+
 /*
-    Hlavička DNS
+    Dotaz dávkového režimu, čekající na odeslání, odpověď nebo výpis
 */
-struct DNS_header {
-    uint16_t DNS_ID;
-    uint16_t DNS_FLAGS;
-    uint16_t DNS_QDCOUNT;
-    uint16_t DNS_ANCOUNT;
-    uint16_t DNS_NSCOUNT;
-    uint16_t DNS_ARCOUNT;
+struct Batch_query {
+    std::string name;
+    uint16_t qtype;
+    bool done;
+    int status;
+    DNS_Response response;
 };
 
 /*
-    Tělo otázky DNS
+    Adresa v binární podobě pro odstranění duplicit v hromadném PTR režimu
 */
-struct DNS_question {
-    std::string QNAME;
-    uint16_t QTYPE;
-    uint16_t QCLASS;
+struct Address_key {
+    int family;
+    unsigned char bytes[16];
+
+    bool operator==(const Address_key& other) const
+    {
+        return family == other.family && memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+    }
+};
+
+struct Address_key_hash {
+    size_t operator()(const Address_key& key) const
+    {
+        uint64_t high, low;
+        memcpy(&high, key.bytes, sizeof(high));
+        memcpy(&low, key.bytes + 8, sizeof(low));
+        return std::hash<uint64_t>()((high * 0x9E3779B97F4A7C15ULL) ^ low ^ static_cast<uint64_t>(key.family));
+    }
 };
 
 /*
-    Struktura pro uložení hodnot na výstup
+    Nastavení přenosu dotazů společné pro jednotlivý i dávkový režim
 */
-struct DNS_Record {
-    std::string name;
-    uint16_t type;
-    uint16_t dnsclass;
-    uint32_t ttl;
-    std::string rdata;
+struct Query_options {
+    int retries;
+    bool tcp;
+    uint16_t edns_payload;
+    bool iterative;
+    uint32_t stale_window;
+    uint32_t prefetch_hits;
+    DNS_metrics* metrics;
 };
 
 /**
-    Konstruktor hlavičky
-    @param header - Hlavička pro kterou se mají vyplnit hodnoty
+    Registrace serverů do enginu, při chybě se program ukončí
+    @param engine - Engine, do kterého se servery přidají
+    @param server_ips - Adresy serverů
+    @param port - Port serverů
+    @return - Indexy serverů v enginu
 */
-void header_constr(DNS_header* header)
+std::vector<int> add_servers(DNS_engine& engine, const std::vector<std::string>& server_ips, uint16_t port)
 {
-    header->DNS_ID = htons(70);
-    header->DNS_FLAGS = htons(0b0000000100000000);
-    header->DNS_QDCOUNT = htons(1);
-    header->DNS_ANCOUNT = htons(0);
-    header->DNS_NSCOUNT = htons(0);
-    header->DNS_ARCOUNT = htons(0);
+    std::vector<int> servers;
+    for(const std::string& server_ip : server_ips)
+    {
+        int server = engine.add_server(server_ip, port);
+        if(server == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+        servers.push_back(server);
+    }
+    return servers;
 }
 
 /**
-    Konstruktor těla otázky
-    @param question - Struktura otázky k vyplnění
-    @param name - Dotazovaný domain name (nebo IPv4/IPv6)
+    Chybová hláška pro stav dotazu
+    @param status - Stav dotazu (DNS_status)
+    @return - Text hlášky
 */
-void question_constr(DNS_question* question, std::string& name)
+const char* status_message(int status)
 {
-    question->QNAME = name;
-    question->QTYPE = htons(1);
-    question->QCLASS = htons(1);
+    switch(status)
+    {
+        case DNS_ERR_SEND: return "Data se neposlala.";
+        case DNS_ERR_NAME: return "Neplatné doménové jméno.";
+        case DNS_ERR_SERVER: return "Neplatný server.";
+        case DNS_ERR_FORMAT: return "Odpověď serveru je poškozená.";
+    }
+    return "Žádná data nebyla obdržena.";
 }
 
 /**
-    Převedení domain name na tvar vhodný pro DNS otázku
-    @param address - Převáděná adresa
-    @return - Adresa v korektním tvaru
+    Převedení seznamu typů oddělených čárkou na číselné typy, opakované typy se vynechají
+    @param list - Seznam typů (názvy, čísla nebo TYPEn), např. "A,AAAA,HTTPS"
+    @param types - Sem se typy přidají
+    @return - false, pokud některý typ není platný
 */
-char* Convert_question(std::string& address)
+bool parse_types(const std::string& list, std::vector<uint16_t>& types)
 {
-    char* temp_add = new char[address.size() + 1];
-    int len = 0;
-    int label = 0;
-    int i = 0;
-    for(char c : address)
+    size_t start = 0;
+    while(start <= list.size())
     {
-        if(c == '.')
+        size_t comma = list.find(',', start);
+        if(comma == std::string::npos)
         {
-            temp_add[i] = static_cast<char>(len); // zapsání délky segmentu před segment
-            i++;
-            for(int j = 0; j < len; j++)
-            {
-                temp_add[i] = address[label + j];
-                i++;
-            }
-            label += len + 1;
-            len = 0;
+            comma = list.size();
         }
-        else
+        uint16_t type = parse_type(list.substr(start, comma - start));
+        if(type == 0)
         {
-            len++;
+            return false;
         }
+        if(std::find(types.begin(), types.end(), type) == types.end())
+        {
+            types.push_back(type);
+        }
+        start = comma + 1;
     }
-    // poslední label po poslední tečce
-    temp_add[i] = static_cast<char>(len);
-    i++;
-    for(int j = 0; j < len; j++)
-    {
-        temp_add[i] = address[label + j];
-        i++;
-    }
-    temp_add[i] = '\0'; //přidání nulového bitu na konec stringu
-    return temp_add;
+    return true;
 }
 
 /**
-    Rozšíření IPv6 do její celé formy
-    @param ip - IPv6 adresa k rozšíření
-    @return - Kompletní verze IPv6
- */
-std::string extend_ipv6(const std::string& ip)
+    Nastavení rezolveru podle přepínačů příkazové řádky
+    @param resolver - Nastavovaný rezolver
+    @param server_ips - Adresy serverů, v iterativním režimu kořenové servery
+    @param recursion - Zda se má rezoluce provést rekurzivně
+    @param options - Nastavení přenosu (počet opakování, TCP, EDNS, iterativní režim, cache, metriky)
+    @return - false pokud některý server nelze přidat
+*/
+bool configure_resolver(DNS_resolver& resolver, const std::vector<std::string>& server_ips, bool recursion, const Query_options& options)
 {
-    std::string expanded;
-    int colonCount = 0;
-    bool doubleColonFound = false;
-
-    // počítání dvoj teček a kontrola použití shorthand notace (:)
-    for (size_t i = 0; i < ip.size(); ++i) {
-        if (ip[i] == ':') {
-            colonCount++;
-            if (i > 0 && ip[i - 1] == ':') {
-                doubleColonFound = true;
-            }
+    resolver.set_recursion(recursion);
+    resolver.set_retries(options.retries);
+    resolver.set_tcp(options.tcp);
+    resolver.set_edns_payload(options.edns_payload);
+    resolver.set_metrics(options.metrics);
+    resolver.set_iterative(options.iterative);
+    resolver.set_stale(options.stale_window);
+    resolver.set_prefetch(options.prefetch_hits);
+    if(options.iterative)
+    {
+        if(!server_ips.empty())
+        {
+            resolver.set_root_hints(server_ips);
         }
+        return true;
     }
+    for(const std::string& server_ip : server_ips)
+    {
+        if(resolver.add_server(server_ip) == -1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    // počítání chybějících hex sekcí
-    int missingSections = 8 - colonCount - 1 + (doubleColonFound ? 1 : 0);
-    size_t lastColon = -1;
-
-    for (size_t i = 0; i < ip.size(); ++i) {
-        if (ip[i] == ':') {
-            if (i == lastColon + 1) {
-                while (missingSections-- > 0) {
-                    expanded += "0000:";
+/**
+    Dávková rezoluce adres ze vstupu, všechny dotazy jdou přes jeden rezolver (jeden UDP socket)
+    Každý řádek vstupu má tvar "adresa [typ,typ,...]" (názvy z tabulky v dns_rdata.cpp nebo čísla),
+    prázdné řádky a řádky začínající # se přeskočí. Každý typ je samostatný dotaz.
+    Najednou je rozpracováno nejvýše batch_window dotazů (včetně připojených ke stejnému
+    rozpracovanému dotazu), odpovědi se párují podle ID a otázky a vypisují se ve stejném pořadí
+    jako na vstupu. Nevypsaných dotazů (i hotových z cache) je nejvýše batch_buffer.
+    @param resolver - Nastavený rezolver (servery, cache, přenos)
+    @param input - Vstup s adresami
+    V hromadném PTR režimu (bulk_ptr) je na řádku jen IP adresa, převede se přes inet_pton
+    přímo na jméno v in-addr.arpa/ip6.arpa a každá adresa se dotazuje a vypíše jen jednou.
+    @param default_types - Typy dotazů pro řádky bez uvedeného typu
+    @param output - Výstup výsledků (zvolený formát)
+    @param bulk_ptr - Hromadný PTR režim
+    @return - Počet dotazů, na které nepřišla odpověď
+*/
+int DNS_batch(DNS_resolver& resolver, std::istream& input, const std::vector<uint16_t>& default_types, DNS_output& output, bool bulk_ptr)
+{
+    const size_t batch_window = 256;
+    const size_t batch_buffer = 4 * batch_window;
+    resolver.set_max_in_flight(batch_window);
+
+    std::deque<Batch_query> queries;       // dotazy od nejstaršího nevypsaného
+    size_t first_seq = 0;                  // pořadové číslo queries.front()
+    bool input_done = false;
+    int failures = 0;
+    std::unordered_set<Address_key, Address_key_hash> seen;
+    std::string line;
+
+    // zařazení dotazu, výsledek se zapíše do queries podle pořadového čísla
+    auto submit = [&resolver, &queries, &first_seq](const std::string& name, uint16_t qtype)
+    {
+        Batch_query query;
+        query.name = name;
+        query.qtype = qtype;
+        query.done = false;
+        query.status = DNS_OK;
+
+        // opakovaná jména se zodpoví z cache hned, bez dotazu na server
+        size_t seq = first_seq + queries.size();
+        queries.push_back(std::move(query));
+        resolver.resolve_async(name, qtype, [&queries, &first_seq, seq](int status, DNS_Response& response)
+        {
+            Batch_query& done = queries[seq - first_seq];
+            done.done = true;
+            done.status = status;
+            done.response = std::move(response);
+        });
+    };
+
+    while(true)
+    {
+        // načtení dalších řádků ze vstupu, dokud není okno plné
+        while(!input_done && resolver.pending() < batch_window && queries.size() < batch_buffer)
+        {
+            if(!std::getline(input, line))
+            {
+                input_done = true;
+                break;
+            }
+            size_t start = line.find_first_not_of(" \t\r");
+            if(start == std::string::npos || line[start] == '#')
+            {
+                continue;
+            }
+            size_t end = line.find_first_of(" \t\r", start);
+            if(bulk_ptr)
+            {
+                if(end != std::string::npos)
+                {
+                    line[end] = '\0';
+                }
+                const char* address = line.c_str() + start;
+                Address_key key;
+                memset(&key, 0, sizeof(key));
+                key.family = strchr(address, ':') ? AF_INET6 : AF_INET;
+                char name[max_arpa_length];
+                size_t length = (inet_pton(key.family, address, key.bytes) == 1) ? arpa_name(key.family, key.bytes, name, sizeof(name)) : 0;
+                if(length == 0)
+                {
+                    std::cerr << "Neplatná adresa " << address << "." << std::endl;
+                    continue;
                 }
+                if(seen.insert(key).second)
+                {
+                    submit(std::string(name, length), 12);
+                }
+                continue;
             }
-            lastColon = i;
-        } else if (lastColon == i - 1 || i == 0) {
-            size_t nextColon = ip.find(':', i);
-            if (nextColon == std::string::npos) {
-                nextColon = ip.size();
+            std::string name = line.substr(start, end - start);
+            std::vector<uint16_t> line_types;
+            if(end != std::string::npos)
+            {
+                size_t type_start = line.find_first_not_of(" \t\r", end);
+                if(type_start != std::string::npos)
+                {
+                    size_t type_end = line.find_first_of(" \t\r", type_start);
+                    if(!parse_types(line.substr(type_start, type_end - type_start), line_types))
+                    {
+                        std::cerr << "Neznámý typ záznamu pro " << name << "." << std::endl;
+                        continue;
+                    }
+                }
+            }
+            if(line_types.empty())
+            {
+                line_types = default_types;
             }
 
-            std::string section = ip.substr(i, nextColon - i);
-            expanded += std::string(4 - section.size(), '0') + section;
-            i = nextColon - 1;
-
-            if (i < ip.size() - 1) {
-                expanded += ":";
+            for(uint16_t qtype : line_types)
+            {
+                submit((qtype == 12) ? get_ip_version(name) : name, qtype);
             }
         }
-    }
 
-    // jestli adresa končí shorthand notací tak za ní doplnit nuly
-    if (doubleColonFound && lastColon == ip.size() - 1) {
-        while (missingSections-- > 0) {
-            expanded += ":0000";
+        // výpis hotových dotazů ve vstupním pořadí
+        while(!queries.empty() && queries.front().done)
+        {
+            Batch_query& query = queries.front();
+            if(query.status == DNS_OK)
+            {
+                output.response(query.name, query.response);
+            }
+            else if(query.status == DNS_ERR_TIMEOUT)
+            {
+                output.error(query.name, query.status, "Na dotaz " + query.name + " nepřišla odpověď.");
+                failures++;
+            }
+            else
+            {
+                output.error(query.name, query.status, "Dotaz " + query.name + ": " + status_message(query.status));
+                failures++;
+            }
+            queries.pop_front();
+            first_seq++;
         }
-    }
 
-    return expanded;
-}
-
-/**
-    Obrácení IPv4 adresy pro PTR záznam
-    @param ip - Adresa kterou je třeba obrátit
-    @return - Obrácená adresa
-*/
-std::string reverse_address(const std::string& ip)
-{
-    std::string reversed_ip;
-    int len = ip.length();
-    int start = len;
-
-    for(int i = len - 1; i >= -1; i--) 
-    {
-        if(i == -1 || ip[i] == '.') 
+        if(resolver.pending() == 0)
         {
-            if(!reversed_ip.empty()) 
+            if(input_done)
             {
-                reversed_ip += ".";
+                break;
             }
-            reversed_ip += ip.substr(i + 1, start - (i + 1));
-            start = i;
+            continue;
         }
+        resolver.run_once(-1);
     }
 
-    return reversed_ip += ".in-addr.arpa";
+    return failures;
 }
 
 /**
-    Obrácení IPv6 adresy pro PTR záznam
-    @param ip - IPv6 adresa kterou je třeba obrátit
-    @return - Obrácená IPv6 adresa
+    Zápis metrik jako JSON na konci běhu
+    @param path - Cesta k souboru, "-" = standardní chybový výstup, prázdná = nic se nezapíše
+    @param metrics - Metriky jednotlivých vláken
 */
-std::string reverse_ipv6_address(const std::string& ip)
+void write_metrics(const std::string& path, const std::vector<const DNS_metrics*>& metrics)
 {
-    std::string reversed_ip, tmp;
-    tmp = extend_ipv6(ip);
-    int len = tmp.length();
-
-    for(int i = len - 1; i >= 0; i--)
+    if(path.empty())
     {
-        if(tmp[i] != ':')
-        {
-            reversed_ip += tmp[i];
-            reversed_ip += ".";
-        }
+        return;
     }
-    return reversed_ip += "ip6.arpa";
-}
-
-/**
-    Funkce na výběr verze IP adresy (4/6)
-    @param ip - Adresa kterou je třeba obrátit
-    @return - Obrácená adresa
-*/
-std::string get_ip_version(const std::string& ip)
-{
-    int cnt = 0;
-    for(char c : ip) 
+    if(path == "-")
     {
-        if (c == ':') 
-        {
-            cnt++;
-        }
+        std::cerr << metrics_json(metrics) << std::endl;
+        return;
     }
-    if(cnt > 0) {
-
-        return reverse_ipv6_address(ip);
-    } 
-    else 
+    std::ofstream file(path, std::ios::trunc);
+    if(!(file << metrics_json(metrics) << "\n"))
     {
-        return reverse_address(ip);
+        std::cerr << "Metriky se nepodařilo zapsat do " << path << "." << std::endl;
     }
 }
 
+/*
+    Vlákno démona: vlastní smyčka událostí, upstream sockety a naslouchající sockety (SO_REUSEPORT)
+*/
+struct Daemon_worker {
+    Daemon_worker(DNS_shared_cache& cache, uint16_t port) : resolver(engine, port), server(engine, cache) {}
+    DNS_metrics metrics;
+    DNS_engine engine;
+    DNS_iterative resolver;
+    DNS_server server;
+    std::thread thread;
+};
+
 /**
-    Funkce na provedení DNS rezoluce
-    @param server_ip - Adresa serveru
-    @param server_name - Dotazovaná adresa
-    @param port - Port na kterém se provede rezoluce
-    @param header - Hlavička DNS
-    @param reverse - Zda je třeba provést PTR záznam
-    @param isServer - Jestli se jedná o rezoluci serveru
-    @param quadA - Zda je potřeba provést AAAA záznam
-    @param recursion - Zda se má rezoluce provést rekurzivně
-    @return - Buffer s obsahem celé odpovědi od serveru
+    Režim démona: lokální cachující rezolver, který přijímá dotazy na UDP i TCP
+    Každé vlákno má vlastní engine a vlastní sockety na stejném portu (SO_REUSEPORT), jádro mezi ně
+    rozděluje dotazy. Společná je jen cache rozdělená do shardů se zámky. Dotazy mimo cache se
+    přeposílají serverům z -s (nebo se vyřeší iterativně). Běží do SIGINT nebo SIGTERM.
+    @param server_ips - Adresy upstream serverů, v iterativním režimu kořenové servery
+    @param port - Port upstream serverů
+    @param listen_address - Adresa, na které démon naslouchá
+    @param listen_port - Port, na kterém démon naslouchá
+    @param workers - Počet vláken
+    @param cpus - Procesory, na které se vlákna postupně připnou (prázdné = bez připnutí)
+    @param options - Nastavení přenosu (počet opakování, TCP, EDNS, iterativní režim)
+    @param cache_file - Soubor cache, načte se při startu a uloží při ukončení (prázdný = bez souboru)
+    @param metrics_port - Port HTTP endpointu s metrikami pro Prometheus (0 = bez endpointu)
+    @param metrics_file - Soubor, do kterého se při ukončení zapíšou metriky jako JSON (prázdný = nikam)
+    @return - 0 při řádném ukončení, EXIT_FAILURE pokud nelze naslouchat
 */
-std::vector<char> DNS_query(const std::string& server_ip, std::string& server_name, uint16_t port, DNS_header& header, bool& reverse, bool& isServer, bool& quadA, bool& recursion)
+int DNS_daemon(const std::vector<std::string>& server_ips, uint16_t port, const std::string& listen_address, uint16_t listen_port,
+               size_t workers, const std::vector<int>& cpus, const Query_options& options, const std::string& cache_file,
+               uint16_t metrics_port, const std::string& metrics_file)
 {
-    if(reverse == true && quadA == true)
-    {
-        std::cerr << "Neplatná kombinace přepínačů (-x a -6)." << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    // zjištění serveru se provádí vždy rekurzivně
-    if(recursion == false && isServer == false)
-    {
-        header.DNS_FLAGS &= ~(1 << 8);
-        header.DNS_FLAGS = htons(header.DNS_FLAGS);
-    }
-    DNS_question question;
-    if(reverse == true && isServer == false && quadA == false)
-    {
-        server_name = get_ip_version(server_name);
-    }
-    question_constr(&question, server_name);
-    if(reverse == true && isServer == false && quadA == false)
-    {
-        question.QTYPE = htons(12);
-    }
-    if(quadA == true && isServer == false && reverse == false)
+    DNS_shared_cache cache(cache_capacity, workers * 4);
+    cache.set_stale(options.stale_window);
+    cache.set_prefetch(options.prefetch_hits);
+    if(!cache_file.empty())
     {
-        question.QTYPE = htons(28);
+        cache.load(cache_file);
     }
-    // dva sockety a buffery, jeden pro IPv6, jeden pro IPv4
-    struct sockaddr_in server_socket;
-    struct sockaddr_in6 server_socket6;
-    memset(&server_socket, 0, sizeof(server_socket));
-    memset(&server_socket6, 0, sizeof(server_socket6));
-    struct in_addr tmp_buffer;
-    struct in6_addr tmp_buffer6;
 
-    size_t buffer_size = 1024;
-    std::vector<char> buffer(buffer_size);
-    char* current_position = buffer.data();
-
-    // vložení celé hlavičky a dotazu do bufferu
-    memcpy(current_position, &header, sizeof(DNS_header));
-    current_position += sizeof(DNS_header);
-    memcpy(current_position, Convert_question(question.QNAME), question.QNAME.size() + 2);
-    current_position += question.QNAME.size() + 2;
-    memcpy(current_position, &question.QTYPE, sizeof(uint16_t));
-    current_position += sizeof(uint16_t);
-    memcpy(current_position, &question.QCLASS, sizeof(uint16_t));
-    current_position += sizeof(uint16_t);
-
-    int user_socket;
-    
-    // kontrola, jestli hledaná adresa je IPv6
-    if(inet_pton(AF_INET6, server_ip.c_str(), &tmp_buffer6) == 1)
-    {
-        server_socket6.sin6_family = AF_INET6;
-        server_socket6.sin6_port = htons(port);
-        server_socket6.sin6_addr = tmp_buffer6;
-        user_socket = socket(AF_INET6, SOCK_DGRAM, 0);
-        if(user_socket == -1)
-        {
-            std::cerr << "UDP socket se nepodařil vytvořit." << std::endl;
-            exit(EXIT_FAILURE);
-        }
-        if(connect(user_socket, (struct sockaddr*)&server_socket6, sizeof(server_socket6)) == -1)
+    // signály se zablokují ve všech vláknech a přijímá je jen hlavní vlákno přes sigwait
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<std::unique_ptr<Daemon_worker>> pool;
+    for(size_t w = 0; w < workers; w++)
+    {
+        pool.emplace_back(new Daemon_worker(cache, port));
+        Daemon_worker& worker = *pool.back();
+        worker.engine.set_metrics(&worker.metrics);
+        worker.server.set_metrics(&worker.metrics);
+        worker.engine.set_retries(options.retries);
+        worker.engine.set_tcp(options.tcp);
+        worker.engine.set_edns_payload(options.edns_payload);
+        if(options.iterative)
         {
-            std::cerr << "Navázání spojení bylo neúspěšné." << std::endl;
-            exit(EXIT_FAILURE);
+            if(!server_ips.empty())
+            {
+                worker.resolver.set_root_hints(server_ips);
+            }
+            worker.server.set_resolver(&worker.resolver);
         }
-    }
-    // nebo jestli je IPv4
-    else if(inet_pton(AF_INET, server_ip.c_str(), &tmp_buffer) == 1)
-    {
-        server_socket.sin_family = AF_INET;
-        server_socket.sin_port = htons(port);
-        server_socket.sin_addr = tmp_buffer;
-        user_socket = socket(AF_INET, SOCK_DGRAM, 0);
-        if(user_socket == -1)
+        else
         {
-            std::cerr << "UDP socket se nepodařil vytvořit." << std::endl;
-            exit(EXIT_FAILURE);
+            worker.server.set_upstream(add_servers(worker.engine, server_ips, port));
         }
-        if(connect(user_socket, (struct sockaddr*)&server_socket, sizeof(server_socket)) == -1)
+        if(!worker.server.listen(listen_address, listen_port, workers > 1))
         {
-            std::cerr << "Navázání spojení bylo neúspěšné." << std::endl;
-            exit(EXIT_FAILURE);
+            return EXIT_FAILURE;
         }
     }
-    int i = send(user_socket, buffer.data(), (current_position - buffer.data()), 0);
-    if(i == -1)
-    {
-        std::cerr << "Data se neposlala." << std::endl;
-    }
-    std::vector<char> answer(buffer_size);
-    // nastavení timeoutu v případě čekání na data
-    struct timeval time;
-    time.tv_sec = 5;
-    time.tv_usec = 0;
-    if(setsockopt(user_socket, SOL_SOCKET, SO_RCVTIMEO, (char*)&time, sizeof(time)) == -1)
+
+    // metriky všech vláken vystavuje první vlákno ve své smyčce
+    std::vector<const DNS_metrics*> metrics;
+    for(const std::unique_ptr<Daemon_worker>& worker : pool)
     {
-        std::cerr << "Nepodařilo se nastavit timeout";
+        metrics.push_back(&worker->metrics);
     }
-    if((i = recv(user_socket, answer.data(), buffer_size, 0)) == -1)
+    std::unique_ptr<DNS_metrics_http> http;
+    if(metrics_port != 0)
     {
-        std::cerr << "Žádná data nebyla obdržena." << std::endl;
-        exit(EXIT_FAILURE);
+        http.reset(new DNS_metrics_http(pool[0]->engine, [metrics]() { return metrics_prometheus(metrics); }));
+        if(!http->listen(listen_address, metrics_port))
+        {
+            return EXIT_FAILURE;
+        }
     }
-    answer.resize(i);
-    
-    return answer;
-}
 
-/**
-    Funkce na zpracování ukazatelů v DNS odpovědi
-    @param reader - Aktuální pozice buffer v odpovědi
-    @param buffer - Buffer s celou odpovědí
-    @return - Zpracovaný domain name
-*/
-std::string read_domain_name(char*& reader, const std::vector<char>& buffer)
-{
-    std::string domainName;
-    char* endReader = nullptr; // použito ke skoku zpět na prvotní lokaci
-
-    while (true)
+    std::atomic<bool> stop(false);
+    for(size_t w = 0; w < workers; w++)
     {
-        uint8_t length = static_cast<uint8_t>(*reader);
-
-        if (length == 0)
+        Daemon_worker& worker = *pool[w];
+        worker.thread = std::thread([&worker, &stop]()
         {
-            reader++; // přeskočení null bytu
-            break;
-        }
-        // pointer (je potřeba udělat skok)
-        else if ((length & 0xC0) == 0xC0)
-        {
-            if (!endReader)
+            while(!stop.load(std::memory_order_relaxed))
             {
-                endReader = reader + 2;
+                worker.engine.run_once(250);
             }
-            // vypočítání offsetu
-            uint16_t offset = (length & 0x3F) << 8 | static_cast<uint8_t>(*(reader + 1));
-            reader = const_cast<char*>(buffer.data()) + offset; // provedení skoku na pozici offsetu
-        }
-        else
+        });
+        if(!cpus.empty())
         {
-            if (!domainName.empty())
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[w % cpus.size()], &set);
+            if(pthread_setaffinity_np(worker.thread.native_handle(), sizeof(set), &set) != 0)
             {
-                domainName += '.';
+                std::cerr << "Vlákno nelze připnout na procesor " << cpus[w % cpus.size()] << "." << std::endl;
             }
-            domainName.append(reader + 1, reader + length + 1);
-            reader += length + 1;
         }
     }
 
-    if (endReader) {
-        reader = endReader; // skočení na prvotní lokaci pokud došlo ke skoku
-    }
-
-    return domainName;
-}
-
-/**
-    Funkce na zpracování odpovědi na výstup
-    @param reader - Aktuální místo v bufferu
-    @param buffer - Celý buffer z odpovědí
-    @return - Struktura DNS_Record s hodnotami, které se mají vypsat na výstup
-*/
-DNS_Record parseDNS_Record(char*& reader, const std::vector<char>& buffer)
-{
-    DNS_Record record;
-
-    record.name = read_domain_name(reader, buffer);
-
-    // uložení všech hodnot potřebných pro výpis do struktury record
-    memcpy(&record.type, reader, 2);
-    record.type = ntohs(record.type);
-    reader += 2;
-
-    memcpy(&record.dnsclass, reader, 2);
-    record.dnsclass = ntohs(record.dnsclass);
-    reader += 2;
-
-    memcpy(&record.ttl, reader, 4);
-    record.ttl = ntohl(record.ttl);
-    reader += 4;
-
-    uint16_t data_len;
-    memcpy(&data_len, reader, 2);
-    data_len = ntohs(data_len);
-    reader += 2;
-
-    // A záznam
-    if (record.type == 1 && data_len == 4)
-    {
-        struct in_addr addr;
-        memcpy(&addr, reader, data_len);
-        record.rdata = inet_ntoa(addr);
-        reader += data_len;
-    }
-    // AAAA záznam
-    else if (record.type == 28 && data_len == 16)
-    {
-        char ipv6_address[INET6_ADDRSTRLEN];
-        inet_ntop(AF_INET6, reader, ipv6_address, INET6_ADDRSTRLEN);
-        record.rdata = ipv6_address;
-        reader += data_len;
-    }
-    // PTR, CNAME a NS záznamy
-    else if (record.type == 2 || record.type == 12 || record.type == 5)
+    int signal;
+    sigwait(&signals, &signal);
+    stop = true;
+    uint64_t queries = 0, hits = 0;
+    for(std::unique_ptr<Daemon_worker>& worker : pool)
     {
-        record.rdata = read_domain_name(reader, buffer);
+        worker->thread.join();
+        queries += worker->server.queries();
+        hits += worker->server.cache_hits();
     }
-    else
+
+    std::cerr << "Dotazů: " << queries << ", z cache: " << hits << std::endl;
+    write_metrics(metrics_file, metrics);
+    if(!cache_file.empty() && !cache.save(cache_file))
     {
-        reader += data_len;
+        std::cerr << "Cache se nepodařilo uložit do " << cache_file << "." << std::endl;
     }
-
-    return record;
+    return 0;
 }
 
 /**
@@ -499,12 +518,40 @@ int main(int argc, char *argv[]) {
     bool arg_quadA = false;
     bool arg_port = false;
     bool has_server = false;
-
-    DNS_header header;
-    header_constr(&header);
-
-    std::string ip_name, server_name;
+    bool has_batch = false;
+    bool bulk_ptr = false;
+    bool has_cache_file = false;
+    bool has_daemon = false;
+    bool has_listen = false;
+    bool has_workers = false;
+    bool has_metrics_port = false;
+    bool has_affinity = false;
+    bool has_bootstrap = false;
+
+    std::string ip_name, batch_file, cache_file;
+    std::string listen_address = "127.0.0.1";
+    std::string bootstrap_server = "1.1.1.1";
+    std::vector<std::string> server_names;
     int ip_port = 53;
+    int listen_port = 0;
+    int metrics_port = 0;
+    std::string metrics_file;
+    std::string output_format;
+    std::vector<uint16_t> query_types;
+    size_t workers = 0;
+    std::vector<int> cpus;
+    Query_options options;
+    options.retries = 2;
+    options.tcp = false;
+    options.edns_payload = 1232;
+    options.iterative = false;
+    options.stale_window = 0;
+    options.prefetch_hits = 0;
+    options.metrics = nullptr;
+    bool has_retries = false;
+    bool has_edns = false;
+    bool has_stale = false;
+    bool has_prefetch = false;
 
     // zpracování argumentů
     for(int i = 1; i < argc; i++)
@@ -543,7 +590,7 @@ int main(int argc, char *argv[]) {
             if(i + 1 < argc)
             {
                 i++;
-                server_name = argv[i];
+                server_names.push_back(argv[i]);
                 has_server = true;
             }
             else
@@ -552,6 +599,25 @@ int main(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
         }
+        else if(strcmp(argv[i], "-b") == 0)
+        {
+            if(has_bootstrap == true)
+            {
+                std::cerr << "Argument -b již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_bootstrap = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                bootstrap_server = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán server pro zjištění adres serverů." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
         else if(strcmp(argv[i], "-p") == 0)
         {
             if(arg_port == true)
@@ -571,237 +637,514 @@ int main(int argc, char *argv[]) {
                 exit(EXIT_FAILURE);
             }
         }
+        else if(strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "-ptr") == 0)
+        {
+            if(has_batch == true)
+            {
+                std::cerr << "Argument -f nebo -ptr již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_batch = true;
+            bulk_ptr = (strcmp(argv[i], "-ptr") == 0);
+            if(i + 1 < argc)
+            {
+                i++;
+                batch_file = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán soubor s adresami." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-n") == 0)
+        {
+            if(has_retries == true)
+            {
+                std::cerr << "Argument -n již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_retries = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                options.retries = atoi(argv[i]);
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán počet opakování." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-stale") == 0 || strcmp(argv[i], "-prefetch") == 0)
+        {
+            bool stale = (strcmp(argv[i], "-stale") == 0);
+            bool& has_option = stale ? has_stale : has_prefetch;
+            if(has_option == true)
+            {
+                std::cerr << "Argument " << argv[i] << " již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_option = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                char* end;
+                unsigned long value = strtoul(argv[i], &end, 10);
+                if(*end != '\0' || argv[i][0] == '-' || value > UINT32_MAX)
+                {
+                    std::cerr << "Neplatná hodnota " << argv[i] << "." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                (stale ? options.stale_window : options.prefetch_hits) = value;
+            }
+            else
+            {
+                std::cerr << (stale ? "Nebyla zadána délka okna prošlých odpovědí." : "Nebyl zadán počet zásahů pro obnovu.") << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-e") == 0)
+        {
+            if(has_edns == true)
+            {
+                std::cerr << "Argument -e již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_edns = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                int payload = atoi(argv[i]);
+                if(payload < 0 || payload > 65535)
+                {
+                    std::cerr << "Neplatná velikost EDNS payloadu." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                options.edns_payload = payload;
+            }
+            else
+            {
+                std::cerr << "Nebyla zadána velikost EDNS payloadu." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-i") == 0)
+        {
+            if(options.iterative == true)
+            {
+                std::cerr << "Argument -i již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            options.iterative = true;
+        }
+        else if(strcmp(argv[i], "-tcp") == 0)
+        {
+            if(options.tcp == true)
+            {
+                std::cerr << "Argument -tcp již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            options.tcp = true;
+        }
+        else if(strcmp(argv[i], "-d") == 0)
+        {
+            if(has_daemon == true)
+            {
+                std::cerr << "Argument -d již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_daemon = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                listen_port = atoi(argv[i]);
+                if(listen_port <= 0 || listen_port > 65535)
+                {
+                    std::cerr << "Neplatný port démona." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán port démona." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-l") == 0)
+        {
+            if(has_listen == true)
+            {
+                std::cerr << "Argument -l již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_listen = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                listen_address = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyla zadána adresa pro naslouchání." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-w") == 0)
+        {
+            if(has_workers == true)
+            {
+                std::cerr << "Argument -w již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_workers = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                int count = atoi(argv[i]);
+                if(count < 0 || count > 1024)
+                {
+                    std::cerr << "Neplatný počet vláken." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                workers = count;
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán počet vláken." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-a") == 0)
+        {
+            if(has_affinity == true)
+            {
+                std::cerr << "Argument -a již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_affinity = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                // seznam procesorů oddělených čárkou, např. 0,2,4
+                std::string list = argv[i];
+                size_t start = 0;
+                while(start <= list.size())
+                {
+                    size_t end = list.find(',', start);
+                    if(end == std::string::npos)
+                    {
+                        end = list.size();
+                    }
+                    std::string item = list.substr(start, end - start);
+                    if(item.empty() || item.find_first_not_of("0123456789") != std::string::npos || atoi(item.c_str()) >= CPU_SETSIZE)
+                    {
+                        std::cerr << "Neplatný seznam procesorů." << std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+                    cpus.push_back(atoi(item.c_str()));
+                    start = end + 1;
+                }
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán seznam procesorů." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-m") == 0)
+        {
+            if(has_metrics_port == true)
+            {
+                std::cerr << "Argument -m již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_metrics_port = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                metrics_port = atoi(argv[i]);
+                if(metrics_port <= 0 || metrics_port > 65535)
+                {
+                    std::cerr << "Neplatný port pro metriky." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán port pro metriky." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-j") == 0)
+        {
+            if(!metrics_file.empty())
+            {
+                std::cerr << "Argument -j již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if(i + 1 < argc)
+            {
+                i++;
+                metrics_file = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán soubor pro metriky." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-t") == 0)
+        {
+            if(i + 1 < argc)
+            {
+                i++;
+                if(!parse_types(argv[i], query_types))
+                {
+                    std::cerr << "Neplatný typ záznamu v " << argv[i] << "." << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán typ záznamu." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-o") == 0)
+        {
+            if(!output_format.empty())
+            {
+                std::cerr << "Argument -o již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            if(i + 1 < argc)
+            {
+                i++;
+                lowerArg(argv[i]);
+                output_format = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán formát výstupu." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if(strcmp(argv[i], "-c") == 0)
+        {
+            if(has_cache_file == true)
+            {
+                std::cerr << "Argument -c již byl použit." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            has_cache_file = true;
+            if(i + 1 < argc)
+            {
+                i++;
+                cache_file = argv[i];
+            }
+            else
+            {
+                std::cerr << "Nebyl zadán soubor cache." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
         else
         {
             ip_name = argv[i];
         }
     }
-    if(ip_name.empty() == true)
+    if((has_listen == true || has_workers == true || has_affinity == true || has_metrics_port == true) && has_daemon == false)
+    {
+        std::cerr << "Argumenty -l, -w, -a a -m lze použít jen s -d." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(has_daemon == true && (has_batch == true || !ip_name.empty() || !output_format.empty()))
+    {
+        std::cerr << "V režimu démona nelze zadat adresu k rezoluci, -f ani -o." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::unique_ptr<DNS_output> output = make_output(output_format.empty() ? "human" : output_format, std::cout);
+    if(!output)
+    {
+        std::cerr << "Neznámý formát výstupu " << output_format << " (human, jsonl, binary)." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(ip_name.empty() == true && has_batch == false && has_daemon == false)
     {
         std::cerr << "Není nastavena žádná adresa k rezoluci.";
         exit(EXIT_FAILURE);
     }
-    if(has_server == false)
+    if(has_server == false && options.iterative == false)
     {
         std::cerr << "Není nastaven žádný DNS server.";
         exit(EXIT_FAILURE);
     }
+    if(has_batch == true && !ip_name.empty())
+    {
+        std::cerr << "S argumentem -f nelze zadat adresu k rezoluci." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(arg_reverse == true && arg_quadA == true)
+    {
+        std::cerr << "Neplatná kombinace přepínačů (-x a -6)." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(!query_types.empty() && arg_quadA == true)
+    {
+        std::cerr << "Argument -6 nelze kombinovat s -t (použijte -t AAAA)." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // bez -t platí původní přepínače: -x = PTR, -6 = AAAA, jinak A
+    if(query_types.empty())
+    {
+        query_types.push_back(arg_reverse ? 12 : (arg_quadA ? 28 : 1));
+    }
     // server_name je třeba rezolvovat (je ve tvaru domain name)
-    bool isServer = true;
     struct in_addr tmp_buffer;
     struct in6_addr tmp_buffer6;
-    std::vector<char> response;
-    DNS_header* dnsResponse;
-    char* reader;
-    if(inet_pton(AF_INET, server_name.c_str(), &tmp_buffer) != 1 && inet_pton(AF_INET6, server_name.c_str(), &tmp_buffer6) != 1)
-    {
-        response = DNS_query("1.1.1.1", server_name, ip_port, header, arg_reverse, isServer, arg_quadA, arg_recursion);
-        dnsResponse = reinterpret_cast<DNS_header*>(response.data());
-        reader = response.data() + sizeof(DNS_header);
-        while (*reader != 0) reader++;
-        reader += 5;
-        DNS_Record record;
-        for(int ans = 0; ans < ntohs(dnsResponse->DNS_ANCOUNT); ans++) 
-        {
-            record = parseDNS_Record(reader, response);
-        }
-        server_name = record.rdata;
-    }
-    isServer = false;
-
-    // rezoluce hledané adresy
-    std::vector<char> response2 = DNS_query(server_name, ip_name, ip_port, header, arg_reverse, isServer, arg_quadA, arg_recursion);
-
-    DNS_header* resp_header = reinterpret_cast<DNS_header*>(response2.data());
-
-    // zpracování flagů authority, recursive a truncated pro výstup
-    bool aa = ntohs(resp_header->DNS_FLAGS) & (1 << 10);
-    bool tc = ntohs(resp_header->DNS_FLAGS) & (1 << 9);
-    bool rd = ntohs(resp_header->DNS_FLAGS) & (1 << 8);
-
-    std::cout << "Authoritative: " << (aa ? "Yes" : "No") << ", ";
-    std::cout << "Recursive: " << (rd ? "Yes" : "No") << ", ";
-    std::cout << "Truncated: " << (tc ? "Yes" : "No") << std::endl;
-
-
-    dnsResponse = reinterpret_cast<DNS_header*>(response2.data());
-    reader = response2.data() + sizeof(DNS_header);
-
-    // výpis question sectionu
-    char* header_reader = response2.data();
-    header_reader += 4;
-    uint32_t numQ;
-    memcpy(&numQ,header_reader, 2);
-    numQ = ntohs(numQ);
-    std::cout << "Question section (" << numQ << ")" << std::endl;
-    header_reader += 2;
-
-    uint32_t numA;
-    memcpy(&numA, header_reader, 2);
-    numA = ntohs(numA);
-    header_reader += 2;
-
-    uint32_t numAut;
-    memcpy(&numAut, header_reader, 2);
-    numAut = ntohs(numAut);
-    header_reader += 2;
-
-    uint32_t numAdd;
-    memcpy(&numAdd, header_reader, 2);
-    numAdd = ntohs(numAdd);
-
-    while(*reader != 0) reader++;
-    reader += 1;
-    uint32_t typeQ;
-    memcpy(&typeQ, reader, 2);
-    typeQ = ntohs(typeQ);
-    reader += 2;
-
-    uint32_t classQ;
-    memcpy(&classQ, reader, 2);
-    classQ = ntohs(classQ);
-    reader += 2;
-
-    std::cout << "  " << ip_name << ".";
-    switch(typeQ)
+    std::unique_ptr<DNS_resolver> bootstrap;
+    for(std::string& server_name : server_names)
     {
-        case 1: std::cout << ", A";
-        break;
-        case 12: std::cout << ", PTR";
-        break;
-        case 28: std::cout << ", AAAA";
-        break;
+        if(inet_pton(AF_INET, server_name.c_str(), &tmp_buffer) != 1 && inet_pton(AF_INET6, server_name.c_str(), &tmp_buffer6) != 1)
+        {
+            // zjištění serveru se provádí vždy rekurzivně a bez iterativního režimu, přes server z -b
+            if(!bootstrap)
+            {
+                bootstrap.reset(new DNS_resolver(ip_port, cache_capacity));
+                Query_options bootstrap_options = options;
+                bootstrap_options.iterative = false;
+                if(!configure_resolver(*bootstrap, { bootstrap_server }, true, bootstrap_options))
+                {
+                    exit(EXIT_FAILURE);
+                }
+                if(has_cache_file == true)
+                {
+                    // adresa serveru z minulého běhu se vezme z cache bez dotazu
+                    bootstrap->load_cache(cache_file);
+                }
+            }
+            DNS_Response response;
+            int status = bootstrap->resolve(server_name, 1, response);
+            if(status != DNS_OK)
+            {
+                std::cerr << status_message(status) << std::endl;
+                return EXIT_FAILURE;
+            }
+            DNS_Record record;
+            for(const DNS_Record& answer : response.answers)
+            {
+                record = answer;
+            }
+            server_name = record.rdata;
+        }
     }
-    switch(classQ)
+    // snímek s adresou serveru načte hlavní rezolver (nebo démon) a při ukončení ho uloží znovu
+    if(bootstrap && has_cache_file == true && !bootstrap->save_cache(cache_file))
     {
-        case 1: std::cout << ", IN";
-        break;
+        std::cerr << "Cache se nepodařilo uložit do " << cache_file << "." << std::endl;
     }
-    std::cout << std::endl;
-
-    // výpis answer sectionu
-    std::cout << "Answer section (" << numA << ")" << std::endl;
 
-    for(uint32_t ans = 0; ans < numA; ans++) 
+    // režim démona, běží do SIGINT nebo SIGTERM
+    if(has_daemon == true)
     {
-        DNS_Record record = parseDNS_Record(reader, response2);
-
-        std::cout << "  " << record.name << ".";
-        switch(record.type)
-        {
-            case 1: std::cout << ", A";
-            break;
-            case 2: std::cout << ", NS";
-            break;
-            case 5: std::cout << ", CNAME";
-            break;
-            case 6: std::cout << ", SOA";
-            break;
-            case 12: std::cout << ", PTR";
-            break;
-            case 15: std::cout << ", MX";
-            break;
-            case 28: std::cout << ", AAAA";
-            break;
-        }
-        switch(record.dnsclass)
+        if(workers == 0)
         {
-            case 1: std::cout << ", IN";
-            break;
-        }
-        std::cout << ", " << std::dec << record.ttl;
-        if(record.type == 2 || record.type == 5 || record.type == 12)
-        {
-            std::cout << ", " << record.rdata << "." << std::endl;
-        }
-        else
-        {
-            std::cout << ", " << record.rdata << std::endl;
+            workers = std::max(1u, std::thread::hardware_concurrency());
         }
+        return DNS_daemon(server_names, ip_port, listen_address, listen_port, workers, cpus, options, has_cache_file ? cache_file : "",
+                          metrics_port, metrics_file);
     }
 
-    // výpis authority sectionu
-    std::cout << "Authority section (" << numAut << ")" << std::endl;
+    // metriky se sbírají jen pro hledané adresy, ne pro zjištění serverů
+    std::unique_ptr<DNS_metrics> metrics;
+    if(!metrics_file.empty())
+    {
+        metrics.reset(new DNS_metrics());
+        options.metrics = metrics.get();
+    }
 
-    for(uint32_t ans = 0; ans < numAut; ans++) 
+    DNS_resolver resolver(ip_port, cache_capacity);
+    if(!configure_resolver(resolver, server_names, arg_recursion, options))
+    {
+        exit(EXIT_FAILURE);
+    }
+    if(has_cache_file == true)
     {
-        DNS_Record record = parseDNS_Record(reader, response2);
+        // chybějící nebo poškozený soubor znamená jen prázdnou cache
+        resolver.load_cache(cache_file);
+    }
 
-        std::cout << "  " << record.name << ".";
-        switch(record.type)
+    // dávkový režim, adresy se čtou ze souboru nebo ze stdin
+    if(has_batch == true)
+    {
+        int failures;
+        if(batch_file == "-")
         {
-            case 1: std::cout << ", A";
-            break;
-            case 2: std::cout << ", NS";
-            break;
-            case 5: std::cout << ", CNAME";
-            break;
-            case 6: std::cout << ", SOA";
-            break;
-            case 12: std::cout << ", PTR";
-            break;
-            case 15: std::cout << ", MX";
-            break;
-            case 28: std::cout << ", AAAA";
-            break;
+            failures = DNS_batch(resolver, std::cin, query_types, *output, bulk_ptr);
         }
-        switch(record.dnsclass)
+        else
         {
-            case 1: std::cout << ", IN";
-            break;
+            std::ifstream input(batch_file);
+            if(!input)
+            {
+                std::cerr << "Soubor " << batch_file << " nelze otevřít." << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            failures = DNS_batch(resolver, input, query_types, *output, bulk_ptr);
         }
-        std::cout << ", " << std::dec << record.ttl;
-        if(record.type == 2 || record.type == 5 || record.type == 12)
+        output->flush();
+        if(has_cache_file == true && !resolver.save_cache(cache_file))
         {
-            std::cout << ", " << record.rdata << "." << std::endl;
+            std::cerr << "Cache se nepodařilo uložit do " << cache_file << "." << std::endl;
         }
-        else
+        if(metrics)
         {
-            std::cout << ", " << record.rdata << std::endl;
+            write_metrics(metrics_file, { metrics.get() });
         }
-    
+        return failures == 0 ? 0 : EXIT_FAILURE;
     }
 
-    // výpis additional sectionu
-    std::cout << "Additional section (" << numAdd << ")" << std::endl;
-
-    for(uint32_t ans = 0; ans < numAdd; ans++) 
+    // rezoluce hledané adresy, všechny typy najednou
+    if(arg_reverse == true)
     {
-        DNS_Record record = parseDNS_Record(reader, response2);
-
-        std::cout << "  " << record.name << ".";
-        switch(record.type)
-        {
-            case 1: std::cout << ", A";
-            break;
-            case 2: std::cout << ", NS";
-            break;
-            case 5: std::cout << ", CNAME";
-            break;
-            case 6: std::cout << ", SOA";
-            break;
-            case 12: std::cout << ", PTR";
-            break;
-            case 15: std::cout << ", MX";
-            break;
-            case 28: std::cout << ", AAAA";
-            break;
-        }
-        switch(record.dnsclass)
+        ip_name = get_ip_version(ip_name);
+    }
+    std::vector<DNS_Response> responses;
+    std::vector<int> statuses = resolver.resolve(ip_name, query_types, responses);
+    if(metrics)
+    {
+        write_metrics(metrics_file, { metrics.get() });
+    }
+    bool failed = false;
+    for(size_t i = 0; i < query_types.size(); i++)
+    {
+        if(statuses[i] == DNS_OK)
         {
-            case 1: std::cout << ", IN";
-            break;
+            output->response(ip_name, responses[i]);
+            continue;
         }
-        std::cout << ", " << std::dec << record.ttl;
-        if(record.type == 2 || record.type == 5 || record.type == 12)
+        failed = true;
+        if(query_types.size() == 1)
         {
-            std::cout << ", " << record.rdata << "." << std::endl;
+            output->error(ip_name, statuses[i], status_message(statuses[i]));
         }
         else
         {
-            std::cout << ", " << record.rdata << std::endl;
+            const char* type = type_name(query_types[i]);
+            output->error(ip_name, statuses[i], "Dotaz " + ip_name + " " + (type ? type : "TYPE" + std::to_string(query_types[i])) + ": " +
+                          status_message(statuses[i]));
         }
     }
+    output->flush();
+    if(failed)
+    {
+        return EXIT_FAILURE;
+    }
+    if(has_cache_file == true && !resolver.save_cache(cache_file))
+    {
+        std::cerr << "Cache se nepodařilo uložit do " << cache_file << "." << std::endl;
+    }
 
     return 0;
 
@@ -0,0 +1,882 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t DNS_cache::max_ttl;
+const uint32_t DNS_cache::stale_ttl;
+const uint32_t DNS_cache::stale_retry;
+const int DNS_cache::stale_timeout_ms;
+const uint32_t DNS_cache::prefetch_percent;
+
+// hlavička snapshotu: "DNSC", verze, počet položek, rezerva
+static const char snapshot_magic[4] = { 'D', 'N', 'S', 'C' };
+static const uint32_t snapshot_version = 1;
+static const size_t snapshot_header_size = 16;
+
+/**
+    Konstruktor cache
+    @param capacity - Maximální počet uložených odpovědí
+*/
+DNS_cache::DNS_cache(size_t capacity)
+    : capacity(std::max<size_t>(1, capacity)), hand(0), stale_window(0), prefetch_hits(0), snapshot(nullptr), snapshot_size(0)
+{
+    index.reserve(this->capacity);
+}
+
+/**
+    Nastavení okna, po které se prošlé odpovědi drží a vydávají při nedostupném serveru (RFC 8767)
+    Nastavuje se před load(), aby se ze snapshotu načetly i prošlé položky v okně.
+    @param window - Délka okna v sekundách po vypršení TTL, 0 = prošlé odpovědi se zahazují
+*/
+void DNS_cache::set_stale(uint32_t window)
+{
+    stale_window = window;
+}
+
+/**
+    Nastavení obnovy často používaných odpovědí před vypršením
+    @param hits - Počet zásahů od uložení, od kterého se odpověď v posledních prefetch_percent % TTL
+                  obnoví na pozadí, 0 = bez obnovy
+*/
+void DNS_cache::set_prefetch(uint32_t hits)
+{
+    prefetch_hits = hits;
+}
+
+/**
+    Destruktor cache, odmapuje snapshot
+*/
+DNS_cache::~DNS_cache()
+{
+    unmap();
+}
+
+/**
+    Sestavení klíče cache (jméno bez ohledu na velikost písmen, typ a třída)
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @return - Klíč do indexu
+*/
+std::string DNS_cache::make_key(const std::string& qname, uint16_t qtype, uint16_t qclass)
+{
+    std::string key;
+    key.reserve(qname.size() + 5);
+    for(char c : qname)
+    {
+        key += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    key += '\0';
+    key += static_cast<char>(qtype >> 8);
+    key += static_cast<char>(qtype & 0xFF);
+    key += static_cast<char>(qclass >> 8);
+    key += static_cast<char>(qclass & 0xFF);
+    return key;
+}
+
+/**
+    Určení shardu, do kterého klíč patří
+    @param key - Klíč cache (z make_key)
+    @param shards - Počet shardů
+    @return - Index shardu
+*/
+size_t DNS_cache::shard_of(const std::string& key, size_t shards)
+{
+    return std::hash<std::string>()(key) % shards;
+}
+
+/**
+    Zjištění, jak dlouho se smí odpověď držet v cache
+    Pozitivní odpověď podle nejmenšího TTL v answer sectionu, NXDOMAIN a NODATA
+    podle SOA z authority sectionu (menší z TTL a pole minimum, RFC 2308).
+    @param response - Zpracovaná odpověď
+    @return - TTL v sekundách, 0 pokud se odpověď nemá ukládat
+*/
+uint32_t response_ttl(const DNS_Response& response)
+{
+    // zkrácené odpovědi a jiné chyby než NXDOMAIN se neukládají
+    if(response.flags & (1 << 9))
+    {
+        return 0;
+    }
+    uint16_t rcode = response.flags & 0xF;
+    uint32_t ttl = DNS_cache::max_ttl;
+
+    if(rcode == 0 && !response.answers.empty())
+    {
+        for(const DNS_Record& record : response.answers)
+        {
+            ttl = std::min(ttl, record.ttl);
+        }
+        return ttl;
+    }
+    if(rcode != 0 && rcode != 3)
+    {
+        return 0;
+    }
+    // SOA (a jeho MINIMUM) se ověřuje už při zpracování odpovědi z přenosového tvaru
+    return std::min(ttl, response.negative_ttl);
+}
+
+/**
+    Nalezení položky a určení jejího stavu (platná, k obnově, prošlá v okně set_stale())
+    Prošlá odpověď se poprvé (a pak nejvýš jednou za stale_retry sekund) vrátí jako DNS_CACHE_EXPIRED,
+    aby se volající zkusil zeptat serveru, mezitím jako DNS_CACHE_STALE.
+    @param key - Klíč cache
+    @param state - Sem se uloží stav položky
+    @return - Položka, nullptr pokud v cache není (state je DNS_CACHE_MISS)
+*/
+DNS_cache::Entry* DNS_cache::find(const std::string& key, DNS_cache_state& state)
+{
+    state = DNS_CACHE_MISS;
+    auto it = index.find(key);
+    if(it == index.end())
+    {
+        // odpověď z předchozího běhu se přesune do paměti
+        if(!lookup_snapshot(key))
+        {
+            return nullptr;
+        }
+        it = index.find(key);
+    }
+    Entry& entry = entries[it->second];
+    clock::time_point now = clock::now();
+    if(entry.expires <= now)
+    {
+        if(entry.expires + std::chrono::seconds(stale_window) <= now)
+        {
+            entry.key.clear();
+            index.erase(it);
+            return nullptr;
+        }
+        entry.referenced = true;
+        if(entry.retry > now)
+        {
+            state = DNS_CACHE_STALE;
+            return &entry;
+        }
+        entry.retry = now + std::chrono::seconds(stale_retry);
+        state = DNS_CACHE_EXPIRED;
+        return &entry;
+    }
+    entry.referenced = true;
+    entry.hits++;
+    state = DNS_CACHE_HIT;
+    if(prefetch_hits > 0 && !entry.prefetching && entry.hits >= prefetch_hits &&
+       (entry.expires - now) * 100 <= (entry.expires - entry.stored) * prefetch_percent)
+    {
+        entry.prefetching = true;
+        state = DNS_CACHE_PREFETCH;
+    }
+    return &entry;
+}
+
+/**
+    Nové TTL záznamu vydávaného z cache
+    @param ttl - TTL při uložení
+    @param elapsed - Sekundy od uložení
+    @param stale - Zda jde o prošlou odpověď (TTL stale_ttl)
+    @return - TTL pro klienta
+*/
+static uint32_t cached_ttl(uint32_t ttl, uint32_t elapsed, bool stale)
+{
+    if(stale)
+    {
+        return DNS_cache::stale_ttl;
+    }
+    return (ttl > elapsed) ? ttl - elapsed : 0;
+}
+
+/**
+    Vyhledání odpovědi v cache, TTL záznamů se sníží o dobu strávenou v cache
+    Prošlá odpověď v okně set_stale() se vrátí s TTL stale_ttl (stavy viz find()).
+    Zpráva se zpracuje při prvním vyhledání a zpracovaná podoba zůstane v položce.
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param response - Sem se uloží nalezená odpověď
+    @return - Stav nalezené odpovědi, DNS_CACHE_MISS pokud nebyla nalezena
+*/
+DNS_cache_state DNS_cache::lookup(const std::string& qname, uint16_t qtype, uint16_t qclass, DNS_Response& response)
+{
+    std::string key = make_key(qname, qtype, qclass);
+    DNS_cache_state state;
+    Entry* entry = find(key, state);
+    if(!entry)
+    {
+        return DNS_CACHE_MISS;
+    }
+    if(!entry->parsed)
+    {
+        if(!parse_response(entry->message, entry->response))
+        {
+            entry->key.clear();
+            index.erase(key);
+            return DNS_CACHE_MISS;
+        }
+        entry->parsed = true;
+    }
+    response = entry->response;
+
+    bool stale = (state == DNS_CACHE_EXPIRED || state == DNS_CACHE_STALE);
+    uint32_t elapsed = std::chrono::duration_cast<std::chrono::seconds>(clock::now() - entry->stored).count();
+    for(std::vector<DNS_Record>* section : { &response.answers, &response.authority, &response.additional })
+    {
+        for(DNS_Record& record : *section)
+        {
+            record.ttl = cached_ttl(record.ttl, elapsed, stale);
+        }
+    }
+    return state;
+}
+
+/**
+    Vyhledání odpovědi v přenosovém tvaru, jak ji poslal server, bez zpracování záznamů
+    Zpráva nemá OPT, TTL všech záznamů se přepíšou na místě (stejně jako u lookup()),
+    ID a flagy nastaví volající.
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param message - Sem se zkopíruje nalezená zpráva
+    @return - Stav nalezené odpovědi, DNS_CACHE_MISS pokud nebyla nalezena
+*/
+DNS_cache_state DNS_cache::lookup_wire(const std::string& qname, uint16_t qtype, uint16_t qclass, std::vector<char>& message)
+{
+    std::string key = make_key(qname, qtype, qclass);
+    DNS_cache_state state;
+    Entry* entry = find(key, state);
+    if(!entry)
+    {
+        return DNS_CACHE_MISS;
+    }
+    message = entry->message;
+    DNS_MessageView view;
+    if(!parse_message_view(message.data(), message.size(), view))
+    {
+        entry->key.clear();
+        index.erase(key);
+        return DNS_CACHE_MISS;
+    }
+
+    bool stale = (state == DNS_CACHE_EXPIRED || state == DNS_CACHE_STALE);
+    uint32_t elapsed = std::chrono::duration_cast<std::chrono::seconds>(clock::now() - entry->stored).count();
+    for(const std::vector<DNS_RecordView>* section : { &view.answers, &view.authority, &view.additional })
+    {
+        for(const DNS_RecordView& record : *section)
+        {
+            // TTL je před délkou rdata
+            uint32_t ttl = cached_ttl(record.ttl, elapsed, stale);
+            char* field = message.data() + record.rdata_offset - 6;
+            for(int i = 0; i < 4; i++)
+            {
+                field[i] = static_cast<char>(ttl >> (24 - 8 * i));
+            }
+        }
+    }
+    return state;
+}
+
+/**
+    Nalezení slotu pro novou položku, při plné cache vyhození podle CLOCK
+    @return - Index volného slotu
+*/
+size_t DNS_cache::free_slot()
+{
+    if(entries.size() < capacity)
+    {
+        entries.emplace_back();
+        return entries.size() - 1;
+    }
+    clock::time_point now = clock::now();
+    while(true)
+    {
+        size_t slot = hand;
+        hand = (hand + 1) % entries.size();
+        Entry& entry = entries[slot];
+        if(entry.key.empty())
+        {
+            return slot;
+        }
+        // prošlé položky se vyhazují přednostně, jinak dostanou druhou šanci
+        if(entry.referenced && entry.expires > now)
+        {
+            entry.referenced = false;
+            continue;
+        }
+        index.erase(entry.key);
+        entry.key.clear();
+        return slot;
+    }
+}
+
+/**
+    Uložení odpovědi do cache (jen pokud ji lze podle TTL uložit), přenosový tvar se sestaví
+    ze zpracované odpovědi (např. výsledek iterativní rezoluce poskládaný z více zpráv)
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param response - Zpracovaná odpověď
+*/
+void DNS_cache::store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response)
+{
+    uint32_t ttl = response_ttl(response);
+    if(ttl == 0)
+    {
+        return;
+    }
+    std::vector<char> message;
+    encode_response(response, message);
+    insert(make_key(qname, qtype, qclass), ttl, response, message);
+}
+
+/**
+    Uložení odpovědi do cache i s původní zprávou od serveru, ze které se bude vydávat
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param response - Zpracovaná odpověď (podle ní se určí TTL)
+    @param message - Odpověď serveru v přenosovém tvaru
+*/
+void DNS_cache::store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response, const std::vector<char>& message)
+{
+    uint32_t ttl = response_ttl(response);
+    if(ttl == 0)
+    {
+        return;
+    }
+    std::vector<char> copy(message);
+    insert(make_key(qname, qtype, qclass), ttl, response, copy);
+}
+
+/**
+    Zápis položky do volného nebo stávajícího slotu
+    @param key - Klíč cache
+    @param ttl - Doba platnosti v sekundách
+    @param response - Zpracovaná odpověď
+    @param message - Zpráva v přenosovém tvaru, OPT se z ní odstraní a obsah se přesune do položky
+*/
+void DNS_cache::insert(const std::string& key, uint32_t ttl, const DNS_Response& response, std::vector<char>& message)
+{
+    // OPT patří ke spojení se serverem, klient dostane vlastní podle svého dotazu
+    if(!strip_opt(message))
+    {
+        message.clear();
+        encode_response(response, message);
+        strip_opt(message);
+    }
+    size_t slot;
+    auto it = index.find(key);
+    if(it != index.end())
+    {
+        slot = it->second;
+    }
+    else
+    {
+        slot = free_slot();
+        index[key] = slot;
+    }
+    Entry& entry = entries[slot];
+    entry.key = key;
+    entry.message = std::move(message);
+    entry.parsed = true;
+    entry.response = response;
+    entry.stored = clock::now();
+    entry.expires = entry.stored + std::chrono::seconds(ttl);
+    entry.retry = entry.stored;
+    entry.hits = 0;
+    entry.prefetching = false;
+    entry.referenced = false;
+}
+
+/**
+    Počet platných položek v cache
+    @return - Počet položek
+*/
+size_t DNS_cache::size() const
+{
+    return index.size();
+}
+
+/**
+    Čtení a zápis čísel v síťovém pořadí pro formát snapshotu
+*/
+static uint16_t get16(const char* data)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const char* data)
+{
+    return static_cast<uint32_t>(get16(data)) << 16 | get16(data + 2);
+}
+
+static uint64_t get64(const char* data)
+{
+    return static_cast<uint64_t>(get32(data)) << 32 | get32(data + 4);
+}
+
+static void put16(std::vector<char>& out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value & 0xFF));
+}
+
+static void put32(std::vector<char>& out, uint32_t value)
+{
+    put16(out, value >> 16);
+    put16(out, value & 0xFFFF);
+}
+
+static void put64(std::vector<char>& out, uint64_t value)
+{
+    put32(out, value >> 32);
+    put32(out, value & 0xFFFFFFFF);
+}
+
+/**
+    Odmapování souboru snapshotu (po uvolnění posledního shardu, který ho používá)
+*/
+DNS_cache::Mapping::~Mapping()
+{
+    munmap(const_cast<char*>(data), size);
+}
+
+/**
+    Odpojení snapshotu od cache
+*/
+void DNS_cache::unmap()
+{
+    mapping.reset();
+    snapshot = nullptr;
+    snapshot_size = 0;
+    snapshot_index.clear();
+}
+
+/**
+    Připojení namapovaného snapshotu k cache, index položek je zatím prázdný
+    @param file - Namapovaný snapshot
+*/
+void DNS_cache::attach_snapshot(const std::shared_ptr<const Mapping>& file)
+{
+    unmap();
+    mapping = file;
+    snapshot = file->data;
+    snapshot_size = file->size;
+}
+
+/**
+    Namapování snapshotu ze souboru a kontrola hlavičky
+    Položka: délka (4 B), uloženo a platnost do (8 B, unix čas), délka klíče (2 B),
+    klíč, délka zprávy (2 B) a DNS zpráva, jak ji poslal server (bez OPT).
+    Snapshot se přepisuje přes rename(), takže namapovaný soubor se pod rukama nezmění.
+    @param path - Cesta k souboru
+    @return - Namapovaný soubor, nullptr pokud chybí nebo nemá platnou hlavičku
+*/
+std::shared_ptr<const DNS_cache::Mapping> DNS_cache::map_snapshot(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+    {
+        return nullptr;
+    }
+    struct stat info;
+    if(fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < snapshot_header_size)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<const Mapping> file = std::make_shared<const Mapping>(static_cast<const char*>(data), info.st_size);
+    if(memcmp(file->data, snapshot_magic, 4) != 0 || get32(file->data + 4) != snapshot_version)
+    {
+        return nullptr;
+    }
+    return file;
+}
+
+/**
+    Jeden průchod položkami snapshotu, callback dostane klíč a offset každé platné položky
+    (i prošlé v okně stale_window)
+    @param file - Namapovaný snapshot
+    @param stale_window - Okno prošlých odpovědí v sekundách
+    @param callback - Funkce (klíč, offset položky)
+*/
+template<typename Entry_callback>
+void DNS_cache::scan_snapshot(const Mapping& file, uint32_t stale_window, Entry_callback&& callback)
+{
+    uint32_t count = get32(file.data + 8);
+    uint64_t now = time(nullptr);
+    size_t offset = snapshot_header_size;
+    for(uint32_t i = 0; i < count && offset + 22 <= file.size; i++)
+    {
+        uint32_t entry_len = get32(file.data + offset);
+        uint16_t key_len = get16(file.data + offset + 20);
+        if(entry_len < 24u + key_len || offset + entry_len > file.size)
+        {
+            break; // poškozený nebo neúplný soubor, zbytek se ignoruje
+        }
+        if(get64(file.data + offset + 12) + stale_window > now)
+        {
+            callback(std::string(file.data + offset + 22, key_len), offset);
+        }
+        offset += entry_len;
+    }
+}
+
+/**
+    Namapování snapshotu ze souboru, zaindexují se jen klíče platných položek
+    @param path - Cesta k souboru
+    @return - true pokud byl snapshot načten
+*/
+bool DNS_cache::load(const std::string& path)
+{
+    unmap();
+    std::shared_ptr<const Mapping> file = map_snapshot(path);
+    if(!file)
+    {
+        return false;
+    }
+    attach_snapshot(file);
+    scan_snapshot(*file, stale_window, [this](std::string&& key, size_t offset)
+    {
+        snapshot_index[std::move(key)] = offset;
+    });
+    return true;
+}
+
+/**
+    Přesun odpovědi ze snapshotu do paměti, zpráva se jen zkopíruje a ověří její struktura
+    (záznamy se zpracují až při lookup()). Položka si ponechá původní čas uložení i vypršení, takže se s ní dál zachází stejně
+    (snižování TTL, prošlé odpovědi v okně set_stale()).
+    @param key - Klíč cache
+    @return - true pokud byla nalezena platná (nebo prošlá v okně) odpověď
+*/
+bool DNS_cache::lookup_snapshot(const std::string& key)
+{
+    auto it = snapshot_index.find(key);
+    if(it == snapshot_index.end())
+    {
+        return false;
+    }
+    const char* data = snapshot + it->second;
+    uint32_t entry_len = get32(data);
+    uint64_t stored = get64(data + 4);
+    uint64_t expires = get64(data + 12);
+    uint64_t now = time(nullptr);
+    size_t msg_pos = 22 + key.size();
+    if(expires + stale_window <= now || msg_pos + 2 > entry_len)
+    {
+        return false;
+    }
+    uint16_t msg_len = get16(data + msg_pos);
+    if(msg_pos + 2 + msg_len > entry_len)
+    {
+        return false;
+    }
+    std::vector<char> message(data + msg_pos + 2, data + msg_pos + 2 + msg_len);
+    DNS_MessageView view;
+    if(!strip_opt(message) || !parse_message_view(message.data(), message.size(), view))
+    {
+        return false;
+    }
+    size_t slot = free_slot();
+    index[key] = slot;
+    Entry& entry = entries[slot];
+    clock::time_point steady_now = clock::now();
+    entry.key = key;
+    entry.message = std::move(message);
+    entry.parsed = false;
+    entry.response = DNS_Response();
+    entry.stored = steady_now - std::chrono::seconds((now > stored) ? now - stored : 0);
+    entry.expires = steady_now + std::chrono::seconds(expires) - std::chrono::seconds(now);
+    entry.retry = entry.stored;
+    entry.hits = 0;
+    entry.prefetching = false;
+    entry.referenced = false;
+    return true;
+}
+
+/**
+    Zápis platných položek cache (a dosud platných položek starého snapshotu) za hlavičku snapshotu
+    @param out - Buffer snapshotu, položky se připojí na konec
+    @param count - Počet zapsaných položek, zvýší se
+*/
+void DNS_cache::serialize(std::vector<char>& out, uint32_t& count) const
+{
+    clock::time_point now = clock::now();
+    uint64_t wall_now = time(nullptr);
+
+    for(const Entry& entry : entries)
+    {
+        // zpráva se zapíše tak, jak přišla od serveru (jen bez OPT), nic se znovu nesestavuje
+        const std::vector<char>& message = entry.message;
+        if(entry.key.empty() || entry.expires + std::chrono::seconds(stale_window) <= now || message.size() > 0xFFFF)
+        {
+            continue;
+        }
+        size_t start = out.size();
+        put32(out, 0);
+        put64(out, wall_now - std::chrono::duration_cast<std::chrono::seconds>(now - entry.stored).count());
+        // prošlá položka v okně se uloží s časem vypršení v minulosti
+        put64(out, wall_now + std::chrono::duration_cast<std::chrono::seconds>(entry.expires - now).count());
+        put16(out, entry.key.size());
+        out.insert(out.end(), entry.key.begin(), entry.key.end());
+        put16(out, message.size());
+        out.insert(out.end(), message.begin(), message.end());
+        uint32_t entry_len = out.size() - start;
+        for(int i = 0; i < 4; i++)
+        {
+            out[start + i] = static_cast<char>(entry_len >> (24 - 8 * i));
+        }
+        count++;
+    }
+    // položky starého snapshotu, které se v tomto běhu nepoužily, se zkopírují beze změny
+    for(const auto& item : snapshot_index)
+    {
+        if(index.count(item.first))
+        {
+            continue;
+        }
+        const char* entry = snapshot + item.second;
+        if(get64(entry + 12) + stale_window <= wall_now)
+        {
+            continue;
+        }
+        out.insert(out.end(), entry, entry + get32(entry));
+        count++;
+    }
+}
+
+/**
+    Zapsání snapshotu do souboru
+    Zapisuje se do dočasného souboru, který se atomicky přejmenuje na cílový,
+    takže jiný proces čtoucí snapshot nikdy neuvidí rozepsaný soubor.
+    @param path - Cesta k souboru
+    @param out - Hlavička a položky snapshotu, doplní se počet položek
+    @param count - Počet položek
+    @return - true pokud se snapshot podařilo uložit
+*/
+bool DNS_cache::write_snapshot(const std::string& path, std::vector<char>& out, uint32_t count)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        out[8 + i] = static_cast<char>(count >> (24 - 8 * i));
+    }
+
+    std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if(!file.write(out.data(), out.size()) || !file.flush())
+    {
+        file.close();
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    file.close();
+    if(rename(tmp_path.c_str(), path.c_str()) == -1)
+    {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+    Hlavička snapshotu (počet položek se doplní při zápisu)
+    @param out - Buffer snapshotu
+*/
+static void snapshot_header(std::vector<char>& out)
+{
+    out.assign(snapshot_magic, snapshot_magic + 4);
+    put32(out, snapshot_version);
+    put32(out, 0);
+    put32(out, 0);
+}
+
+/**
+    Uložení platných položek cache (a dosud platných položek starého snapshotu) do souboru
+    @param path - Cesta k souboru
+    @return - true pokud se snapshot podařilo uložit
+*/
+bool DNS_cache::save(const std::string& path) const
+{
+    std::vector<char> out;
+    snapshot_header(out);
+    uint32_t count = 0;
+    serialize(out, count);
+    return write_snapshot(path, out, count);
+}
+
+/**
+    Konstruktor sdílené cache
+    @param capacity - Maximální počet uložených odpovědí (rozdělí se mezi shardy)
+    @param shards - Počet shardů
+*/
+DNS_shared_cache::DNS_shared_cache(size_t capacity, size_t shards)
+{
+    shards = std::max<size_t>(1, shards);
+    for(size_t i = 0; i < shards; i++)
+    {
+        this->shards.emplace_back(new Shard((capacity + shards - 1) / shards));
+    }
+}
+
+/**
+    Nastavení okna prošlých odpovědí a obnovy na pozadí pro všechny shardy (viz DNS_cache)
+    @param window - Délka okna v sekundách po vypršení TTL
+*/
+void DNS_shared_cache::set_stale(uint32_t window)
+{
+    for(std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->cache.set_stale(window);
+    }
+}
+
+void DNS_shared_cache::set_prefetch(uint32_t hits)
+{
+    for(std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->cache.set_prefetch(hits);
+    }
+}
+
+/**
+    Vyhledání odpovědi v shardu, do kterého dotaz patří
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param response - Sem se uloží nalezená odpověď
+    @return - Stav nalezené odpovědi, DNS_CACHE_MISS pokud nebyla nalezena
+*/
+DNS_cache_state DNS_shared_cache::lookup(const std::string& qname, uint16_t qtype, uint16_t qclass, DNS_Response& response)
+{
+    Shard& shard = *shards[DNS_cache::shard_of(DNS_cache::make_key(qname, qtype, qclass), shards.size())];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.cache.lookup(qname, qtype, qclass, response);
+}
+
+/**
+    Vyhledání odpovědi v přenosovém tvaru v shardu, do kterého dotaz patří (viz DNS_cache::lookup_wire)
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param message - Sem se zkopíruje nalezená zpráva
+    @return - Stav nalezené odpovědi, DNS_CACHE_MISS pokud nebyla nalezena
+*/
+DNS_cache_state DNS_shared_cache::lookup_wire(const std::string& qname, uint16_t qtype, uint16_t qclass, std::vector<char>& message)
+{
+    Shard& shard = *shards[DNS_cache::shard_of(DNS_cache::make_key(qname, qtype, qclass), shards.size())];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    return shard.cache.lookup_wire(qname, qtype, qclass, message);
+}
+
+/**
+    Uložení odpovědi do shardu, do kterého dotaz patří
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param response - Zpracovaná odpověď
+*/
+void DNS_shared_cache::store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response)
+{
+    Shard& shard = *shards[DNS_cache::shard_of(DNS_cache::make_key(qname, qtype, qclass), shards.size())];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.cache.store(qname, qtype, qclass, response);
+}
+
+void DNS_shared_cache::store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response, const std::vector<char>& message)
+{
+    Shard& shard = *shards[DNS_cache::shard_of(DNS_cache::make_key(qname, qtype, qclass), shards.size())];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.cache.store(qname, qtype, qclass, response, message);
+}
+
+/**
+    Počet platných položek ve všech shardech
+    @return - Počet položek
+*/
+size_t DNS_shared_cache::size() const
+{
+    size_t total = 0;
+    for(const std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total += shard->cache.size();
+    }
+    return total;
+}
+
+/**
+    Načtení snapshotu: soubor se namapuje a projde jednou, všechny shardy sdílí stejné
+    mapování a každá položka se zaindexuje jen do shardu podle hashe klíče
+    @param path - Cesta k souboru
+    @return - true pokud byl snapshot načten
+*/
+bool DNS_shared_cache::load(const std::string& path)
+{
+    std::vector<std::unique_lock<std::mutex>> guards;
+    for(std::unique_ptr<Shard>& shard : shards)
+    {
+        guards.emplace_back(shard->lock);
+        shard->cache.unmap();
+    }
+    std::shared_ptr<const DNS_cache::Mapping> file = DNS_cache::map_snapshot(path);
+    if(!file)
+    {
+        return false;
+    }
+    for(std::unique_ptr<Shard>& shard : shards)
+    {
+        shard->cache.attach_snapshot(file);
+    }
+    DNS_cache::scan_snapshot(*file, shards[0]->cache.stale_window, [this](std::string&& key, size_t offset)
+    {
+        DNS_cache& cache = shards[DNS_cache::shard_of(key, shards.size())]->cache;
+        cache.snapshot_index[std::move(key)] = offset;
+    });
+    return true;
+}
+
+/**
+    Uložení všech shardů do jednoho snapshotu (stejný formát jako DNS_cache::save)
+    @param path - Cesta k souboru
+    @return - true pokud se snapshot podařilo uložit
+*/
+bool DNS_shared_cache::save(const std::string& path) const
+{
+    std::vector<char> out;
+    snapshot_header(out);
+    uint32_t count = 0;
+    for(const std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->cache.serialize(out, count);
+    }
+    return DNS_cache::write_snapshot(path, out, count);
+}
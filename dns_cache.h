@@ -0,0 +1,189 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Cache odpovědí s ohledem na TTL, včetně negativních odpovědí
+*/
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "dns_wire.h"
+
+/*
+    Výsledek vyhledání v cache. Kromě platné odpovědi může cache vrátit odpověď, kterou je
+    vhodné obnovit na pozadí (často používaná a blízko vypršení), nebo prošlou odpověď
+    v okně pro vydání prošlých dat (RFC 8767) s TTL stale_ttl.
+*/
+enum DNS_cache_state {
+    DNS_CACHE_MISS = 0,
+    DNS_CACHE_HIT,
+    DNS_CACHE_PREFETCH,   // platná odpověď, volající ji má obnovit na pozadí
+    DNS_CACHE_EXPIRED,    // prošlá odpověď, volající se má zeptat serveru a vydat ji jen při jeho selhání
+    DNS_CACHE_STALE       // prošlá odpověď, obnova se nedávno zkoušela, vydá se hned
+};
+
+/*
+    Prošlá odpověď čekající na výsledek obnovy (DNS_CACHE_EXPIRED): vydá se, pokud server selže
+    (chyba, SERVFAIL, REFUSED) nebo neodpoví do stale_timeout_ms, jinak jde klientovi čerstvá odpověď
+*/
+struct DNS_stale_answer {
+    bool answered;
+    DNS_Response response;
+    std::vector<char> message;   // démon: prošlá odpověď v přenosovém tvaru (lookup_wire)
+};
+
+/**
+    Zda odpověď znamená selhání serveru, při kterém se místo ní vydá prošlá odpověď
+    @param flags - Flagy odpovědi
+    @return - true pro SERVFAIL a REFUSED (NXDOMAIN je platná odpověď)
+*/
+inline bool server_failure(uint16_t flags)
+{
+    uint16_t rcode = flags & 0x000F;
+    return rcode == 2 || rcode == 5;
+}
+
+/*
+    Cache odpovědí podle (qname, qtype, qclass). Počet položek je omezen,
+    při zaplnění se vyhazuje algoritmem CLOCK (druhá šance).
+    Každá položka drží odpověď v přenosovém tvaru, jak přišla od serveru (bez OPT), a z ní
+    se vydává s upraveným TTL (lookup_wire); zpracovaná podoba pro lookup() vzniká až na požádání.
+    Obsah lze uložit do souboru (snapshot) se zprávami beze změny a při dalším spuštění ho
+    namapovat přes mmap, položka ze snapshotu se zkopíruje do paměti až při prvním dotazu na ni.
+*/
+class DNS_cache {
+public:
+    explicit DNS_cache(size_t capacity);
+    ~DNS_cache();
+    DNS_cache(const DNS_cache&) = delete;
+    DNS_cache& operator=(const DNS_cache&) = delete;
+
+    void set_stale(uint32_t window);
+    void set_prefetch(uint32_t hits);
+    DNS_cache_state lookup(const std::string& qname, uint16_t qtype, uint16_t qclass, DNS_Response& response);
+    DNS_cache_state lookup_wire(const std::string& qname, uint16_t qtype, uint16_t qclass, std::vector<char>& message);
+    void store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response);
+    void store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response, const std::vector<char>& message);
+    size_t size() const;
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    static std::string make_key(const std::string& qname, uint16_t qtype, uint16_t qclass);
+    static size_t shard_of(const std::string& key, size_t shards);
+
+    static const uint32_t max_ttl = 86400;
+    static const uint32_t stale_ttl = 30;             // TTL záznamů prošlé odpovědi (RFC 8767)
+    static const uint32_t stale_retry = 30;           // po neúspěšné obnově se prošlá odpověď vydává hned
+    static const int stale_timeout_ms = 1800;         // jak dlouho se čeká na obnovu, než se vydá prošlá odpověď
+    static const uint32_t prefetch_percent = 10;      // obnova na pozadí v posledních 10 % TTL
+
+private:
+    friend class DNS_shared_cache;
+
+    typedef std::chrono::steady_clock clock;
+
+    /*
+        Položka cache, slot v kruhu algoritmu CLOCK
+    */
+    struct Entry {
+        std::string key;
+        std::vector<char> message;   // odpověď v přenosovém tvaru bez OPT
+        DNS_Response response;       // zpracovaná odpověď, platná jen při parsed
+        bool parsed;
+        clock::time_point stored;
+        clock::time_point expires;
+        clock::time_point retry;   // do té doby se prošlá odpověď vydává bez pokusu o obnovu
+        uint32_t hits;             // zásahy od uložení
+        bool prefetching;          // obnova na pozadí už byla zahájena
+        bool referenced;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, size_t> index;
+    size_t capacity;
+    size_t hand;
+    uint32_t stale_window;
+    uint32_t prefetch_hits;
+
+    /*
+        Namapovaný soubor snapshotu, u sdílené cache ho drží všechny shardy a odmapuje se s posledním
+    */
+    struct Mapping {
+        const char* data;
+        size_t size;
+        Mapping(const char* data, size_t size) : data(data), size(size) {}
+        ~Mapping();
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+    };
+
+    /*
+        Namapovaný snapshot a index jeho položek (klíč -> offset položky)
+    */
+    std::shared_ptr<const Mapping> mapping;
+    const char* snapshot;
+    size_t snapshot_size;
+    std::unordered_map<std::string, size_t> snapshot_index;
+
+    size_t free_slot();
+    Entry* find(const std::string& key, DNS_cache_state& state);
+    void insert(const std::string& key, uint32_t ttl, const DNS_Response& response, std::vector<char>& message);
+    bool lookup_snapshot(const std::string& key);
+    void unmap();
+    void attach_snapshot(const std::shared_ptr<const Mapping>& file);
+    static std::shared_ptr<const Mapping> map_snapshot(const std::string& path);
+    template<typename Entry_callback>
+    static void scan_snapshot(const Mapping& file, uint32_t stale_window, Entry_callback&& callback);
+    void serialize(std::vector<char>& out, uint32_t& count) const;
+    static bool write_snapshot(const std::string& path, std::vector<char>& out, uint32_t count);
+};
+
+/*
+    Cache sdílená vlákny démona. Klíče jsou rozdělené do shardů, každý shard je samostatná
+    DNS_cache s vlastním zámkem, takže vlákna se potkají jen při dotazu do stejného shardu.
+    Snapshot je stejný soubor jako u DNS_cache, namapuje se a projde jednou a každá položka se
+    zaindexuje do shardu podle hashe svého klíče.
+*/
+class DNS_shared_cache {
+public:
+    DNS_shared_cache(size_t capacity, size_t shards);
+    DNS_shared_cache(const DNS_shared_cache&) = delete;
+    DNS_shared_cache& operator=(const DNS_shared_cache&) = delete;
+
+    void set_stale(uint32_t window);
+    void set_prefetch(uint32_t hits);
+    DNS_cache_state lookup(const std::string& qname, uint16_t qtype, uint16_t qclass, DNS_Response& response);
+    DNS_cache_state lookup_wire(const std::string& qname, uint16_t qtype, uint16_t qclass, std::vector<char>& message);
+    void store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response);
+    void store(const std::string& qname, uint16_t qtype, uint16_t qclass, const DNS_Response& response, const std::vector<char>& message);
+    size_t size() const;
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+private:
+    /*
+        Shard cache se zámkem
+    */
+    struct Shard {
+        explicit Shard(size_t capacity) : cache(capacity) {}
+        DNS_cache cache;
+        mutable std::mutex lock;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+uint32_t response_ttl(const DNS_Response& response);
+
+#endif
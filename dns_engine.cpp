@@ -0,0 +1,1536 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_engine.h"
+#include "dns_wire.h"
+#include "dns_metrics.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+const int DNS_engine::wheel_tick_ms;
+const size_t DNS_engine::wheel_size;
+const size_t DNS_engine::max_query_size;
+const size_t DNS_engine::max_servers;
+const int DNS_engine::initial_rto_ms;
+const int DNS_engine::min_rto_ms;
+const int DNS_engine::max_rto_ms;
+const size_t DNS_engine::max_pooled_buffers;
+const size_t DNS_engine::io_batch;
+const int DNS_engine::receive_buffer_size;
+
+/**
+    Konstruktor enginu, vytvoří epoll instanci a prázdné časové kolo
+*/
+DNS_engine::DNS_engine()
+    : socket4(-1), socket6(-1), queries(65536), wheel(wheel_size), wheel_pos(0),
+      wheel_time(clock::now()), in_flight(0), max_in_flight(4096), retries(2), tcp_only(false), edns_payload(1232),
+      udp_buffer_size(1232), metrics(nullptr), receive_buffers(io_batch, std::vector<char>(udp_buffer_size)),
+      coalescing(true), attached(0)
+{
+    // bez epoll selže registrace socketů, takže add_server() vrátí -1 (proces se neukončuje)
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd == -1)
+    {
+        std::cerr << "Nepodařilo se vytvořit epoll." << std::endl;
+    }
+    for(Query& query : queries)
+    {
+        query.active = false;
+        query.generation = 0;
+    }
+}
+
+/**
+    Destruktor enginu, uzavře všechny sockety
+*/
+DNS_engine::~DNS_engine()
+{
+    for(Server& server : servers)
+    {
+        if(server.tcp.fd != -1)
+        {
+            close(server.tcp.fd);
+        }
+    }
+    if(socket4 != -1)
+    {
+        close(socket4);
+    }
+    if(socket6 != -1)
+    {
+        close(socket6);
+    }
+    if(epoll_fd != -1)
+    {
+        close(epoll_fd);
+    }
+}
+
+/**
+    Vytvoření neblokujícího UDP socketu a jeho registrace do epoll
+    @param family - Rodina adres (AF_INET nebo AF_INET6)
+    @return - Deskriptor socketu, -1 při chybě
+*/
+int DNS_engine::open_socket(int family)
+{
+    int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        std::cerr << "UDP socket se nepodařil vytvořit." << std::endl;
+        return -1;
+    }
+    // odpovědi na celé okno dotazů můžou přijít najednou (např. od démona po sloučení stejných dotazů),
+    // jádro velikost omezí na net.core.rmem_max
+    int buffer_size = receive_buffer_size;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        std::cerr << "Socket se nepodařilo zaregistrovat do epoll." << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+    Přidání upstream serveru
+    @param server_ip - Adresa serveru (IPv4 nebo IPv6)
+    @param port - Port serveru
+    @return - Index serveru pro submit(), -1 při chybě
+*/
+int DNS_engine::add_server(const std::string& server_ip, uint16_t port)
+{
+    if(servers.size() >= max_servers)
+    {
+        std::cerr << "Příliš mnoho serverů (nejvýše " << max_servers << ")." << std::endl;
+        return -1;
+    }
+    Server server;
+    server.tcp.fd = -1;
+    server.tcp.connected = false;
+    server.tcp.want_write = false;
+    server.tcp.out_pos = 0;
+    server.tcp.in_len = 0;
+    server.tcp.generation = 0;
+    if(!set_address(server, server_ip, port))
+    {
+        return -1;
+    }
+    servers.push_back(server);
+    if(metrics)
+    {
+        metrics->upstream_names[servers.size() - 1].set(server_ip);
+    }
+    return servers.size() - 1;
+}
+
+/**
+    Přesměrování existujícího slotu na jiný server (slot nesmí používat žádný rozpracovaný dotaz),
+    TCP spojení se zavře, RTT i histogram serveru v metrikách začínají znovu
+    @param server - Index serveru z add_server()
+    @param server_ip - Nová adresa serveru (IPv4 nebo IPv6)
+    @param port - Port serveru
+    @return - true při úspěchu, při chybě slot zůstane beze změny
+*/
+bool DNS_engine::set_server(int server, const std::string& server_ip, uint16_t port)
+{
+    if(server < 0 || static_cast<size_t>(server) >= servers.size())
+    {
+        return false;
+    }
+    Server target;
+    if(!set_address(target, server_ip, port))
+    {
+        return false;
+    }
+    // slot nepoužívá žádný dotaz, procházet dotazy čekající na spojení není potřeba
+    drop_tcp(server);
+    Server& slot = servers[server];
+    slot.address = target.address;
+    slot.addr = target.addr;
+    slot.addr_len = target.addr_len;
+    slot.fd = target.fd;
+    slot.srtt_ms = target.srtt_ms;
+    slot.rttvar_ms = target.rttvar_ms;
+    slot.samples = target.samples;
+    if(metrics)
+    {
+        metrics->upstream_rtt[server].reset();
+        metrics->upstream_names[server].set(server_ip);
+    }
+    return true;
+}
+
+/**
+    Nastavení adresy serveru a socketu, přes který se mu posílá, RTT se vynuluje
+    @param server - Server
+    @param server_ip - Adresa serveru (IPv4 nebo IPv6)
+    @param port - Port serveru
+    @return - true při úspěchu
+*/
+bool DNS_engine::set_address(Server& server, const std::string& server_ip, uint16_t port)
+{
+    server.address = server_ip;
+    memset(&server.addr, 0, sizeof(server.addr));
+    server.srtt_ms = 0;
+    server.rttvar_ms = 0;
+    server.samples = 0;
+    struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&server.addr);
+    struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&server.addr);
+
+    if(inet_pton(AF_INET6, server_ip.c_str(), &addr6->sin6_addr) == 1)
+    {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        server.addr_len = sizeof(struct sockaddr_in6);
+        if(socket6 == -1)
+        {
+            socket6 = open_socket(AF_INET6);
+        }
+        server.fd = socket6;
+    }
+    else if(inet_pton(AF_INET, server_ip.c_str(), &addr4->sin_addr) == 1)
+    {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        server.addr_len = sizeof(struct sockaddr_in);
+        if(socket4 == -1)
+        {
+            socket4 = open_socket(AF_INET);
+        }
+        server.fd = socket4;
+    }
+    else
+    {
+        std::cerr << "Neplatná adresa serveru." << std::endl;
+        return false;
+    }
+    return server.fd != -1;
+}
+
+/**
+    Nastavení maximálního počtu současně rozpracovaných dotazů, další čekají ve frontě
+    @param max - Maximální počet dotazů (nejvýše 65536 kvůli 16bitovému ID)
+*/
+void DNS_engine::set_max_in_flight(size_t max)
+{
+    max_in_flight = std::max<size_t>(1, std::min<size_t>(max, queries.size()));
+}
+
+/**
+    Nastavení počtu opakovaných odeslání dotazu, než se prohlásí za nezodpovězený
+    @param retries - Počet opakování (0 = dotaz se pošle jen jednou)
+*/
+void DNS_engine::set_retries(int retries)
+{
+    this->retries = std::max(0, std::min(retries, 16));
+}
+
+/**
+    Posílání všech dotazů přes TCP (trvalé spojení ke každému serveru) místo UDP
+    @param tcp - Zda se má používat jen TCP
+*/
+void DNS_engine::set_tcp(bool tcp)
+{
+    tcp_only = tcp;
+}
+
+/**
+    Nastavení inzerované velikosti UDP odpovědi v EDNS(0), podle ní se dimenzují přijímací buffery
+    @param payload - Velikost payloadu v bajtech (0 = dotazy bez OPT záznamu, odpovědi do 512 B)
+*/
+void DNS_engine::set_edns_payload(uint16_t payload)
+{
+    edns_payload = (payload == 0) ? 0 : std::max<uint16_t>(payload, 512);
+    udp_buffer_size = std::max<size_t>(edns_payload, 512);
+    for(std::vector<char>& buffer : receive_buffers)
+    {
+        buffer.resize(udp_buffer_size);
+    }
+}
+
+/**
+    Nastavení metrik, do kterých engine zapisuje latence, RTT serverů a čítače
+    Metriky zapisuje jen vlákno, které engine pohání, číst je může kdokoli.
+    @param metrics - Metriky (musí žít déle než engine), nullptr = bez metrik
+*/
+void DNS_engine::set_metrics(DNS_metrics* metrics)
+{
+    this->metrics = metrics;
+    for(size_t i = 0; metrics && i < servers.size(); i++)
+    {
+        metrics->upstream_names[i].set(servers[i].address);
+    }
+}
+
+/**
+    Zapnutí slučování stejných rozpracovaných dotazů (výchozí zapnuto)
+    @param coalescing - false = každý dotaz se posílá samostatně (např. při zátěžovém měření)
+*/
+void DNS_engine::set_coalescing(bool coalescing)
+{
+    this->coalescing = coalescing;
+}
+
+/**
+    Zařazení dotazu, výsledek se předá do callbacku z run_once()
+    @param server - Index serveru z add_server()
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param recursion - Zda se má nastavit bit RD
+    @param timeout_ms - Čas na odpověď v milisekundách
+    @param callback - Funkce volaná po dokončení dotazu
+*/
+void DNS_engine::submit(int server, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms, DNS_callback callback)
+{
+    Waiting request;
+    request.server_mask = (server >= 0 && static_cast<size_t>(server) < max_servers) ? (1ULL << server) : 0;
+    request.qname = qname;
+    request.qtype = qtype;
+    request.recursion = recursion;
+    request.timeout_ms = timeout_ms;
+    request.callback = std::move(callback);
+    enqueue(request);
+}
+
+/**
+    Zařazení dotazu s výsledkem ve formě future, engine je potřeba dál pohánět přes run_once()
+    @param server - Index serveru z add_server()
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param recursion - Zda se má nastavit bit RD
+    @param timeout_ms - Čas na odpověď v milisekundách
+    @return - Future s výsledkem dotazu
+*/
+std::future<DNS_result> DNS_engine::submit(int server, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms)
+{
+    std::shared_ptr<std::promise<DNS_result>> promise = std::make_shared<std::promise<DNS_result>>();
+    submit(server, qname, qtype, recursion, timeout_ms, [promise](DNS_result& result)
+    {
+        promise->set_value(std::move(result));
+    });
+    return promise->get_future();
+}
+
+/**
+    Zařazení dotazu pro více serverů najednou, dotaz se pošle všem (nejrychlejším podle RTT nejdřív),
+    platí první odpověď bez chyby a ostatní se zahodí
+    @param servers - Indexy serverů z add_server()
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param recursion - Zda se má nastavit bit RD
+    @param timeout_ms - Čas na odpověď v milisekundách
+    @param callback - Funkce volaná po dokončení dotazu
+*/
+void DNS_engine::submit(const std::vector<int>& servers, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms, DNS_callback callback)
+{
+    Waiting request;
+    request.server_mask = 0;
+    for(int server : servers)
+    {
+        if(server < 0 || static_cast<size_t>(server) >= max_servers)
+        {
+            // neplatný index, dotaz skončí chybou DNS_ERR_SERVER
+            request.server_mask = 0;
+            break;
+        }
+        request.server_mask |= 1ULL << server;
+    }
+    request.qname = qname;
+    request.qtype = qtype;
+    request.recursion = recursion;
+    request.timeout_ms = timeout_ms;
+    request.callback = std::move(callback);
+    enqueue(request);
+}
+
+/**
+    Zařazení dotazu pro více serverů s výsledkem ve formě future
+    @param servers - Indexy serverů z add_server()
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param recursion - Zda se má nastavit bit RD
+    @param timeout_ms - Čas na odpověď v milisekundách
+    @return - Future s výsledkem dotazu
+*/
+std::future<DNS_result> DNS_engine::submit(const std::vector<int>& servers, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms)
+{
+    std::shared_ptr<std::promise<DNS_result>> promise = std::make_shared<std::promise<DNS_result>>();
+    submit(servers, qname, qtype, recursion, timeout_ms, [promise](DNS_result& result)
+    {
+        promise->set_value(std::move(result));
+    });
+    return promise->get_future();
+}
+
+/**
+    Odeslání dotazu, nebo jeho zařazení do fronty při plném okně
+    @param request - Dotaz k odeslání
+*/
+void DNS_engine::enqueue(Waiting& request)
+{
+    if(attach(request))
+    {
+        return;
+    }
+    if(in_flight < max_in_flight && waiting.empty())
+    {
+        start(request);
+    }
+    else
+    {
+        waiting.push_back(std::move(request));
+    }
+}
+
+/**
+    Klíč pro slučování stejných dotazů: jméno malými písmeny, typ, bit RD a maska serverů
+    @param request - Dotaz
+    @return - Klíč
+*/
+std::string DNS_engine::coalescing_key(const Waiting& request)
+{
+    std::string key;
+    key.reserve(request.qname.size() + 12);
+    for(char c : request.qname)
+    {
+        key.push_back(std::tolower(static_cast<unsigned char>(c)));
+    }
+    key.push_back('\0');
+    key.push_back(static_cast<char>(request.qtype >> 8));
+    key.push_back(static_cast<char>(request.qtype & 0xFF));
+    key.push_back(request.recursion ? 1 : 0);
+    key.append(reinterpret_cast<const char*>(&request.server_mask), sizeof(request.server_mask));
+    return key;
+}
+
+/**
+    Připojení dotazu ke stejnému rozpracovanému dotazu, výsledek pak dostane z jeho odpovědi
+    (i s jeho zbývajícím časem na odpověď, vlastní timeout se neuplatní)
+    @param request - Dotaz
+    @return - false pokud stejný dotaz neběží (nebo je slučování vypnuté)
+*/
+bool DNS_engine::attach(Waiting& request)
+{
+    if(!coalescing || in_flight_index.empty())
+    {
+        return false;
+    }
+    auto leader = in_flight_index.find(coalescing_key(request));
+    if(leader == in_flight_index.end())
+    {
+        return false;
+    }
+    queries[leader->second].followers.push_back(std::move(request.callback));
+    attached++;
+    if(metrics)
+    {
+        metrics->coalesced.add();
+    }
+    return true;
+}
+
+/**
+    Získání volného bufferu pro sestavený dotaz, zásoba bufferů roste jen do počtu rozpracovaných dotazů
+    @return - Index bufferu
+*/
+uint32_t DNS_engine::acquire_packet()
+{
+    if(free_packets.empty())
+    {
+        uint32_t slots = packet_storage.size() / max_query_size;
+        uint32_t added = std::max<uint32_t>(64, slots);
+        packet_storage.resize((slots + added) * max_query_size);
+        for(uint32_t i = slots + added; i > slots; i--)
+        {
+            free_packets.push_back(i - 1);
+        }
+    }
+    uint32_t slot = free_packets.back();
+    free_packets.pop_back();
+    return slot;
+}
+
+/**
+    Ukazatel na buffer dotazu
+    @param slot - Index bufferu
+    @return - Začátek bufferu
+*/
+char* DNS_engine::packet(uint32_t slot)
+{
+    return packet_storage.data() + slot * max_query_size;
+}
+
+/**
+    Odeslání dotazu a naplánování jeho vypršení v časovém kole
+    @param request - Dotaz k odeslání
+*/
+void DNS_engine::start(Waiting& request)
+{
+    if(request.server_mask == 0 || (servers.size() < max_servers && (request.server_mask >> servers.size()) != 0))
+    {
+        DNS_result result;
+        result.status = DNS_ERR_SERVER;
+        request.callback(result);
+        return;
+    }
+    // každý dotaz má náhodné ID, aby se z jednoho pozorovaného nedala odhadnout další (podvržené odpovědi);
+    // sloty se indexují přímo podle ID, obsazené ID se posune na nejbližší volné
+    uint16_t id = random_id();
+    while(queries[id].active)
+    {
+        id++;
+    }
+    Query& query = queries[id];
+
+    DNS_header header;
+    header_constr(&header, id, request.recursion);
+    // dotaz se sestaví přímo do předalokovaného bufferu, který zůstane pro opakované odeslání
+    uint32_t slot = acquire_packet();
+    size_t length = build_query(packet(slot), max_query_size, header, request.qname, request.qtype, 1, edns_payload);
+    int status = DNS_OK;
+    if(length == 0)
+    {
+        status = DNS_ERR_NAME;
+    }
+    else
+    {
+        query.server_mask = request.server_mask;
+        query.answered_mask = 0;
+        query.tcp_mask = 0;
+        query.packet_slot = slot;
+        query.packet_length = length;
+        if(tcp_only)
+        {
+            uint64_t sent_mask = 0;
+            for(size_t i = 0; i < servers.size(); i++)
+            {
+                if((query.server_mask & (1ULL << i)) && send_tcp(i, query))
+                {
+                    sent_mask |= 1ULL << i;
+                }
+            }
+            query.server_mask = sent_mask;
+            query.tcp_mask = sent_mask;
+        }
+        if(query.server_mask == 0)
+        {
+            status = DNS_ERR_SEND;
+        }
+    }
+    if(status != DNS_OK)
+    {
+        free_packets.push_back(slot);
+        DNS_result result;
+        result.status = status;
+        request.callback(result);
+        return;
+    }
+
+    if(in_flight == 0)
+    {
+        // v prázdném kole nejsou platné položky, není třeba dohánět zameškané tiky
+        wheel_time = clock::now();
+    }
+    query.active = true;
+    query.generation++;
+    query.sent = clock::now();
+    query.deadline = query.sent + std::chrono::milliseconds(request.timeout_ms);
+    query.attempts = 1;
+    query.qname = request.qname;
+    query.qtype = request.qtype;
+    query.callback = std::move(request.callback);
+    query.key.clear();
+    if(coalescing)
+    {
+        query.key = coalescing_key(request);
+        in_flight_index.emplace(query.key, id);
+    }
+    in_flight++;
+    if(!tcp_only)
+    {
+        // pakety jdou do fronty, odešlou se dávkou ve flush_sends()
+        transmit(query);
+    }
+
+    schedule(id, std::min(query_rto(query), request.timeout_ms));
+}
+
+/**
+    Zařazení dotazu k odeslání (nebo opakovanému odeslání) přes UDP serverům, které ještě
+    neodpověděly a nejsou dotazovány přes TCP, v pořadí podle vyhlazeného RTT
+    @param query - Dotaz se sestaveným paketem
+    @return - Servery, kterým se dotaz zařadil k odeslání
+*/
+uint64_t DNS_engine::transmit(Query& query)
+{
+    int order[max_servers];
+    size_t count = 0;
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        if(query.server_mask & ~query.answered_mask & ~query.tcp_mask & (1ULL << i))
+        {
+            order[count++] = i;
+        }
+    }
+    std::stable_sort(order, order + count, [this](int a, int b)
+    {
+        return servers[a].srtt_ms < servers[b].srtt_ms;
+    });
+    uint64_t sent_mask = 0;
+    uint16_t id = &query - queries.data();
+    for(size_t i = 0; i < count; i++)
+    {
+        Outgoing packet;
+        packet.id = id;
+        packet.generation = query.generation;
+        packet.server = order[i];
+        send_queue.push_back(packet);
+        sent_mask |= 1ULL << order[i];
+        if(send_queue.size() >= io_batch)
+        {
+            flush_sends();
+        }
+    }
+    return sent_mask;
+}
+
+/**
+    Odeslání UDP paketů z fronty po dávkách přes sendmmsg (jedno volání na io_batch paketů)
+    Server, kterému se nepodařilo poslat první pokus, se z dotazu vyřadí; dotaz, kterému
+    tak nezbude žádný server, skončí s DNS_ERR_SEND. Opakovaná odeslání se jen zahodí,
+    dotaz pak vyprší nebo ho zachrání další pokus.
+*/
+void DNS_engine::flush_sends()
+{
+    while(!send_queue.empty())
+    {
+        // fronta se vyprázdní předem, callbacky při chybě můžou řadit další pakety
+        std::vector<Outgoing> batch;
+        size_t count = std::min(send_queue.size(), io_batch);
+        batch.assign(send_queue.begin(), send_queue.begin() + count);
+        send_queue.erase(send_queue.begin(), send_queue.begin() + count);
+
+        size_t valid = 0;
+        for(const Outgoing& entry : batch)
+        {
+            const Query& query = queries[entry.id];
+            if(!query.active || query.generation != entry.generation)
+            {
+                continue;
+            }
+            Server& server = servers[entry.server];
+            io_vecs[valid].iov_base = packet(query.packet_slot);
+            io_vecs[valid].iov_len = query.packet_length;
+            memset(&io_msgs[valid], 0, sizeof(struct mmsghdr));
+            io_msgs[valid].msg_hdr.msg_name = &server.addr;
+            io_msgs[valid].msg_hdr.msg_namelen = server.addr_len;
+            io_msgs[valid].msg_hdr.msg_iov = &io_vecs[valid];
+            io_msgs[valid].msg_hdr.msg_iovlen = 1;
+            batch[valid++] = entry;
+        }
+
+        // sendmmsg posílá jen přes jeden socket, souvislé úseky se stejným socketem jdou najednou
+        std::vector<Outgoing> failed;
+        size_t pos = 0;
+        while(pos < valid)
+        {
+            int fd = servers[batch[pos].server].fd;
+            size_t end = pos + 1;
+            while(end < valid && servers[batch[end].server].fd == fd)
+            {
+                end++;
+            }
+            while(pos < end)
+            {
+                int sent = sendmmsg(fd, io_msgs + pos, end - pos, MSG_DONTWAIT);
+                if(sent > 0)
+                {
+                    pos += sent;
+                    continue;
+                }
+                if(sent == -1 && errno == EINTR)
+                {
+                    continue;
+                }
+                failed.push_back(batch[pos]);
+                pos++;
+                if(metrics)
+                {
+                    metrics->send_errors.add();
+                }
+            }
+        }
+
+        std::vector<char> empty;
+        for(const Outgoing& entry : failed)
+        {
+            Query& query = queries[entry.id];
+            if(!query.active || query.generation != entry.generation || query.attempts != 1)
+            {
+                continue;
+            }
+            query.server_mask &= ~(1ULL << entry.server);
+            if(query.server_mask == 0)
+            {
+                complete(entry.id, DNS_ERR_SEND, empty);
+            }
+        }
+    }
+}
+
+/**
+    Naplánování dalšího ověření dotazu v časovém kole
+    @param id - ID dotazu
+    @param delay_ms - Za kolik milisekund se má dotaz ověřit
+*/
+void DNS_engine::schedule(uint16_t id, int delay_ms)
+{
+    size_t ticks = std::max(1, (delay_ms + wheel_tick_ms - 1) / wheel_tick_ms);
+    Timer timer;
+    timer.id = id;
+    timer.generation = queries[id].generation;
+    timer.rounds = (ticks - 1) / wheel_size;
+    wheel[(wheel_pos + ticks) % wheel_size].push_back(timer);
+}
+
+/**
+    Čas do opakovaného odeslání (RTO) podle nejrychlejšího serveru, který ještě neodpověděl,
+    RTO = SRTT + 4 * RTTVAR jako v RFC 6298, bez měření se použije initial_rto_ms
+    @param query - Rozpracovaný dotaz
+    @return - RTO v milisekundách
+*/
+int DNS_engine::query_rto(const Query& query) const
+{
+    int rto = max_rto_ms;
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        if(!(query.server_mask & ~query.answered_mask & (1ULL << i)))
+        {
+            continue;
+        }
+        const Server& server = servers[i];
+        int server_rto = initial_rto_ms;
+        if(server.samples > 0)
+        {
+            server_rto = static_cast<int>(server.srtt_ms + std::max<double>(4 * server.rttvar_ms, wheel_tick_ms));
+        }
+        rto = std::min(rto, std::max(min_rto_ms, server_rto));
+    }
+    return rto;
+}
+
+/**
+    Získání bufferu pro odpověď ze zásoby (nový se alokuje jen při prázdné zásobě)
+    @return - Buffer s kapacitou aspoň udp_buffer_size
+*/
+std::vector<char> DNS_engine::acquire_buffer()
+{
+    std::vector<char> buffer;
+    if(!buffer_pool.empty())
+    {
+        buffer.swap(buffer_pool.back());
+        buffer_pool.pop_back();
+    }
+    buffer.reserve(udp_buffer_size);
+    return buffer;
+}
+
+/**
+    Vrácení bufferu do zásoby, pokud ho callback nepřevzal
+    @param buffer - Buffer s odpovědí
+*/
+void DNS_engine::release_buffer(std::vector<char>& buffer)
+{
+    if(buffer.capacity() >= udp_buffer_size && buffer_pool.size() < max_pooled_buffers)
+    {
+        buffer_pool.push_back(std::move(buffer));
+    }
+}
+
+/**
+    Dokončení dotazu, uvolnění jeho slotu a zavolání callbacku
+    Pokud dotaz skončí chybou (timeout, odeslání), ale některý server mezitím vrátil
+    chybovou odpověď (SERVFAIL, REFUSED, ...), dostane callback tuto odpověď.
+    @param id - ID dotazu
+    @param status - Stav dokončení
+    @param response - Odpověď serveru (prázdná při chybě)
+*/
+void DNS_engine::complete(uint16_t id, int status, std::vector<char>& response)
+{
+    Query& query = queries[id];
+    if(!query.active)
+    {
+        return;
+    }
+    if(status != DNS_OK && !query.error_response.empty())
+    {
+        status = DNS_OK;
+        response.swap(query.error_response);
+    }
+    query.error_response.clear();
+    DNS_callback callback = std::move(query.callback);
+    std::vector<DNS_callback> followers;
+    followers.swap(query.followers);
+    attached -= followers.size();
+    if(!query.key.empty())
+    {
+        // callbacky můžou poslat stejný dotaz znovu, ten už se musí odeslat
+        in_flight_index.erase(query.key);
+        query.key.clear();
+    }
+    query.active = false;
+    query.generation++;
+    query.callback = nullptr;
+    free_packets.push_back(query.packet_slot);
+    in_flight--;
+    if(metrics)
+    {
+        metrics->queries.add();
+        metrics->latency.record(std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - query.sent).count());
+        if(status == DNS_OK && response.size() >= sizeof(DNS_header))
+        {
+            metrics->rcodes[response[3] & 0x0F].add();
+        }
+        else if(status == DNS_ERR_TIMEOUT)
+        {
+            metrics->timeouts.add();
+        }
+    }
+
+    DNS_result result;
+    result.status = status;
+    result.response.swap(response);
+    for(DNS_callback& follower : followers)
+    {
+        // každý připojený dotaz dostane vlastní kopii, callback si ji může převzít
+        DNS_result copy;
+        copy.status = status;
+        copy.response = result.response;
+        follower(copy);
+    }
+    callback(result);
+    release_buffer(result.response);
+}
+
+/**
+    Přečtení všech čekajících odpovědí ze socketu
+    @param fd - Socket, na kterém jsou data
+*/
+void DNS_engine::receive(int fd)
+{
+    while(true)
+    {
+        // přijímací buffery jsou připravené předem, jedno volání přečte až io_batch odpovědí
+        for(size_t i = 0; i < io_batch; i++)
+        {
+            io_vecs[i].iov_base = receive_buffers[i].data();
+            io_vecs[i].iov_len = receive_buffers[i].size();
+            memset(&io_msgs[i], 0, sizeof(struct mmsghdr));
+            io_msgs[i].msg_hdr.msg_name = &io_addrs[i];
+            io_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            io_msgs[i].msg_hdr.msg_iov = &io_vecs[i];
+            io_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(fd, io_msgs, io_batch, MSG_DONTWAIT, nullptr);
+        if(received == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for(int i = 0; i < received; i++)
+        {
+            std::vector<char>& buffer = receive_buffers[i];
+            size_t len = io_msgs[i].msg_len;
+            if(len < sizeof(DNS_header))
+            {
+                continue;
+            }
+            if(io_msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                // server poslal víc, než jsme inzerovali, se zbytkem se naloží jako se zkrácenou odpovědí
+                buffer[2] |= 0x02;
+            }
+            uint16_t id;
+            memcpy(&id, buffer.data(), sizeof(uint16_t));
+            id = ntohs(id);
+            Query& query = queries[id];
+            if(!query.active)
+            {
+                continue;
+            }
+            // odpověď musí přijít od serveru, kterému byl dotaz poslán a který ještě neodpověděl
+            int server = find_server(io_addrs[i], query.server_mask & ~query.answered_mask & ~query.tcp_mask);
+            if(server == -1)
+            {
+                continue;
+            }
+            accept_response(id, server, buffer.data(), len, &buffer);
+        }
+        if(received < static_cast<int>(io_batch))
+        {
+            break;
+        }
+    }
+}
+
+/**
+    Zpracování odpovědi od serveru, dokončí dotaz nebo ho při zkrácené odpovědi přesune na TCP
+    @param id - ID dotazu
+    @param server - Server, od kterého odpověď přišla
+    @param data - Odpověď
+    @param len - Délka odpovědi
+    @param datagram - Přijímací buffer, ve kterém leží UDP odpověď (předá se bez kopírování),
+                      nullptr u odpovědi přes TCP
+*/
+void DNS_engine::accept_response(uint16_t id, int server, const char* data, size_t len, std::vector<char>* datagram)
+{
+    bool tcp = (datagram == nullptr);
+    Query& query = queries[id];
+    if(!response_matches(data, len, id, query.qname, query.qtype))
+    {
+        return;
+    }
+    uint16_t flags;
+    memcpy(&flags, data + sizeof(uint16_t), sizeof(uint16_t));
+    flags = ntohs(flags);
+
+    // zkrácená odpověď, dotaz se zopakuje přes TCP (pokud se nepodaří, platí zkrácená)
+    if(!tcp && (flags & 0x0200) && send_tcp(server, query))
+    {
+        query.tcp_mask |= 1ULL << server;
+        if(metrics)
+        {
+            metrics->truncations.add();
+        }
+        return;
+    }
+    double elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - query.sent).count();
+    if(query.attempts == 1 && !tcp)
+    {
+        // po opakovaném odeslání nelze poznat, na který paket odpověď patří (Karnův algoritmus)
+        update_rtt(server, elapsed_ms);
+        if(metrics)
+        {
+            metrics->upstream_rtt[server].record(static_cast<uint64_t>(elapsed_ms * 1000));
+        }
+    }
+    query.answered_mask |= 1ULL << server;
+
+    // SERVFAIL, REFUSED apod. vyhrají jen tehdy, když už žádný jiný server neodpoví;
+    // odpověď se schová pro případ, že ostatní servery neodpoví vůbec (viz complete())
+    uint16_t rcode = flags & 0x000F;
+    if(rcode != 0 && rcode != 3 && query.answered_mask != query.server_mask)
+    {
+        query.error_response.assign(data, data + len);
+        return;
+    }
+    // servery, které nestihly odpovědět, mají RTT aspoň tak velké jako vítěz
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        if((query.server_mask & ~query.answered_mask & (1ULL << i)) && servers[i].srtt_ms < elapsed_ms)
+        {
+            update_rtt(i, elapsed_ms);
+        }
+    }
+    std::vector<char> response;
+    if(tcp)
+    {
+        response = acquire_buffer();
+        response.assign(data, data + len);
+    }
+    else
+    {
+        // UDP odpověď leží v přijímacím bufferu, předá se bez kopírování a příjem pokračuje do jiného bufferu
+        response.swap(*datagram);
+        response.resize(len);
+        *datagram = acquire_buffer();
+        datagram->resize(udp_buffer_size);
+    }
+    complete(id, DNS_OK, response);
+}
+
+/**
+    Zařazení dotazu do TCP spojení se serverem (s dvoubajtovou délkou před zprávou),
+    spojení se otevře, pokud ještě neexistuje
+    @param server - Index serveru
+    @param query - Dotaz se sestaveným paketem
+    @return - false, pokud se spojení nepodařilo otevřít nebo zapsat
+*/
+bool DNS_engine::send_tcp(int server, const Query& query)
+{
+    Server& s = servers[server];
+    Connection& tcp = s.tcp;
+    if(tcp.fd == -1)
+    {
+        tcp.fd = socket(s.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(tcp.fd == -1)
+        {
+            return false;
+        }
+        int one = 1;
+        setsockopt(tcp.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if(connect(tcp.fd, reinterpret_cast<const struct sockaddr*>(&s.addr), s.addr_len) == -1 && errno != EINPROGRESS)
+        {
+            close(tcp.fd);
+            tcp.fd = -1;
+            return false;
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.fd = tcp.fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tcp.fd, &event) == -1)
+        {
+            close(tcp.fd);
+            tcp.fd = -1;
+            return false;
+        }
+        tcp.connected = false;
+        tcp.want_write = true;
+        tcp.out_pos = 0;
+        tcp.out.clear();
+        tcp.in.resize(sizeof(uint16_t) + 65535);
+        tcp.in_len = 0;
+    }
+    uint16_t length = htons(query.packet_length);
+    const char* prefix = reinterpret_cast<const char*>(&length);
+    tcp.out.insert(tcp.out.end(), prefix, prefix + sizeof(uint16_t));
+    const char* data = packet_storage.data() + query.packet_slot * max_query_size;
+    tcp.out.insert(tcp.out.end(), data, data + query.packet_length);
+    if(tcp.connected && !flush_tcp(server))
+    {
+        // dotaz ještě není mezi čekajícími na spojení, selhání spojení se mu ohlásí návratovou hodnotou
+        close_tcp(server);
+        return false;
+    }
+    return true;
+}
+
+/**
+    Zapsání čekajících dotazů do TCP spojení, co se nevejde, počká na EPOLLOUT
+    @param server - Index serveru
+    @return - false při chybě spojení
+*/
+bool DNS_engine::flush_tcp(int server)
+{
+    Connection& tcp = servers[server].tcp;
+    while(tcp.out_pos < tcp.out.size())
+    {
+        ssize_t sent = send(tcp.fd, tcp.out.data() + tcp.out_pos, tcp.out.size() - tcp.out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(sent == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            if(!tcp.want_write)
+            {
+                struct epoll_event event;
+                memset(&event, 0, sizeof(event));
+                event.events = EPOLLIN | EPOLLOUT;
+                event.data.fd = tcp.fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, tcp.fd, &event);
+                tcp.want_write = true;
+            }
+            return true;
+        }
+        tcp.out_pos += sent;
+    }
+    tcp.out.clear();
+    tcp.out_pos = 0;
+    if(tcp.want_write)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = tcp.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, tcp.fd, &event);
+        tcp.want_write = false;
+    }
+    return true;
+}
+
+/**
+    Obsloužení události na TCP spojení: dokončení připojení, zápis a čtení odpovědí
+    @param server - Index serveru
+    @param events - Události z epoll
+*/
+void DNS_engine::handle_tcp(int server, uint32_t events)
+{
+    Connection& tcp = servers[server].tcp;
+    if(!tcp.connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if(getsockopt(tcp.fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1 || error != 0)
+        {
+            close_tcp(server);
+            return;
+        }
+        tcp.connected = true;
+    }
+    if(!tcp.connected)
+    {
+        return;
+    }
+    if((events & EPOLLOUT) && !flush_tcp(server))
+    {
+        close_tcp(server);
+        return;
+    }
+    if(!(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        return;
+    }
+
+    // callbacky dotazů můžou spojení zavřít (i otevřít nové) nebo přidat server, čímž se
+    // přesune pole serverů; spojení se proto po každé odpovědi hledá znovu a při změně
+    // generace se zbytek starého bufferu zahodí
+    uint32_t generation = tcp.generation;
+    Connection* connection = &tcp;
+    bool closed = false;
+    while(true)
+    {
+        ssize_t len = recv(connection->fd, connection->in.data() + connection->in_len, connection->in.size() - connection->in_len, MSG_DONTWAIT);
+        if(len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if(len <= 0)
+        {
+            closed = (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+            break;
+        }
+        connection->in_len += len;
+
+        // zpracování všech celých zpráv v bufferu, odpovědi můžou chodit v libovolném pořadí
+        size_t pos = 0;
+        while(connection->in_len - pos >= sizeof(uint16_t))
+        {
+            const char* data = connection->in.data();
+            uint16_t message_len;
+            memcpy(&message_len, data + pos, sizeof(uint16_t));
+            message_len = ntohs(message_len);
+            if(connection->in_len - pos - sizeof(uint16_t) < message_len)
+            {
+                break;
+            }
+            const char* message = data + pos + sizeof(uint16_t);
+            pos += sizeof(uint16_t) + message_len;
+            if(message_len < sizeof(DNS_header))
+            {
+                continue;
+            }
+            uint16_t id;
+            memcpy(&id, message, sizeof(uint16_t));
+            id = ntohs(id);
+            const Query& query = queries[id];
+            if(query.active && (query.tcp_mask & ~query.answered_mask & (1ULL << server)))
+            {
+                accept_response(id, server, message, message_len, nullptr);
+                connection = &servers[server].tcp;
+                if(connection->generation != generation)
+                {
+                    return;
+                }
+            }
+        }
+        memmove(connection->in.data(), connection->in.data() + pos, connection->in_len - pos);
+        connection->in_len -= pos;
+    }
+    if(closed)
+    {
+        close_tcp(server);
+    }
+}
+
+/**
+    Zavření socketu TCP spojení a vyprázdnění jeho bufferů, bez zásahu do dotazů
+    @param server - Index serveru
+    @return - true, pokud bylo spojení otevřené
+*/
+bool DNS_engine::drop_tcp(int server)
+{
+    Connection& tcp = servers[server].tcp;
+    if(tcp.fd == -1)
+    {
+        return false;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, tcp.fd, nullptr);
+    close(tcp.fd);
+    tcp.fd = -1;
+    tcp.connected = false;
+    tcp.want_write = false;
+    tcp.out.clear();
+    tcp.out_pos = 0;
+    tcp.in_len = 0;
+    tcp.generation++;
+    return true;
+}
+
+/**
+    Uzavření TCP spojení, dotazy, které na něm čekaly, se u tohoto serveru považují za nezodpovězené
+    @param server - Index serveru
+*/
+void DNS_engine::close_tcp(int server)
+{
+    if(!drop_tcp(server))
+    {
+        return;
+    }
+
+    const uint64_t bit = 1ULL << server;
+    std::vector<char> empty;
+    for(size_t id = 0; id < queries.size(); id++)
+    {
+        Query& query = queries[id];
+        if(!query.active || !(query.tcp_mask & ~query.answered_mask & bit))
+        {
+            continue;
+        }
+        query.answered_mask |= bit;
+        if(query.answered_mask == query.server_mask)
+        {
+            complete(id, DNS_ERR_SEND, empty);
+        }
+    }
+}
+
+/**
+    Nalezení serveru podle adresy, ze které přišla odpověď
+    @param from - Adresa odesílatele
+    @param mask - Servery, mezi kterými se hledá
+    @return - Index serveru, -1 pokud adresa žádnému neodpovídá
+*/
+int DNS_engine::find_server(const sockaddr_storage& from, uint64_t mask) const
+{
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        if(!(mask & (1ULL << i)))
+        {
+            continue;
+        }
+        const Server& server = servers[i];
+        if(from.ss_family != server.addr.ss_family)
+        {
+            continue;
+        }
+        if(from.ss_family == AF_INET)
+        {
+            const struct sockaddr_in* a = reinterpret_cast<const struct sockaddr_in*>(&from);
+            const struct sockaddr_in* b = reinterpret_cast<const struct sockaddr_in*>(&server.addr);
+            if(a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr)
+            {
+                return i;
+            }
+        }
+        else
+        {
+            const struct sockaddr_in6* a = reinterpret_cast<const struct sockaddr_in6*>(&from);
+            const struct sockaddr_in6* b = reinterpret_cast<const struct sockaddr_in6*>(&server.addr);
+            if(a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(struct in6_addr)) == 0)
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+    Započtení vzorku RTT do vyhlazeného odhadu serveru a jeho rozptylu (váhy 1/8 a 1/4 jako v RFC 6298)
+    @param server - Index serveru
+    @param sample_ms - Naměřený čas odpovědi v milisekundách
+*/
+void DNS_engine::update_rtt(int server, double sample_ms)
+{
+    Server& s = servers[server];
+    if(s.samples == 0)
+    {
+        s.srtt_ms = sample_ms;
+        s.rttvar_ms = sample_ms / 2;
+    }
+    else
+    {
+        s.rttvar_ms += (std::abs(s.srtt_ms - sample_ms) - s.rttvar_ms) / 4;
+        s.srtt_ms += (sample_ms - s.srtt_ms) / 8;
+    }
+    s.samples++;
+}
+
+/**
+    Vyhlazené RTT serveru
+    @param server - Index serveru z add_server()
+    @return - RTT v milisekundách, 0 pokud ještě nebylo změřeno
+*/
+double DNS_engine::server_rtt(int server) const
+{
+    if(server < 0 || static_cast<size_t>(server) >= servers.size())
+    {
+        return 0;
+    }
+    return servers[server].srtt_ms;
+}
+
+/**
+    Posunutí časového kola do aktuálního času a ukončení vypršených dotazů
+*/
+void DNS_engine::advance_wheel()
+{
+    clock::time_point now = clock::now();
+    const std::chrono::milliseconds tick(wheel_tick_ms);
+    std::vector<uint16_t> expired;
+
+    while(wheel_time + tick <= now)
+    {
+        wheel_time += tick;
+        wheel_pos = (wheel_pos + 1) % wheel_size;
+
+        std::vector<Timer>& slot = wheel[wheel_pos];
+        size_t kept = 0;
+        for(Timer& timer : slot)
+        {
+            const Query& query = queries[timer.id];
+            if(!query.active || query.generation != timer.generation)
+            {
+                continue;
+            }
+            if(timer.rounds > 0)
+            {
+                timer.rounds--;
+                slot[kept++] = timer;
+            }
+            else
+            {
+                expired.push_back(timer.id);
+            }
+        }
+        slot.resize(kept);
+    }
+
+    std::vector<char> empty;
+    for(uint16_t id : expired)
+    {
+        Query& query = queries[id];
+        bool udp_pending = query.server_mask & ~query.answered_mask & ~query.tcp_mask;
+        bool tcp_pending = query.server_mask & ~query.answered_mask & query.tcp_mask;
+        if(udp_pending && query.attempts <= retries && now < query.deadline)
+        {
+            // opakované odeslání, čekání se s každým pokusem zdvojnásobí (nejvýše na max_rto_ms)
+            transmit(query);
+            if(metrics)
+            {
+                metrics->retransmissions.add();
+            }
+            int backoff = std::min<int>(max_rto_ms, query_rto(query) << std::min<int>(query.attempts, 8));
+            int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(query.deadline - now).count();
+            query.attempts++;
+            schedule(id, std::max(1, std::min(backoff, remaining)));
+            continue;
+        }
+        if(tcp_pending && now < query.deadline)
+        {
+            // TCP se neopakuje, jen se čeká do vypršení dotazu
+            int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(query.deadline - now).count();
+            schedule(id, std::max(1, remaining));
+            continue;
+        }
+        // servery, které vůbec neodpověděly, se posunou v pořadí dozadu
+        double elapsed_ms = std::chrono::duration<double, std::milli>(now - query.sent).count();
+        for(size_t i = 0; i < servers.size(); i++)
+        {
+            if(query.server_mask & ~query.answered_mask & (1ULL << i))
+            {
+                update_rtt(i, elapsed_ms);
+            }
+        }
+        complete(id, DNS_ERR_TIMEOUT, empty);
+    }
+}
+
+/**
+    Přidání cizího deskriptoru do smyčky událostí, callback se volá z run_once()
+    @param fd - Deskriptor
+    @param events - Sledované události epoll (EPOLLIN, EPOLLOUT, ...)
+    @param callback - Funkce volaná s nastalými událostmi
+    @return - false, pokud se deskriptor nepodařilo zaregistrovat
+*/
+bool DNS_engine::watch(int fd, uint32_t events, DNS_watch_callback callback)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        return false;
+    }
+    watchers[fd] = std::move(callback);
+    return true;
+}
+
+/**
+    Změna sledovaných událostí cizího deskriptoru
+    @param fd - Deskriptor přidaný přes watch()
+    @param events - Nové sledované události
+*/
+void DNS_engine::modify_watch(int fd, uint32_t events)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/**
+    Odebrání cizího deskriptoru ze smyčky událostí (deskriptor se nezavírá)
+    @param fd - Deskriptor přidaný přes watch()
+*/
+void DNS_engine::unwatch(int fd)
+{
+    if(watchers.erase(fd) > 0)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+/**
+    Jeden průchod smyčkou událostí: čekání na data, zpracování odpovědí a vypršení
+    @param max_wait_ms - Nejdelší doba čekání v milisekundách (-1 = bez omezení)
+*/
+void DNS_engine::run_once(int max_wait_ms)
+{
+    // dotazy zařazené mimo smyčku se odešlou před čekáním, pokud některý hned selže, nečeká se
+    size_t before = in_flight;
+    flush_sends();
+    int wait_ms = (in_flight < before) ? 0 : max_wait_ms;
+    if(in_flight > 0)
+    {
+        // nejpozději do dalšího tiku časového kola
+        auto remaining = wheel_time + std::chrono::milliseconds(wheel_tick_ms) - clock::now();
+        int tick_ms = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count() + 1);
+        wait_ms = (wait_ms < 0) ? tick_ms : std::min(wait_ms, tick_ms);
+    }
+    if(!timers.empty())
+    {
+        auto remaining = timers.begin()->first - clock::now();
+        int timer_ms = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count() + 1);
+        wait_ms = (wait_ms < 0) ? timer_ms : std::min(wait_ms, timer_ms);
+    }
+
+    struct epoll_event events[64];
+    int count = epoll_wait(epoll_fd, events, 64, wait_ms);
+    for(int i = 0; i < count; i++)
+    {
+        int fd = events[i].data.fd;
+        if(fd == socket4 || fd == socket6)
+        {
+            receive(fd);
+            continue;
+        }
+        auto watcher = watchers.find(fd);
+        if(watcher != watchers.end())
+        {
+            // kopie, callback může deskriptor odebrat
+            DNS_watch_callback callback = watcher->second;
+            callback(events[i].events);
+            continue;
+        }
+        for(size_t s = 0; s < servers.size(); s++)
+        {
+            if(servers[s].tcp.fd == fd)
+            {
+                handle_tcp(s, events[i].events);
+                break;
+            }
+        }
+    }
+    advance_wheel();
+    run_timers();
+
+    // doplnění okna dotazy z fronty
+    while(in_flight < max_in_flight && !waiting.empty())
+    {
+        Waiting request = std::move(waiting.front());
+        waiting.pop_front();
+        if(!attach(request))
+        {
+            start(request);
+        }
+    }
+    flush_sends();
+}
+
+/**
+    Naplánování jednorázového časovače, callback se zavolá z run_once() nejdřív po delay_ms
+    Časovače nejsou dotazy, pending() je nepočítá a run() na ně nečeká.
+    @param delay_ms - Zpoždění v milisekundách
+    @param callback - Funkce volaná po uplynutí času
+*/
+void DNS_engine::defer(int delay_ms, DNS_timer_callback callback)
+{
+    timers.emplace(clock::now() + std::chrono::milliseconds(std::max(0, delay_ms)), std::move(callback));
+}
+
+/**
+    Zavolání časovačů, jejichž čas už nastal (v pořadí, v jakém vyprší)
+*/
+void DNS_engine::run_timers()
+{
+    clock::time_point now = clock::now();
+    while(!timers.empty() && timers.begin()->first <= now)
+    {
+        // odebrání před zavoláním, callback může naplánovat další časovač
+        DNS_timer_callback callback = std::move(timers.begin()->second);
+        timers.erase(timers.begin());
+        callback();
+    }
+}
+
+/**
+    Pohánění smyčky událostí, dokud nejsou dokončeny všechny dotazy
+*/
+void DNS_engine::run()
+{
+    while(pending() > 0)
+    {
+        run_once(-1);
+    }
+}
+
+/**
+    Počet nedokončených dotazů (odeslaných, čekajících ve frontě i připojených k rozpracovaným)
+    @return - Počet dotazů
+*/
+size_t DNS_engine::pending() const
+{
+    return in_flight + waiting.size() + attached;
+}
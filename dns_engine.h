@@ -0,0 +1,248 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Neblokující engine pro DNS dotazy nad epoll
+*/
+
+#ifndef DNS_ENGINE_H
+#define DNS_ENGINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <unordered_map>
+#include <map>
+#include <sys/socket.h>
+
+struct DNS_metrics;
+
+/*
+    Stav dokončeného dotazu
+*/
+enum DNS_status {
+    DNS_OK = 0,
+    DNS_ERR_TIMEOUT,
+    DNS_ERR_SEND,
+    DNS_ERR_SERVER,
+    DNS_ERR_NAME,
+    DNS_ERR_FORMAT
+};
+
+/*
+    Výsledek dotazu předávaný do callbacku
+*/
+struct DNS_result {
+    int status;
+    std::vector<char> response;
+};
+
+typedef std::function<void(DNS_result&)> DNS_callback;
+typedef std::function<void(uint32_t events)> DNS_watch_callback;
+typedef std::function<void()> DNS_timer_callback;
+
+/*
+    Engine drží jeden IPv4 a jeden IPv6 UDP socket, přes které multiplexuje
+    všechny rozpracované dotazy. Dotazy se párují podle ID a otázky, jejich
+    vypršení hlídá časové kolo (timer wheel).
+    Dotaz lze poslat více serverům najednou, platí první platná odpověď.
+    Pro každý server se počítá vyhlazené RTT, podle kterého se servery řadí
+    a ze kterého se odvozuje čas opakovaného odeslání (RTO, s exponenciálním backoffem).
+    Zkrácené odpovědi (TC) se opakují přes TCP. Ke každému serveru se drží nejvýše
+    jedno TCP spojení, přes které jde víc dotazů za sebou (pipelining podle RFC 7766)
+    a odpovědi se párují podle ID v libovolném pořadí.
+    Dotazy nesou OPT záznam EDNS(0), přijímací buffery mají velikost inzerovaného
+    payloadu a po zpracování odpovědi se vracejí do zásoby pro další dotazy.
+    Do smyčky událostí lze přidat i cizí deskriptory (watch), např. sockety serveru,
+    a jednorázové časovače (defer), např. limit pro vydání prošlé odpovědi z cache.
+    Stejné dotazy (jméno bez ohledu na velikost písmen, typ, bit RD a servery) se slučují: dokud je
+    jeden rozpracovaný, další se k němu jen připojí a dostanou kopii jeho výsledku.
+*/
+class DNS_engine {
+public:
+    DNS_engine();
+    ~DNS_engine();
+    DNS_engine(const DNS_engine&) = delete;
+    DNS_engine& operator=(const DNS_engine&) = delete;
+
+    int add_server(const std::string& server_ip, uint16_t port);
+    bool set_server(int server, const std::string& server_ip, uint16_t port);
+    void set_max_in_flight(size_t max);
+    void set_retries(int retries);
+    void set_tcp(bool tcp);
+    void set_edns_payload(uint16_t payload);
+    void set_coalescing(bool coalescing);
+    void set_metrics(DNS_metrics* metrics);
+    void submit(int server, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms, DNS_callback callback);
+    std::future<DNS_result> submit(int server, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms);
+    void submit(const std::vector<int>& servers, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms, DNS_callback callback);
+    std::future<DNS_result> submit(const std::vector<int>& servers, const std::string& qname, uint16_t qtype, bool recursion, int timeout_ms);
+    bool watch(int fd, uint32_t events, DNS_watch_callback callback);
+    void modify_watch(int fd, uint32_t events);
+    void unwatch(int fd);
+    void defer(int delay_ms, DNS_timer_callback callback);
+    void run_once(int max_wait_ms);
+    void run();
+    size_t pending() const;
+    double server_rtt(int server) const;
+
+    static const size_t max_servers = 64;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    /*
+        Trvalé TCP spojení k serveru, výstupní a vstupní buffer se drží mezi dotazy
+    */
+    struct Connection {
+        int fd;
+        bool connected;
+        bool want_write;
+        std::vector<char> out;
+        size_t out_pos;
+        std::vector<char> in;
+        size_t in_len;
+        uint32_t generation;   // zvýší se při každém uzavření spojení
+    };
+
+    /*
+        Upstream server a socket, přes který se mu posílá
+    */
+    struct Server {
+        std::string address;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        int fd;
+        double srtt_ms;
+        double rttvar_ms;
+        uint32_t samples;
+        Connection tcp;
+    };
+
+    /*
+        Rozpracovaný dotaz, uložený ve slotu podle svého ID
+    */
+    struct Query {
+        bool active;
+        uint32_t generation;
+        uint64_t server_mask;
+        uint64_t answered_mask;
+        uint64_t tcp_mask;
+        clock::time_point sent;
+        clock::time_point deadline;
+        uint8_t attempts;
+        std::string qname;
+        uint16_t qtype;
+        uint32_t packet_slot;
+        uint16_t packet_length;
+        DNS_callback callback;
+        std::string key;                       // klíč v in_flight_index, prázdný = dotaz se neslučuje
+        std::vector<DNS_callback> followers;   // připojené stejné dotazy
+        std::vector<char> error_response;      // poslední chybová odpověď (SERVFAIL, ...) od serveru, který prohrál závod
+    };
+
+    /*
+        Dotaz čekající na uvolnění místa v okně rozpracovaných dotazů
+    */
+    struct Waiting {
+        uint64_t server_mask;
+        std::string qname;
+        uint16_t qtype;
+        bool recursion;
+        int timeout_ms;
+        DNS_callback callback;
+    };
+
+    /*
+        UDP paket čekající na odeslání v dávce (sendmmsg), neplatný pokud se generace dotazu změnila
+    */
+    struct Outgoing {
+        uint16_t id;
+        uint32_t generation;
+        int server;
+    };
+
+    /*
+        Položka časového kola, neplatná pokud se generace dotazu mezitím změnila
+    */
+    struct Timer {
+        uint16_t id;
+        uint32_t generation;
+        uint32_t rounds;
+    };
+
+    static const int wheel_tick_ms = 10;
+    static const size_t max_query_size = 512;
+    static const size_t wheel_size = 1024;
+    static const int initial_rto_ms = 400;
+    static const int min_rto_ms = 50;
+    static const int max_rto_ms = 3000;
+    static const size_t max_pooled_buffers = 64;
+    static const size_t io_batch = 32;
+    static const int receive_buffer_size = 1 << 20;
+
+    int epoll_fd;
+    int socket4;
+    int socket6;
+    std::vector<Server> servers;
+    std::vector<Query> queries;
+    std::deque<Waiting> waiting;
+    std::vector<std::vector<Timer>> wheel;
+    size_t wheel_pos;
+    clock::time_point wheel_time;
+    size_t in_flight;
+    size_t max_in_flight;
+    int retries;
+    bool tcp_only;
+    uint16_t edns_payload;
+    size_t udp_buffer_size;
+    DNS_metrics* metrics;
+    std::vector<std::vector<char>> receive_buffers;
+    std::vector<std::vector<char>> buffer_pool;
+    std::vector<Outgoing> send_queue;
+    struct mmsghdr io_msgs[io_batch];
+    struct iovec io_vecs[io_batch];
+    sockaddr_storage io_addrs[io_batch];
+    std::unordered_map<int, DNS_watch_callback> watchers;
+    std::multimap<clock::time_point, DNS_timer_callback> timers;
+    bool coalescing;
+    std::unordered_map<std::string, uint16_t> in_flight_index;
+    size_t attached;   // dotazy připojené k rozpracovaným (followers), počítají se do pending()
+    std::vector<char> packet_storage;
+    std::vector<uint32_t> free_packets;
+
+    int open_socket(int family);
+    bool set_address(Server& server, const std::string& server_ip, uint16_t port);
+    uint32_t acquire_packet();
+    char* packet(uint32_t slot);
+    void enqueue(Waiting& request);
+    static std::string coalescing_key(const Waiting& request);
+    bool attach(Waiting& request);
+    void start(Waiting& request);
+    std::vector<char> acquire_buffer();
+    void release_buffer(std::vector<char>& buffer);
+    void complete(uint16_t id, int status, std::vector<char>& response);
+    void receive(int fd);
+    void accept_response(uint16_t id, int server, const char* data, size_t len, std::vector<char>* datagram);
+    bool send_tcp(int server, const Query& query);
+    bool flush_tcp(int server);
+    void handle_tcp(int server, uint32_t events);
+    bool drop_tcp(int server);
+    void close_tcp(int server);
+    int find_server(const sockaddr_storage& from, uint64_t mask) const;
+    void update_rtt(int server, double sample_ms);
+    int query_rto(const Query& query) const;
+    void schedule(uint16_t id, int delay_ms);
+    uint64_t transmit(Query& query);
+    void flush_sends();
+    void advance_wheel();
+    void run_timers();
+};
+
+#endif
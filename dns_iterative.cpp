@@ -0,0 +1,527 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_iterative.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+const int DNS_iterative::max_referrals;
+const int DNS_iterative::max_cnames;
+const int DNS_iterative::max_depth;
+const size_t DNS_iterative::fanout;
+const int DNS_iterative::step_timeout_ms;
+const size_t DNS_iterative::server_slots;
+
+// nejdelší doba, po kterou se drží delegace (v sekundách)
+static const uint32_t max_delegation_ttl = 86400;
+
+// vestavěné kořenové servery (IPv4 adresy a.root-servers.net až m.root-servers.net)
+static const char* const builtin_root_hints[] = {
+    "198.41.0.4", "170.247.170.2", "192.33.4.12", "199.7.91.13", "192.203.230.10",
+    "192.5.5.241", "192.112.36.4", "198.97.190.53", "192.36.148.17", "192.58.128.30",
+    "193.0.14.129", "199.7.83.42", "202.12.27.33"
+};
+
+/**
+    Převod jména do porovnatelného tvaru (malá písmena, bez tečky na konci)
+    @param name - Domain name
+    @return - Upravené jméno, kořen je prázdný řetězec
+*/
+static std::string normalize(const std::string& name)
+{
+    std::string result = name;
+    if(!result.empty() && result.back() == '.')
+    {
+        result.pop_back();
+    }
+    for(char& c : result)
+    {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+    return result;
+}
+
+/**
+    Zda jméno leží v zóně (nebo je přímo jejím vrcholem)
+    @param name - Upravené jméno
+    @param zone - Upravené jméno zóny, kořen je prázdný řetězec
+    @return - true, pokud jméno patří do zóny
+*/
+static bool in_zone(const std::string& name, const std::string& zone)
+{
+    if(zone.empty() || name == zone)
+    {
+        return true;
+    }
+    return name.size() > zone.size() && name[name.size() - zone.size() - 1] == '.' &&
+           name.compare(name.size() - zone.size(), zone.size(), zone) == 0;
+}
+
+/**
+    Odstranění záznamů mimo zónu serveru (bailiwick), za ty server nemůže ručit
+    @param records - Záznamy jedné sekce odpovědi
+    @param zone - Upravené jméno zóny, na kterou se rezoluce ptala
+*/
+static void keep_in_zone(std::vector<DNS_Record>& records, const std::string& zone)
+{
+    records.erase(std::remove_if(records.begin(), records.end(), [&zone](const DNS_Record& record)
+    {
+        return !in_zone(normalize(record.name), zone);
+    }), records.end());
+}
+
+/**
+    Konstruktor rezolveru, začíná s vestavěnými kořenovými servery
+    @param engine - Engine, přes který se posílají dotazy
+    @param port - Port autoritativních serverů
+*/
+DNS_iterative::DNS_iterative(DNS_engine& engine, uint16_t port)
+    : engine(engine), port(port), root_hints(std::begin(builtin_root_hints), std::end(builtin_root_hints)), use_clock(0)
+{
+}
+
+/**
+    Nahrazení kořenových serverů (např. lokálním testovacím serverem)
+    @param addresses - Adresy serverů, které se ptají jako první
+*/
+void DNS_iterative::set_root_hints(const std::vector<std::string>& addresses)
+{
+    root_hints = addresses;
+}
+
+/**
+    Iterativní rezoluce jména, výsledek se předá do callbacku z DNS_engine::run_once()
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param callback - Funkce volaná s výsledkem (v answer sectionu je i celý řetězec CNAME)
+*/
+void DNS_iterative::resolve(const std::string& qname, uint16_t qtype, DNS_resolve_callback callback)
+{
+    resolve(qname, qtype, 0, std::move(callback));
+}
+
+/**
+    Počet delegací uložených v cache
+    @return - Počet zón
+*/
+size_t DNS_iterative::delegations_cached() const
+{
+    return delegations.size();
+}
+
+/**
+    Založení rezoluce, depth počítá vnoření kvůli dohledání adres serverů bez glue
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param depth - Hloubka vnoření
+    @param callback - Funkce volaná s výsledkem
+*/
+void DNS_iterative::resolve(const std::string& qname, uint16_t qtype, int depth, DNS_resolve_callback callback)
+{
+    std::shared_ptr<Resolution> state = std::make_shared<Resolution>();
+    state->qname = normalize(qname);
+    state->target = state->qname;
+    state->qtype = qtype;
+    state->next_address = 0;
+    state->referrals = 0;
+    state->cnames = 0;
+    state->depth = depth;
+    state->callback = std::move(callback);
+    start(state);
+}
+
+/**
+    Začátek dotazování u nejbližší známé delegace nad hledaným jménem (nebo u kořene)
+    @param state - Stav rezoluce
+*/
+void DNS_iterative::start(std::shared_ptr<Resolution> state)
+{
+    clock::time_point now = clock::now();
+    std::string zone = state->target;
+    while(!zone.empty())
+    {
+        auto it = delegations.find(zone);
+        if(it != delegations.end())
+        {
+            if(it->second.expires > now)
+            {
+                set_addresses(*state, zone, it->second.addresses);
+                query(state);
+                return;
+            }
+            delegations.erase(it);
+        }
+        size_t dot = zone.find('.');
+        zone = (dot == std::string::npos) ? "" : zone.substr(dot + 1);
+    }
+    set_addresses(*state, "", root_hints);
+    query(state);
+}
+
+/**
+    Nastavení serverů zóny, na kterou se rezoluce právě ptá, seřazených podle RTT
+    @param state - Stav rezoluce
+    @param zone - Zóna
+    @param addresses - Adresy jejích serverů
+*/
+void DNS_iterative::set_addresses(Resolution& state, const std::string& zone, const std::vector<std::string>& addresses)
+{
+    state.zone = zone;
+    state.addresses = addresses;
+    state.next_address = 0;
+    std::stable_sort(state.addresses.begin(), state.addresses.end(), [this](const std::string& a, const std::string& b)
+    {
+        auto ia = slot_index.find(a);
+        auto ib = slot_index.find(b);
+        double rtt_a = (ia == slot_index.end()) ? 0 : engine.server_rtt(slots[ia->second].index);
+        double rtt_b = (ib == slot_index.end()) ? 0 : engine.server_rtt(slots[ib->second].index);
+        return rtt_a < rtt_b;
+    });
+}
+
+/**
+    Odeslání dotazu nejvýše fanout dalším serverům zóny (platí nejrychlejší odpověď)
+    @param state - Stav rezoluce
+*/
+void DNS_iterative::query(std::shared_ptr<Resolution> state)
+{
+    // sloty se označí jako používané hned, aby je další server téhož dotazu nepřevzal
+    std::vector<size_t> used;
+    std::vector<int> servers;
+    size_t first = state->next_address;
+    while(state->next_address < state->addresses.size() && servers.size() < fanout)
+    {
+        int slot = server(state->addresses[state->next_address++]);
+        if(slot != -1)
+        {
+            slots[slot].busy++;
+            used.push_back(slot);
+            servers.push_back(slots[slot].index);
+        }
+    }
+    if(servers.empty())
+    {
+        if(!idle_slot())
+        {
+            // všechny sloty drží rozpracované dotazy, rezoluce pokračuje po dokončení některého z nich
+            state->next_address = first;
+            parked.push_back(state);
+            return;
+        }
+        DNS_Response empty;
+        finish(state, DNS_ERR_SERVER, empty);
+        return;
+    }
+    engine.submit(servers, state->target, state->qtype, false, step_timeout_ms, [this, state, used](DNS_result& result)
+    {
+        for(size_t slot : used)
+        {
+            slots[slot].busy--;
+        }
+        while(!parked.empty() && idle_slot())
+        {
+            std::shared_ptr<Resolution> next = parked.front();
+            parked.pop_front();
+            query(next);
+        }
+        process(state, result);
+    });
+}
+
+/**
+    Zpracování odpovědi autoritativního serveru: odpověď, CNAME, odkaz na nižší zónu nebo chyba
+    @param state - Stav rezoluce
+    @param result - Výsledek dotazu z enginu
+*/
+void DNS_iterative::process(std::shared_ptr<Resolution> state, DNS_result& result)
+{
+    DNS_Response response;
+    int status = result.status;
+    if(status == DNS_OK && !parse_response(result.response, response))
+    {
+        status = DNS_ERR_FORMAT;
+    }
+    uint16_t rcode = (status == DNS_OK) ? (response.flags & 0x000F) : 0;
+    if(status != DNS_OK || (rcode != 0 && rcode != 3))
+    {
+        // zkusí se další servery zóny, jinak se vrátí poslední výsledek
+        if(state->next_address < state->addresses.size())
+        {
+            query(state);
+            return;
+        }
+        finish(state, status, response);
+        return;
+    }
+    // data mimo dotazovanou zónu se zahodí (podvržený CNAME cíl nebo cizí glue by se jinak uložily do cache),
+    // CNAME vedoucí mimo zónu se pak dořeší od nejbližší delegace cílového jména
+    keep_in_zone(response.answers, state->zone);
+    keep_in_zone(response.authority, state->zone);
+    keep_in_zone(response.additional, state->zone);
+    if(rcode == 3)
+    {
+        finish(state, DNS_OK, response);
+        return;
+    }
+
+    // hledaný záznam, případně CNAME řetězec v rámci jedné odpovědi
+    std::string name = state->target;
+    bool found = false;
+    for(int hop = 0; hop <= max_cnames && !found; hop++)
+    {
+        std::string next;
+        for(const DNS_Record& record : response.answers)
+        {
+            if(normalize(record.name) != name)
+            {
+                continue;
+            }
+            if(record.type == state->qtype || state->qtype == 255)
+            {
+                found = true;
+            }
+            else if(record.type == 5)
+            {
+                next = normalize(record.rdata);
+            }
+        }
+        if(found || next.empty())
+        {
+            break;
+        }
+        name = next;
+    }
+    if(found)
+    {
+        finish(state, DNS_OK, response);
+        return;
+    }
+    if(name != state->target)
+    {
+        // CNAME vede mimo tuto odpověď, rezoluce pokračuje od nejbližší delegace nového jména
+        state->chain.insert(state->chain.end(), response.answers.begin(), response.answers.end());
+        if(++state->cnames > max_cnames)
+        {
+            DNS_Response empty;
+            finish(state, DNS_ERR_SERVER, empty);
+            return;
+        }
+        state->target = name;
+        start(state);
+        return;
+    }
+    if(follow_referral(state, response))
+    {
+        return;
+    }
+
+    // autoritativní odpověď bez dat (NODATA), jinak server zónu neobsluhuje (lame delegation)
+    bool has_soa = std::any_of(response.authority.begin(), response.authority.end(), [](const DNS_Record& record)
+    {
+        return record.type == 6;
+    });
+    if(has_soa || (response.flags & 0x0400))
+    {
+        finish(state, DNS_OK, response);
+        return;
+    }
+    if(state->next_address < state->addresses.size())
+    {
+        query(state);
+        return;
+    }
+    finish(state, DNS_ERR_SERVER, response);
+}
+
+/**
+    Přechod na nižší zónu podle NS záznamů z authority sectionu a glue z additional sectionu
+    @param state - Stav rezoluce
+    @param response - Odpověď s odkazem
+    @return - true, pokud odpověď obsahovala použitelný odkaz (rezoluce pokračuje)
+*/
+bool DNS_iterative::follow_referral(std::shared_ptr<Resolution> state, const DNS_Response& response)
+{
+    std::string zone;
+    std::vector<std::string> ns_names;
+    uint32_t ttl = max_delegation_ttl;
+    for(const DNS_Record& record : response.authority)
+    {
+        if(record.type != 2)
+        {
+            continue;
+        }
+        // odkaz musí vést blíž k hledanému jménu, jinak by se rezoluce zacyklila
+        std::string owner = normalize(record.name);
+        if(owner == state->zone || !in_zone(owner, state->zone) || !in_zone(state->target, owner))
+        {
+            continue;
+        }
+        if(zone.empty())
+        {
+            zone = owner;
+        }
+        if(owner == zone)
+        {
+            ns_names.push_back(normalize(record.rdata));
+            ttl = std::min(ttl, record.ttl);
+        }
+    }
+    if(ns_names.empty())
+    {
+        return false;
+    }
+    if(++state->referrals > max_referrals)
+    {
+        DNS_Response empty;
+        finish(state, DNS_ERR_SERVER, empty);
+        return true;
+    }
+
+    // glue se přijme jen pro jména v zóně serveru, který odkaz poslal
+    std::vector<std::string> addresses;
+    for(const DNS_Record& record : response.additional)
+    {
+        std::string owner = normalize(record.name);
+        if((record.type == 1 || record.type == 28) && in_zone(owner, state->zone) &&
+           std::find(ns_names.begin(), ns_names.end(), owner) != ns_names.end())
+        {
+            addresses.push_back(record.rdata);
+        }
+    }
+    if(addresses.empty())
+    {
+        state->zone = zone;
+        state->glueless = ns_names;
+        resolve_glueless(state);
+        return true;
+    }
+    Delegation& delegation = delegations[zone];
+    delegation.addresses = addresses;
+    delegation.expires = clock::now() + std::chrono::seconds(ttl);
+    set_addresses(*state, zone, addresses);
+    query(state);
+    return true;
+}
+
+/**
+    Dohledání adresy některého ze serverů zóny, pro kterou odkaz neobsahoval glue
+    @param state - Stav rezoluce (zóna a zbývající jména serverů)
+*/
+void DNS_iterative::resolve_glueless(std::shared_ptr<Resolution> state)
+{
+    if(state->glueless.empty() || state->depth >= max_depth)
+    {
+        DNS_Response empty;
+        finish(state, DNS_ERR_SERVER, empty);
+        return;
+    }
+    std::string ns_name = state->glueless.back();
+    state->glueless.pop_back();
+    resolve(ns_name, 1, state->depth + 1, [this, state, ns_name](int status, DNS_Response& response)
+    {
+        std::vector<std::string> addresses;
+        uint32_t ttl = max_delegation_ttl;
+        if(status == DNS_OK)
+        {
+            for(const DNS_Record& record : response.answers)
+            {
+                if(record.type == 1)
+                {
+                    addresses.push_back(record.rdata);
+                    ttl = std::min(ttl, record.ttl);
+                }
+            }
+        }
+        if(addresses.empty())
+        {
+            resolve_glueless(state);
+            return;
+        }
+        Delegation& delegation = delegations[state->zone];
+        delegation.addresses = addresses;
+        delegation.expires = clock::now() + std::chrono::seconds(ttl);
+        state->glueless.clear();
+        set_addresses(*state, state->zone, addresses);
+        query(state);
+    });
+}
+
+/**
+    Dokončení rezoluce, před odpověď se vloží dříve sledované CNAME záznamy
+    @param state - Stav rezoluce
+    @param status - Stav dokončení
+    @param response - Poslední odpověď
+*/
+void DNS_iterative::finish(std::shared_ptr<Resolution> state, int status, DNS_Response& response)
+{
+    if(status == DNS_OK)
+    {
+        response.answers.insert(response.answers.begin(), state->chain.begin(), state->chain.end());
+        response.qname = state->qname;
+        response.qtype = state->qtype;
+    }
+    state->callback(status, response);
+}
+
+/**
+    Slot enginu pro server, server se přidá při prvním použití. Když jsou všechny sloty obsazené,
+    převezme se nejdéle nepoužitý slot bez rozpracovaných dotazů (jeho RTT se měří znovu).
+    @param address - Adresa serveru
+    @return - Pozice slotu ve slots, -1 pokud teď žádný slot volný není
+*/
+int DNS_iterative::server(const std::string& address)
+{
+    auto it = slot_index.find(address);
+    if(it != slot_index.end())
+    {
+        slots[it->second].used = ++use_clock;
+        return it->second;
+    }
+    if(slots.size() < server_slots)
+    {
+        int index = engine.add_server(address, port);
+        if(index == -1)
+        {
+            return -1;
+        }
+        slot_index[address] = slots.size();
+        slots.push_back(Slot{ address, index, 0, ++use_clock });
+        return slots.size() - 1;
+    }
+
+    size_t victim = slots.size();
+    for(size_t i = 0; i < slots.size(); i++)
+    {
+        if(slots[i].busy == 0 && (victim == slots.size() || slots[i].used < slots[victim].used))
+        {
+            victim = i;
+        }
+    }
+    if(victim == slots.size() || !engine.set_server(slots[victim].index, address, port))
+    {
+        return -1;
+    }
+    slot_index.erase(slots[victim].address);
+    slots[victim].address = address;
+    slots[victim].used = ++use_clock;
+    slot_index[address] = victim;
+    return victim;
+}
+
+/**
+    Zda lze některému serveru přidělit slot (volné místo nebo slot bez rozpracovaných dotazů)
+    @return - true, pokud server() teď slot najde
+*/
+bool DNS_iterative::idle_slot() const
+{
+    return slots.size() < server_slots || std::any_of(slots.begin(), slots.end(), [](const Slot& slot)
+    {
+        return slot.busy == 0;
+    });
+}
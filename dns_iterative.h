@@ -0,0 +1,112 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Iterativní rezoluce od kořenových serverů (bez rekurzivního upstreamu)
+*/
+
+#ifndef DNS_ITERATIVE_H
+#define DNS_ITERATIVE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+
+#include "dns_wire.h"
+#include "dns_engine.h"
+
+typedef std::function<void(int status, DNS_Response& response)> DNS_resolve_callback;
+
+/*
+    Iterativní rezolver nad DNS_engine. Dotaz začíná u kořenových serverů (nebo u nejbližší
+    delegace z cache), sleduje odkazy z authority sectionu s glue záznamy z additional sectionu
+    a řetězce CNAME. Delegace se ukládají podle TTL, další dotazy tak vynechají horní úrovně.
+    Kořenové servery lze nahradit (např. lokálním testovacím serverem na loopbacku).
+    Autoritativní servery sdílejí nejvýše server_slots slotů enginu, nejdéle nepoužitý slot
+    bez rozpracovaných dotazů se přidělí dalšímu serveru; když volný není, rezoluce počká.
+*/
+class DNS_iterative {
+public:
+    DNS_iterative(DNS_engine& engine, uint16_t port);
+    DNS_iterative(const DNS_iterative&) = delete;
+    DNS_iterative& operator=(const DNS_iterative&) = delete;
+
+    void set_root_hints(const std::vector<std::string>& addresses);
+    void resolve(const std::string& qname, uint16_t qtype, DNS_resolve_callback callback);
+    size_t delegations_cached() const;
+
+    static const int max_referrals = 32;
+    static const int max_cnames = 8;
+    static const int max_depth = 4;
+    static const size_t fanout = 3;
+    static const int step_timeout_ms = 3000;
+    static const size_t server_slots = 32;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    /*
+        Delegace zóny: adresy jejích autoritativních serverů
+    */
+    struct Delegation {
+        std::vector<std::string> addresses;
+        clock::time_point expires;
+    };
+
+    /*
+        Stav jedné rozpracované rezoluce
+    */
+    struct Resolution {
+        std::string qname;
+        std::string target;
+        uint16_t qtype;
+        std::string zone;
+        std::vector<std::string> addresses;
+        size_t next_address;
+        int referrals;
+        int cnames;
+        int depth;
+        std::vector<DNS_Record> chain;
+        std::vector<std::string> glueless;
+        DNS_resolve_callback callback;
+    };
+
+    /*
+        Slot enginu obsazený autoritativním serverem, nejdéle nepoužitý volný slot dostane další server
+    */
+    struct Slot {
+        std::string address;
+        int index;
+        uint32_t busy;   // rozpracované dotazy, které slot používají
+        uint64_t used;   // pořadí posledního použití
+    };
+
+    DNS_engine& engine;
+    uint16_t port;
+    std::vector<std::string> root_hints;
+    std::unordered_map<std::string, Delegation> delegations;
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, size_t> slot_index;
+    uint64_t use_clock;
+    std::deque<std::shared_ptr<Resolution>> parked;   // rezoluce čekající na uvolnění slotu
+
+    void resolve(const std::string& qname, uint16_t qtype, int depth, DNS_resolve_callback callback);
+    void start(std::shared_ptr<Resolution> state);
+    void query(std::shared_ptr<Resolution> state);
+    void process(std::shared_ptr<Resolution> state, DNS_result& result);
+    bool follow_referral(std::shared_ptr<Resolution> state, const DNS_Response& response);
+    void resolve_glueless(std::shared_ptr<Resolution> state);
+    void set_addresses(Resolution& state, const std::string& zone, const std::vector<std::string>& addresses);
+    void finish(std::shared_ptr<Resolution> state, int status, DNS_Response& response);
+    int server(const std::string& address);
+    bool idle_slot() const;
+};
+
+#endif
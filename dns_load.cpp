@@ -0,0 +1,281 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Zátěžový generátor: posílá dotazy přes DNS_resolver danou rychlostí (QPS)
+    a vypíše propustnost a percentily latence
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "dns_wire.h"
+#include "dns_engine.h"
+#include "dns_resolver.h"
+
+typedef std::chrono::steady_clock load_clock;
+
+/*
+    Nastavení zátěže z příkazové řádky
+*/
+struct Load_options {
+    std::vector<std::string> servers;
+    uint16_t port;
+    double qps;          // 0 = co nejrychleji (omezuje jen okno rozpracovaných dotazů)
+    size_t count;
+    size_t window;
+    uint16_t qtype;
+    int timeout_ms;
+    bool caching;
+    bool tcp;
+    bool coalescing;
+    std::vector<std::string> names;
+};
+
+/**
+    Hodnota percentilu ze seřazených latencí (nejbližší vyšší hodnota)
+    @param sorted - Seřazené latence v mikrosekundách
+    @param percentile - Percentil (0 až 100)
+    @return - Latence v milisekundách
+*/
+static double percentile_ms(const std::vector<uint64_t>& sorted, double percentile)
+{
+    if(sorted.empty())
+    {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1] / 1000.0;
+}
+
+/**
+    Běh zátěže: dotazy se plánují v pevných intervalech 1/qps (otevřená smyčka, odesílání
+    nečeká na odpovědi) a latence se měří od plánovaného času odeslání, takže zpoždění
+    ve frontě rezolveru se do ní započítá a měření nepodhodnocuje zahlcený server.
+    @param resolver - Nastavený rezolver
+    @param options - Nastavení zátěže
+    @return - EXIT_SUCCESS, EXIT_FAILURE pokud žádný dotaz neuspěl
+*/
+static int run_load(DNS_resolver& resolver, const Load_options& options)
+{
+    std::vector<uint64_t> latencies;
+    latencies.reserve(options.count);
+    size_t errors[DNS_ERR_FORMAT + 1] = {};
+    size_t sent = 0;
+    size_t done = 0;
+    auto interval = std::chrono::nanoseconds(options.qps > 0 ? static_cast<int64_t>(1e9 / options.qps) : 0);
+    load_clock::time_point start = load_clock::now();
+
+    auto submit = [&](load_clock::time_point scheduled)
+    {
+        const std::string& name = options.names[sent % options.names.size()];
+        sent++;
+        resolver.resolve_async(name, options.qtype, [&, scheduled](int status, DNS_Response&)
+        {
+            done++;
+            if(status == DNS_OK)
+            {
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(load_clock::now() - scheduled).count());
+            }
+            else
+            {
+                errors[status]++;
+            }
+        });
+    };
+
+    while(done < options.count)
+    {
+        load_clock::time_point now = load_clock::now();
+        int wait_ms = 100;
+        if(options.qps > 0)
+        {
+            // dohnání všech dotazů, jejichž čas už nastal
+            while(sent < options.count && start + interval * sent <= now)
+            {
+                submit(start + interval * sent);
+            }
+            if(sent < options.count)
+            {
+                auto next = start + interval * sent - now;
+                wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(next).count();
+            }
+        }
+        else
+        {
+            while(sent < options.count && sent - done < options.window)
+            {
+                submit(load_clock::now());
+            }
+        }
+        if(done < options.count)
+        {
+            resolver.run_once(wait_ms);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(load_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    size_t failures = options.count - latencies.size();
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Dotazy: " << options.count;
+    if(options.qps > 0)
+    {
+        std::cout << " (cíl " << options.qps << "/s)";
+    }
+    std::cout << ", doba " << elapsed << " s, propustnost " << options.count / elapsed << " dotazů/s" << std::endl;
+    std::cout << "Odpovědi: " << latencies.size() << ", chyby: " << failures
+              << " (timeout " << errors[DNS_ERR_TIMEOUT] << ", odeslání " << errors[DNS_ERR_SEND]
+              << ", poškozené " << errors[DNS_ERR_FORMAT] << ")" << std::endl;
+    std::cout << "Latence (ms): min " << percentile_ms(latencies, 0) << ", p50 " << percentile_ms(latencies, 50)
+              << ", p90 " << percentile_ms(latencies, 90) << ", p99 " << percentile_ms(latencies, 99)
+              << ", p99.9 " << percentile_ms(latencies, 99.9) << ", max " << percentile_ms(latencies, 100) << std::endl;
+    return latencies.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+    Načtení číselného argumentu přepínače, při chybě se program ukončí
+    @param argc - Počet argumentů
+    @param argv - Argumenty
+    @param i - Index přepínače, posune se na hodnotu
+    @return - Hodnota
+*/
+static double number_argument(int argc, char* argv[], int& i)
+{
+    if(i + 1 >= argc)
+    {
+        std::cerr << "Argument " << argv[i] << " nemá hodnotu." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    i++;
+    char* end;
+    double value = strtod(argv[i], &end);
+    if(*end != '\0' || value < 0)
+    {
+        std::cerr << "Neplatná hodnota " << argv[i] << "." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(int argc, char* argv[])
+{
+    Load_options options;
+    options.port = 53;
+    options.qps = 0;
+    options.count = 10000;
+    options.window = 100;
+    options.qtype = 1;
+    options.timeout_ms = 2000;
+    options.caching = false;
+    options.tcp = false;
+    options.coalescing = false;
+    std::string names_file;
+
+    // zpracování argumentů
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            options.servers.push_back(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-p") == 0)
+        {
+            options.port = static_cast<uint16_t>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-q") == 0)
+        {
+            options.qps = number_argument(argc, argv, i);
+        }
+        else if(strcmp(argv[i], "-n") == 0)
+        {
+            options.count = static_cast<size_t>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-w") == 0)
+        {
+            options.window = std::max<size_t>(1, number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-timeout") == 0)
+        {
+            options.timeout_ms = static_cast<int>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            options.qtype = parse_type(argv[++i]);
+            if(options.qtype == 0)
+            {
+                std::cerr << "Neplatný typ dotazu " << argv[i] << "." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            names_file = argv[++i];
+        }
+        else if(strcmp(argv[i], "-c") == 0)
+        {
+            options.caching = true;
+        }
+        else if(strcmp(argv[i], "-k") == 0)
+        {
+            options.coalescing = true;
+        }
+        else if(strcmp(argv[i], "-tcp") == 0)
+        {
+            options.tcp = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            std::cerr << "Použití: dns_load -s server [-p port] [-q qps] [-n počet] [-w okno] [-t typ] [-timeout ms] [-c] [-k] [-tcp] [-f jména | jméno...]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            options.names.push_back(argv[i]);
+        }
+    }
+    if(!names_file.empty())
+    {
+        std::ifstream file(names_file);
+        if(!file)
+        {
+            std::cerr << "Soubor " << names_file << " nelze otevřít." << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::string name;
+        while(file >> name)
+        {
+            options.names.push_back(name);
+        }
+    }
+    if(options.servers.empty() || options.names.empty() || options.count == 0)
+    {
+        std::cerr << "Je třeba zadat server (-s), alespoň jedno jméno a nenulový počet dotazů." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    DNS_resolver resolver(options.port);
+    for(const std::string& server : options.servers)
+    {
+        if(resolver.add_server(server) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    resolver.set_caching(options.caching);
+    resolver.set_coalescing(options.coalescing);
+    resolver.set_tcp(options.tcp);
+    resolver.set_timeout(options.timeout_ms);
+    resolver.set_max_in_flight(options.qps > 0 ? 65536 : options.window);
+    return run_load(resolver, options);
+}
@@ -0,0 +1,568 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_metrics.h"
+#include "dns_wire.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const size_t DNS_label::max_length;
+const size_t DNS_histogram::sub_buckets;
+const size_t DNS_histogram::bucket_count;
+const size_t DNS_metrics_http::max_connections;
+const size_t DNS_metrics_http::max_request;
+
+// hranice košů exportovaných do Promethea (v sekundách)
+static const double export_bounds[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+
+/**
+    Konstruktor prázdného textu
+*/
+DNS_label::DNS_label() : sequence(0)
+{
+    for(size_t i = 0; i < max_length; i++)
+    {
+        text[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+    Přepsání textu (jen z jednoho zapisujícího vlákna), delší text se zkrátí
+    @param text - Nový text
+*/
+void DNS_label::set(const std::string& text)
+{
+    uint32_t start = sequence.load(std::memory_order_relaxed);
+    sequence.store(start + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t length = std::min(text.size(), max_length - 1);
+    for(size_t i = 0; i < max_length; i++)
+    {
+        this->text[i].store(i < length ? text[i] : 0, std::memory_order_relaxed);
+    }
+    sequence.store(start + 2, std::memory_order_release);
+}
+
+/**
+    Přečtení textu z libovolného vlákna
+    @return - Text, prázdný, pokud nebyl nastaven
+*/
+std::string DNS_label::get() const
+{
+    while(true)
+    {
+        uint32_t start = sequence.load(std::memory_order_acquire);
+        if(start & 1)
+        {
+            continue;
+        }
+        char copy[max_length];
+        for(size_t i = 0; i < max_length; i++)
+        {
+            copy[i] = text[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(sequence.load(std::memory_order_relaxed) == start)
+        {
+            return std::string(copy, strnlen(copy, max_length));
+        }
+    }
+}
+
+/**
+    Koš, do kterého hodnota patří: pod sub_buckets lineárně, dál podle nejvyššího bitu
+    a tří bitů pod ním
+    @param value_us - Hodnota v mikrosekundách
+    @return - Index koše
+*/
+size_t DNS_histogram::bucket_of(uint64_t value_us)
+{
+    value_us = std::min<uint64_t>(value_us, (1ULL << 36) - 1);
+    if(value_us < sub_buckets)
+    {
+        return value_us;
+    }
+    int top = 63 - __builtin_clzll(value_us);
+    int shift = top - 3;
+    return (shift + 1) * sub_buckets + ((value_us >> shift) & (sub_buckets - 1));
+}
+
+/**
+    Horní hranice koše (nejmenší hodnota, která už do koše nepatří)
+    @param bucket - Index koše
+    @return - Hranice v mikrosekundách
+*/
+uint64_t DNS_histogram::bucket_upper(size_t bucket)
+{
+    if(bucket < sub_buckets)
+    {
+        return bucket + 1;
+    }
+    size_t shift = bucket / sub_buckets - 1;
+    return (sub_buckets + bucket % sub_buckets + 1) << shift;
+}
+
+/**
+    Zaznamenání hodnoty
+    @param value_us - Hodnota v mikrosekundách
+*/
+void DNS_histogram::record(uint64_t value_us)
+{
+    counts[bucket_of(value_us)].add();
+    total_us.add(value_us);
+}
+
+/**
+    Přičtení histogramu do souhrnu (pro sečtení histogramů více vláken)
+    @param counts - Počty v koších, musí mít bucket_count prvků
+    @param sum - Součet hodnot v mikrosekundách
+*/
+void DNS_histogram::collect(std::vector<uint64_t>& counts, uint64_t& sum) const
+{
+    for(size_t i = 0; i < bucket_count; i++)
+    {
+        counts[i] += this->counts[i].get();
+    }
+    sum += total_us.get();
+}
+
+/**
+    Vynulování histogramu (slot upstream serveru převzal jiný server)
+*/
+void DNS_histogram::reset()
+{
+    for(size_t i = 0; i < bucket_count; i++)
+    {
+        counts[i].reset();
+    }
+    total_us.reset();
+}
+
+/*
+    Sečtené hodnoty metrik všech vláken
+*/
+struct Metrics_total {
+    uint64_t queries = 0;
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+    uint64_t timeouts = 0;
+    uint64_t send_errors = 0;
+    uint64_t retransmissions = 0;
+    uint64_t truncations = 0;
+    uint64_t coalesced = 0;
+    uint64_t prefetches = 0;
+    uint64_t stale_answers = 0;
+    uint64_t rcodes[16] = {};
+    std::vector<uint64_t> latency = std::vector<uint64_t>(DNS_histogram::bucket_count);
+    uint64_t latency_sum = 0;
+    std::vector<std::string> upstreams;
+    std::vector<std::vector<uint64_t>> upstream_rtt;
+    std::vector<uint64_t> upstream_sum;
+};
+
+/**
+    Sečtení metrik všech vláken, upstream servery se párují podle adresy
+    @param metrics - Metriky jednotlivých vláken
+    @return - Součet
+*/
+static Metrics_total total(const std::vector<const DNS_metrics*>& metrics)
+{
+    Metrics_total sum;
+    for(const DNS_metrics* m : metrics)
+    {
+        sum.queries += m->queries.get();
+        sum.cache_hits += m->cache_hits.get();
+        sum.cache_misses += m->cache_misses.get();
+        sum.timeouts += m->timeouts.get();
+        sum.send_errors += m->send_errors.get();
+        sum.retransmissions += m->retransmissions.get();
+        sum.truncations += m->truncations.get();
+        sum.coalesced += m->coalesced.get();
+        sum.prefetches += m->prefetches.get();
+        sum.stale_answers += m->stale_answers.get();
+        for(int r = 0; r < 16; r++)
+        {
+            sum.rcodes[r] += m->rcodes[r].get();
+        }
+        m->latency.collect(sum.latency, sum.latency_sum);
+        for(size_t s = 0; s < DNS_engine::max_servers; s++)
+        {
+            std::string name = m->upstream_names[s].get();
+            if(name.empty())
+            {
+                break;
+            }
+            size_t index = std::find(sum.upstreams.begin(), sum.upstreams.end(), name) - sum.upstreams.begin();
+            if(index == sum.upstreams.size())
+            {
+                sum.upstreams.push_back(name);
+                sum.upstream_rtt.emplace_back(DNS_histogram::bucket_count);
+                sum.upstream_sum.push_back(0);
+            }
+            m->upstream_rtt[s].collect(sum.upstream_rtt[index], sum.upstream_sum[index]);
+        }
+    }
+    return sum;
+}
+
+/**
+    Zápis histogramu ve formátu Prometheus (kumulativní koše le, _sum a _count)
+    @param out - Výstup
+    @param name - Název metriky
+    @param labels - Další popisky (např. server="1.1.1.1"), může být prázdné
+    @param counts - Počty v jemných koších
+    @param sum_us - Součet hodnot v mikrosekundách
+*/
+static void prometheus_histogram(std::ostringstream& out, const char* name, const std::string& labels, const std::vector<uint64_t>& counts, uint64_t sum_us)
+{
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    uint64_t total = 0;
+    for(uint64_t count : counts)
+    {
+        total += count;
+    }
+    // jemný koš se započítá do hranice, pod kterou celý leží
+    size_t bucket = 0;
+    uint64_t cumulative = 0;
+    for(double bound : export_bounds)
+    {
+        while(bucket < counts.size() && DNS_histogram::bucket_upper(bucket) <= bound * 1e6)
+        {
+            cumulative += counts[bucket++];
+        }
+        out << name << "_bucket{" << prefix << "le=\"" << bound << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << prefix << "le=\"+Inf\"} " << total << "\n";
+    out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << " " << sum_us / 1e6 << "\n";
+    out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << " " << total << "\n";
+}
+
+/**
+    Export metrik ve formátu Prometheus (text exposition format)
+    @param metrics - Metriky jednotlivých vláken
+    @return - Text pro odpověď na /metrics
+*/
+std::string metrics_prometheus(const std::vector<const DNS_metrics*>& metrics)
+{
+    Metrics_total sum = total(metrics);
+    std::ostringstream out;
+    const struct { const char* name; const char* help; uint64_t value; } counters[] = {
+        { "dns_queries_total", "Dokončené dotazy na upstream servery", sum.queries },
+        { "dns_cache_hits_total", "Dotazy zodpovězené z cache", sum.cache_hits },
+        { "dns_cache_misses_total", "Dotazy, které nebyly v cache", sum.cache_misses },
+        { "dns_timeouts_total", "Dotazy bez odpovědi", sum.timeouts },
+        { "dns_send_errors_total", "Pakety, které se nepodařilo odeslat", sum.send_errors },
+        { "dns_retransmissions_total", "Opakovaná odeslání dotazů", sum.retransmissions },
+        { "dns_truncated_total", "Zkrácené odpovědi (TC) opakované přes TCP", sum.truncations },
+        { "dns_coalesced_total", "Dotazy připojené k rozpracovanému stejnému dotazu", sum.coalesced },
+        { "dns_prefetches_total", "Obnovy často používaných odpovědí před vypršením", sum.prefetches },
+        { "dns_stale_answers_total", "Prošlé odpovědi vydané při nedostupném serveru (RFC 8767)", sum.stale_answers },
+    };
+    for(const auto& counter : counters)
+    {
+        out << "# HELP " << counter.name << " " << counter.help << "\n";
+        out << "# TYPE " << counter.name << " counter\n";
+        out << counter.name << " " << counter.value << "\n";
+    }
+    out << "# HELP dns_responses_total Odpovědi podle návratového kódu\n";
+    out << "# TYPE dns_responses_total counter\n";
+    for(int r = 0; r < 16; r++)
+    {
+        if(sum.rcodes[r] > 0 || r <= 5)
+        {
+            out << "dns_responses_total{rcode=\"" << rcode_name(r) << "\"} " << sum.rcodes[r] << "\n";
+        }
+    }
+    out << "# HELP dns_query_duration_seconds Doba dotazu od odeslání po dokončení\n";
+    out << "# TYPE dns_query_duration_seconds histogram\n";
+    prometheus_histogram(out, "dns_query_duration_seconds", "", sum.latency, sum.latency_sum);
+    out << "# HELP dns_upstream_rtt_seconds Doba odpovědi jednotlivých upstream serverů\n";
+    out << "# TYPE dns_upstream_rtt_seconds histogram\n";
+    for(size_t s = 0; s < sum.upstreams.size(); s++)
+    {
+        prometheus_histogram(out, "dns_upstream_rtt_seconds", "server=\"" + sum.upstreams[s] + "\"", sum.upstream_rtt[s], sum.upstream_sum[s]);
+    }
+    return out.str();
+}
+
+/**
+    Zápis souhrnu histogramu do JSON (počet, průměr, percentily a maximum v milisekundách)
+    @param out - Výstup
+    @param counts - Počty v jemných koších
+    @param sum_us - Součet hodnot v mikrosekundách
+*/
+static void json_histogram(std::ostringstream& out, const std::vector<uint64_t>& counts, uint64_t sum_us)
+{
+    uint64_t total = 0;
+    for(uint64_t count : counts)
+    {
+        total += count;
+    }
+    out << "{\"count\":" << total << ",\"mean_ms\":" << (total ? sum_us / 1000.0 / total : 0);
+    const struct { const char* name; double quantile; } quantiles[] = { { "p50_ms", 0.5 }, { "p90_ms", 0.9 }, { "p99_ms", 0.99 }, { "max_ms", 1.0 } };
+    for(const auto& q : quantiles)
+    {
+        // horní hranice koše, ve kterém leží daný percentil
+        uint64_t rank = static_cast<uint64_t>(q.quantile * total + 0.5);
+        uint64_t cumulative = 0;
+        uint64_t value = 0;
+        for(size_t b = 0; b < counts.size() && total > 0; b++)
+        {
+            cumulative += counts[b];
+            if(counts[b] > 0 && cumulative >= std::max<uint64_t>(rank, 1))
+            {
+                value = DNS_histogram::bucket_upper(b);
+                break;
+            }
+        }
+        out << ",\"" << q.name << "\":" << value / 1000.0;
+    }
+    out << "}";
+}
+
+/**
+    Export metrik jako JSON (výpis na konci dávkového režimu)
+    @param metrics - Metriky jednotlivých vláken
+    @return - JSON objekt na jednom řádku
+*/
+std::string metrics_json(const std::vector<const DNS_metrics*>& metrics)
+{
+    Metrics_total sum = total(metrics);
+    std::ostringstream out;
+    out << "{\"queries\":" << sum.queries
+        << ",\"cache_hits\":" << sum.cache_hits
+        << ",\"cache_misses\":" << sum.cache_misses
+        << ",\"timeouts\":" << sum.timeouts
+        << ",\"send_errors\":" << sum.send_errors
+        << ",\"retransmissions\":" << sum.retransmissions
+        << ",\"truncations\":" << sum.truncations
+        << ",\"coalesced\":" << sum.coalesced
+        << ",\"prefetches\":" << sum.prefetches
+        << ",\"stale_answers\":" << sum.stale_answers
+        << ",\"rcodes\":{";
+    bool first = true;
+    for(int r = 0; r < 16; r++)
+    {
+        if(sum.rcodes[r] > 0)
+        {
+            out << (first ? "" : ",") << "\"" << rcode_name(r) << "\":" << sum.rcodes[r];
+            first = false;
+        }
+    }
+    out << "},\"latency\":";
+    json_histogram(out, sum.latency, sum.latency_sum);
+    out << ",\"upstreams\":[";
+    for(size_t s = 0; s < sum.upstreams.size(); s++)
+    {
+        out << (s ? "," : "") << "{\"server\":\"" << sum.upstreams[s] << "\",\"rtt\":";
+        json_histogram(out, sum.upstream_rtt[s], sum.upstream_sum[s]);
+        out << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+/**
+    Konstruktor HTTP endpointu
+    @param engine - Engine, v jehož smyčce endpoint běží
+    @param render - Funkce vracející aktuální text metrik
+*/
+DNS_metrics_http::DNS_metrics_http(DNS_engine& engine, std::function<std::string()> render)
+    : engine(engine), render(render), listen_fd(-1)
+{
+}
+
+/**
+    Destruktor HTTP endpointu, uzavře naslouchající socket i spojení
+*/
+DNS_metrics_http::~DNS_metrics_http()
+{
+    while(!connections.empty())
+    {
+        close_client(connections.begin()->first);
+    }
+    if(listen_fd != -1)
+    {
+        engine.unwatch(listen_fd);
+        close(listen_fd);
+    }
+}
+
+/**
+    Otevření naslouchajícího TCP socketu
+    @param address - Adresa (IPv4 nebo IPv6)
+    @param port - Port
+    @return - false při chybě (chyba se vypíše)
+*/
+bool DNS_metrics_http::listen(const std::string& address, uint16_t port)
+{
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+    struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+    struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&addr);
+    if(inet_pton(AF_INET6, address.c_str(), &addr6->sin6_addr) == 1)
+    {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+    else if(inet_pton(AF_INET, address.c_str(), &addr4->sin_addr) == 1)
+    {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        std::cerr << "Neplatná adresa pro metriky." << std::endl;
+        return false;
+    }
+    int one = 1;
+    listen_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd == -1)
+    {
+        std::cerr << "Socket pro metriky se nepodařil vytvořit." << std::endl;
+        return false;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 || ::listen(listen_fd, 16) == -1)
+    {
+        std::cerr << "Metriky nelze zpřístupnit na " << address << " port " << port << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(!engine.watch(listen_fd, EPOLLIN, [this](uint32_t) { accept_client(); }))
+    {
+        std::cerr << "Socket pro metriky se nepodařilo zaregistrovat do epoll." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+    Přijetí nových spojení
+*/
+void DNS_metrics_http::accept_client()
+{
+    while(true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if(connections.size() >= max_connections || !engine.watch(fd, EPOLLIN, [this, fd](uint32_t events) { handle_client(fd, events); }))
+        {
+            close(fd);
+            continue;
+        }
+        connections[fd].out_pos = 0;
+    }
+}
+
+/**
+    Čtení požadavku a zápis odpovědi, po odeslání celé odpovědi se spojení uzavře
+    @param fd - Socket klienta
+    @param events - Události z epoll
+*/
+void DNS_metrics_http::handle_client(int fd, uint32_t events)
+{
+    auto it = connections.find(fd);
+    if(it == connections.end())
+    {
+        return;
+    }
+    Connection& connection = it->second;
+    if(connection.out.empty() && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        char buffer[1024];
+        while(true)
+        {
+            ssize_t len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if(len == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if(len == 0 || (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                close_client(fd);
+                return;
+            }
+            if(len == -1)
+            {
+                break;
+            }
+            connection.in.append(buffer, len);
+            if(connection.in.size() > max_request)
+            {
+                close_client(fd);
+                return;
+            }
+        }
+        if(connection.in.find("\r\n\r\n") == std::string::npos)
+        {
+            return;
+        }
+        // na cestě nezáleží, každý GET dostane metriky
+        std::string body;
+        std::string status = "200 OK";
+        if(connection.in.compare(0, 4, "GET ") == 0)
+        {
+            body = render();
+        }
+        else
+        {
+            status = "405 Method Not Allowed";
+        }
+        connection.out = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                         std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+    while(connection.out_pos < connection.out.size())
+    {
+        ssize_t sent = send(fd, connection.out.data() + connection.out_pos, connection.out.size() - connection.out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(sent == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if(sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            engine.modify_watch(fd, EPOLLOUT);
+            return;
+        }
+        if(sent == -1)
+        {
+            break;
+        }
+        connection.out_pos += sent;
+    }
+    close_client(fd);
+}
+
+/**
+    Uzavření spojení klienta
+    @param fd - Socket klienta
+*/
+void DNS_metrics_http::close_client(int fd)
+{
+    engine.unwatch(fd);
+    close(fd);
+    connections.erase(fd);
+}
@@ -0,0 +1,135 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Metriky rezolveru: histogramy latence, čítače a jejich export (Prometheus, JSON)
+*/
+
+#ifndef DNS_METRICS_H
+#define DNS_METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include "dns_engine.h"
+
+/*
+    Čítač s jediným zapisujícím vláknem. Zápis je obyčejné načtení a uložení bez zámku
+    i bez atomické instrukce, jiné vlákno (export) může hodnotu kdykoli číst.
+*/
+class DNS_counter {
+public:
+    DNS_counter() : value(0) {}
+    void add(uint64_t amount = 1) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value;
+};
+
+/*
+    Krátký text (adresa upstream serveru), který zapisující vlákno může přepsat, zatímco
+    export z jiného vlákna čte. Čtení se opakuje, dokud se mezitím nezměnilo pořadové číslo (seqlock).
+*/
+class DNS_label {
+public:
+    static const size_t max_length = 46;   // INET6_ADDRSTRLEN včetně koncové nuly
+
+    DNS_label();
+    void set(const std::string& text);
+    std::string get() const;
+
+private:
+    std::atomic<uint32_t> sequence;
+    std::atomic<char> text[max_length];
+};
+
+/*
+    Histogram ve stylu HDR: hodnoty v mikrosekundách, každá mocnina dvou je rozdělena
+    na sub_buckets lineárních košů (relativní chyba nejvýše 1/8). Zapisuje jedno vlákno.
+*/
+class DNS_histogram {
+public:
+    static const size_t sub_buckets = 8;
+    static const size_t bucket_count = 34 * sub_buckets;
+
+    void record(uint64_t value_us);
+    void collect(std::vector<uint64_t>& counts, uint64_t& sum) const;
+    void reset();
+
+    static size_t bucket_of(uint64_t value_us);
+    static uint64_t bucket_upper(size_t bucket);
+
+private:
+    DNS_counter counts[bucket_count];
+    DNS_counter total_us;
+};
+
+/*
+    Metriky jednoho vlákna (enginu a serveru, který nad ním běží). Víc vláken má každé
+    vlastní instanci a export je sečte.
+*/
+struct DNS_metrics {
+    DNS_histogram latency;
+    DNS_counter queries;
+    DNS_counter cache_hits;
+    DNS_counter cache_misses;
+    DNS_counter timeouts;
+    DNS_counter send_errors;
+    DNS_counter retransmissions;
+    DNS_counter truncations;
+    DNS_counter coalesced;
+    DNS_counter prefetches;
+    DNS_counter stale_answers;
+    DNS_counter rcodes[16];
+    DNS_histogram upstream_rtt[DNS_engine::max_servers];
+    DNS_label upstream_names[DNS_engine::max_servers];
+};
+
+std::string metrics_prometheus(const std::vector<const DNS_metrics*>& metrics);
+std::string metrics_json(const std::vector<const DNS_metrics*>& metrics);
+
+/*
+    Minimální HTTP endpoint pro Prometheus běžící ve smyčce událostí enginu.
+    Na každý požadavek odpoví aktuálním textem z render a spojení uzavře.
+*/
+class DNS_metrics_http {
+public:
+    DNS_metrics_http(DNS_engine& engine, std::function<std::string()> render);
+    ~DNS_metrics_http();
+    DNS_metrics_http(const DNS_metrics_http&) = delete;
+    DNS_metrics_http& operator=(const DNS_metrics_http&) = delete;
+
+    bool listen(const std::string& address, uint16_t port);
+
+    static const size_t max_connections = 64;
+    static const size_t max_request = 8192;
+
+private:
+    /*
+        Spojení klienta: přijatý požadavek a rozepsaná odpověď
+    */
+    struct Connection {
+        std::string in;
+        std::string out;
+        size_t out_pos;
+    };
+
+    DNS_engine& engine;
+    std::function<std::string()> render;
+    int listen_fd;
+    std::unordered_map<int, Connection> connections;
+
+    void accept_client();
+    void handle_client(int fd, uint32_t events);
+    void close_client(int fd);
+};
+
+#endif
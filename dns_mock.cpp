@@ -0,0 +1,810 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Testovací DNS server (mock): odpovídá na loopbacku ze zónového souboru s nastavitelnou
+    latencí, ztrátou a zkracováním odpovědí, testy a zátěžová měření tak nepotřebují síť
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "dns_wire.h"
+#include "dns_rdata.h"
+#include "dns_engine.h"
+
+/*
+    Nastavení mock serveru z příkazové řádky
+*/
+struct Mock_options {
+    std::string address;
+    uint16_t port;
+    std::string zone_file;
+    int delay_ms;
+    int jitter_ms;
+    double loss;       // pravděpodobnost zahození UDP dotazu (0 až 1)
+    bool truncate;     // všechny UDP odpovědi se zkrátí, klient musí přejít na TCP
+    int rcode;         // všechny odpovědi jsou bez záznamů s tímto RCODE (např. 2 = SERVFAIL), -1 = podle zóny
+    unsigned seed;
+};
+
+/*
+    Server nad smyčkou událostí DNS_engine (watch). Odpovědi se neposílají hned, ale řadí se
+    do fronty podle času odeslání (zpoždění + náhodný rozptyl), ztráta se týká jen UDP.
+    Náhoda je ze seedu, takže stejný běh testu zahodí stejné dotazy.
+    NS záznamy u jména bez SOA (mimo kořen) jsou delegace: dotaz na jméno pod nimi dostane
+    odkaz bez AA s NS v authority a glue v additional sectionu.
+*/
+class DNS_mock {
+public:
+    DNS_mock(DNS_engine& engine, const Mock_options& options);
+    ~DNS_mock();
+    DNS_mock(const DNS_mock&) = delete;
+    DNS_mock& operator=(const DNS_mock&) = delete;
+
+    bool load_zone(const std::string& path);
+    bool listen();
+    int next_wait_ms() const;
+    void send_due();
+    void print_stats(std::ostream& out) const;
+
+    static const size_t max_udp_query = 4096;
+    static const uint16_t max_udp_payload = 1232;
+    static const int max_chain = 8;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    /*
+        Odpověď čekající na odeslání (adresa u UDP, číslo spojení u TCP)
+    */
+    struct Reply {
+        clock::time_point due;
+        uint64_t sequence;
+        bool tcp;
+        uint64_t connection;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        std::vector<char> message;
+    };
+
+    struct Later {
+        bool operator()(const Reply& a, const Reply& b) const
+        {
+            return a.due > b.due || (a.due == b.due && a.sequence > b.sequence);
+        }
+    };
+
+    /*
+        TCP spojení klienta
+    */
+    struct Connection {
+        int fd;
+        std::vector<char> in;
+        std::vector<char> out;
+        size_t out_pos;
+    };
+
+    DNS_engine& engine;
+    Mock_options options;
+    std::unordered_map<std::string, std::vector<DNS_Record>> zone;
+    std::priority_queue<Reply, std::vector<Reply>, Later> replies;
+    std::unordered_map<uint64_t, Connection> connections;
+    std::mt19937 random;
+    int udp_fd;
+    int tcp_fd;
+    uint64_t next_connection;
+    uint64_t sequence;
+    uint64_t udp_queries;
+    uint64_t tcp_queries;
+    uint64_t dropped;
+    uint64_t truncated;
+
+    void receive_udp();
+    void accept_tcp();
+    void handle_connection(uint64_t id, uint32_t events);
+    void flush_connection(uint64_t id);
+    void close_connection(uint64_t id);
+    bool build_answer(const char* data, size_t len, bool tcp, std::vector<char>& out);
+    const DNS_Record* find_soa(const std::string& name) const;
+    bool referral(const std::string& name, DNS_Response& response) const;
+    void schedule(Reply& reply);
+};
+
+const size_t DNS_mock::max_udp_query;
+const uint16_t DNS_mock::max_udp_payload;
+const int DNS_mock::max_chain;
+
+/**
+    Převod jména na tvar klíče zóny (malá písmena, bez koncové tečky)
+    @param name - Jméno
+    @return - Klíč
+*/
+static std::string zone_key(std::string name)
+{
+    if(!name.empty() && name.back() == '.')
+    {
+        name.pop_back();
+    }
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    return name;
+}
+
+/**
+    Konstruktor mock serveru, sockety se otevřou až v listen()
+    @param engine - Smyčka událostí
+    @param options - Nastavení
+*/
+DNS_mock::DNS_mock(DNS_engine& engine, const Mock_options& options)
+    : engine(engine), options(options), random(options.seed), udp_fd(-1), tcp_fd(-1), next_connection(1), sequence(0),
+      udp_queries(0), tcp_queries(0), dropped(0), truncated(0)
+{
+}
+
+DNS_mock::~DNS_mock()
+{
+    for(auto& connection : connections)
+    {
+        engine.unwatch(connection.second.fd);
+        close(connection.second.fd);
+    }
+    for(int fd : { udp_fd, tcp_fd })
+    {
+        if(fd != -1)
+        {
+            engine.unwatch(fd);
+            close(fd);
+        }
+    }
+}
+
+/**
+    Načtení zónového souboru, na řádku "jméno typ TTL rdata" (rdata v textové podobě jako ve výpisu
+    programu dns), prázdné řádky a řádky začínající # se přeskočí
+    @param path - Cesta k souboru
+    @return - false pokud soubor nejde otevřít nebo obsahuje neplatný řádek
+*/
+bool DNS_mock::load_zone(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file)
+    {
+        std::cerr << "Zónový soubor " << path << " nelze otevřít." << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t line_number = 0;
+    while(std::getline(file, line))
+    {
+        line_number++;
+        std::istringstream fields(line);
+        std::string name, type;
+        DNS_Record record;
+        if(!(fields >> name) || name[0] == '#')
+        {
+            continue;
+        }
+        fields >> type >> record.ttl;
+        std::getline(fields >> std::ws, record.rdata);
+        record.name = zone_key(name);
+        record.type = parse_type(type);
+        record.dnsclass = 1;
+        const DNS_type* info = find_type(record.type);
+        std::vector<char> rdata;
+        if(!fields.eof() || info == nullptr || !info->encode(record.rdata, rdata))
+        {
+            std::cerr << path << ":" << line_number << ": neplatný záznam." << std::endl;
+            return false;
+        }
+        zone[record.name].push_back(record);
+    }
+    return true;
+}
+
+/**
+    Otevření UDP a TCP socketu a jejich registrace do smyčky událostí
+    @return - false při chybě (neplatná adresa, obsazený port)
+*/
+bool DNS_mock::listen()
+{
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+    struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+    struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&addr);
+    if(inet_pton(AF_INET6, options.address.c_str(), &addr6->sin6_addr) == 1)
+    {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(options.port);
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+    else if(inet_pton(AF_INET, options.address.c_str(), &addr4->sin_addr) == 1)
+    {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(options.port);
+        addr_len = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        std::cerr << "Neplatná adresa pro naslouchání." << std::endl;
+        return false;
+    }
+
+    int one = 1;
+    udp_fd = socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    tcp_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(udp_fd == -1 || tcp_fd == -1)
+    {
+        std::cerr << "Socket serveru se nepodařil vytvořit." << std::endl;
+        return false;
+    }
+    setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // větší buffer, aby zátěžový generátor nenarážel na zahazování v jádře místo na mock
+    int buffer_size = 4 << 20;
+    setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(bind(udp_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+       bind(tcp_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+       ::listen(tcp_fd, 128) == -1)
+    {
+        std::cerr << "Na " << options.address << " port " << options.port << " nelze naslouchat: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(!engine.watch(udp_fd, EPOLLIN, [this](uint32_t) { receive_udp(); }) ||
+       !engine.watch(tcp_fd, EPOLLIN, [this](uint32_t) { accept_tcp(); }))
+    {
+        std::cerr << "Socket serveru se nepodařilo zaregistrovat do epoll." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+    Čas do odeslání nejbližší odložené odpovědi
+    @return - Milisekundy (zaokrouhleno nahoru), -1 pokud nic nečeká
+*/
+int DNS_mock::next_wait_ms() const
+{
+    if(replies.empty())
+    {
+        return -1;
+    }
+    auto remaining = replies.top().due - clock::now();
+    return std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count() + 1);
+}
+
+/**
+    Odeslání všech odpovědí, jejichž čas už nastal
+*/
+void DNS_mock::send_due()
+{
+    clock::time_point now = clock::now();
+    while(!replies.empty() && replies.top().due <= now)
+    {
+        const Reply& reply = replies.top();
+        if(!reply.tcp)
+        {
+            sendto(udp_fd, reply.message.data(), reply.message.size(), 0, reinterpret_cast<const struct sockaddr*>(&reply.addr), reply.addr_len);
+        }
+        else
+        {
+            auto connection = connections.find(reply.connection);
+            if(connection != connections.end())
+            {
+                // spojení mohlo být mezitím zavřeno, pak se odpověď zahodí
+                std::vector<char>& out = connection->second.out;
+                uint16_t length = reply.message.size();
+                out.push_back(static_cast<char>(length >> 8));
+                out.push_back(static_cast<char>(length & 0xFF));
+                out.insert(out.end(), reply.message.begin(), reply.message.end());
+                uint64_t id = reply.connection;
+                replies.pop();
+                flush_connection(id);
+                continue;
+            }
+        }
+        replies.pop();
+    }
+}
+
+/**
+    Výpis počtu dotazů (pro testy, které ověřují, kolik dotazů došlo na server)
+    @param out - Výstupní proud
+*/
+void DNS_mock::print_stats(std::ostream& out) const
+{
+    out << "Dotazy: UDP " << udp_queries << ", TCP " << tcp_queries << ", zahozeno " << dropped << ", zkráceno " << truncated << std::endl;
+}
+
+/**
+    Příjem UDP dotazů, dokud jsou v socketu nějaké
+*/
+void DNS_mock::receive_udp()
+{
+    char buffer[max_udp_query];
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    while(true)
+    {
+        Reply reply;
+        reply.addr_len = sizeof(reply.addr);
+        ssize_t len = recvfrom(udp_fd, buffer, sizeof(buffer), 0, reinterpret_cast<struct sockaddr*>(&reply.addr), &reply.addr_len);
+        if(len < 0)
+        {
+            return;
+        }
+        udp_queries++;
+        if(options.loss > 0 && chance(random) < options.loss)
+        {
+            dropped++;
+            continue;
+        }
+        if(build_answer(buffer, len, false, reply.message))
+        {
+            reply.tcp = false;
+            reply.connection = 0;
+            schedule(reply);
+        }
+    }
+}
+
+/**
+    Přijetí nových TCP spojení
+*/
+void DNS_mock::accept_tcp()
+{
+    while(true)
+    {
+        int fd = accept4(tcp_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+            return;
+        }
+        uint64_t id = next_connection++;
+        if(!engine.watch(fd, EPOLLIN, [this, id](uint32_t events) { handle_connection(id, events); }))
+        {
+            close(fd);
+            continue;
+        }
+        connections[id] = Connection{ fd, {}, {}, 0 };
+    }
+}
+
+/**
+    Čtení dotazů z TCP spojení (zprávy s dvoubajtovou délkou, může jich přijít víc za sebou)
+    @param id - Číslo spojení
+    @param events - Události z epoll
+*/
+void DNS_mock::handle_connection(uint64_t id, uint32_t events)
+{
+    auto it = connections.find(id);
+    if(it == connections.end())
+    {
+        return;
+    }
+    Connection& connection = it->second;
+    if(events & EPOLLOUT)
+    {
+        flush_connection(id);
+        if(connections.find(id) == connections.end())
+        {
+            return;
+        }
+    }
+    if(!(events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+    {
+        return;
+    }
+    char buffer[4096];
+    while(true)
+    {
+        ssize_t len = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if(len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            close_connection(id);
+            return;
+        }
+        if(len < 0)
+        {
+            break;
+        }
+        connection.in.insert(connection.in.end(), buffer, buffer + len);
+    }
+
+    size_t offset = 0;
+    while(connection.in.size() - offset >= 2)
+    {
+        size_t length = read16(connection.in.data() + offset);
+        if(connection.in.size() - offset - 2 < length)
+        {
+            break;
+        }
+        tcp_queries++;
+        Reply reply;
+        if(build_answer(connection.in.data() + offset + 2, length, true, reply.message))
+        {
+            reply.tcp = true;
+            reply.connection = id;
+            reply.addr_len = 0;
+            schedule(reply);
+        }
+        offset += 2 + length;
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + offset);
+}
+
+/**
+    Zápis výstupního bufferu spojení, zbytek se dopíše po události EPOLLOUT
+    @param id - Číslo spojení
+*/
+void DNS_mock::flush_connection(uint64_t id)
+{
+    Connection& connection = connections[id];
+    while(connection.out_pos < connection.out.size())
+    {
+        ssize_t sent = ::send(connection.fd, connection.out.data() + connection.out_pos, connection.out.size() - connection.out_pos, MSG_NOSIGNAL);
+        if(sent < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                engine.modify_watch(connection.fd, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            close_connection(id);
+            return;
+        }
+        connection.out_pos += sent;
+    }
+    connection.out.clear();
+    connection.out_pos = 0;
+    engine.modify_watch(connection.fd, EPOLLIN);
+}
+
+void DNS_mock::close_connection(uint64_t id)
+{
+    auto it = connections.find(id);
+    if(it != connections.end())
+    {
+        engine.unwatch(it->second.fd);
+        close(it->second.fd);
+        connections.erase(it);
+    }
+}
+
+/**
+    Nejbližší SOA nad jménem (pro autoritativní sekci negativních odpovědí)
+    @param name - Klíč jména
+    @return - SOA záznam, nullptr pokud zóna žádný nemá
+*/
+const DNS_Record* DNS_mock::find_soa(const std::string& name) const
+{
+    size_t start = 0;
+    while(true)
+    {
+        auto records = zone.find(name.substr(start));
+        if(records != zone.end())
+        {
+            for(const DNS_Record& record : records->second)
+            {
+                if(record.type == 6)
+                {
+                    return &record;
+                }
+            }
+        }
+        size_t dot = name.find('.', start);
+        if(dot == std::string::npos)
+        {
+            return nullptr;
+        }
+        start = dot + 1;
+    }
+}
+
+/**
+    Odkaz na delegovanou zónu nad jménem (nejvyšší delegace, jako by odpovídal server rodičovské zóny)
+    @param name - Klíč dotazovaného jména
+    @param response - Odpověď, do které se doplní NS a glue a smaže se bit AA
+    @return - true, pokud jméno leží v delegované zóně
+*/
+bool DNS_mock::referral(const std::string& name, DNS_Response& response) const
+{
+    for(size_t dot = name.size(); dot != std::string::npos && dot > 0; )
+    {
+        dot = name.rfind('.', dot - 1);
+        auto records = zone.find((dot == std::string::npos) ? name : name.substr(dot + 1));
+        if(records == zone.end() || std::any_of(records->second.begin(), records->second.end(), [](const DNS_Record& record)
+        {
+            return record.type == 6;
+        }))
+        {
+            continue;
+        }
+        for(const DNS_Record& record : records->second)
+        {
+            if(record.type != 2)
+            {
+                continue;
+            }
+            response.authority.push_back(record);
+            auto glue = zone.find(zone_key(record.rdata));
+            if(glue == zone.end())
+            {
+                continue;
+            }
+            for(const DNS_Record& address : glue->second)
+            {
+                if(address.type == 1 || address.type == 28)
+                {
+                    response.additional.push_back(address);
+                }
+            }
+        }
+        if(!response.authority.empty())
+        {
+            response.flags &= ~0x0400;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    Sestavení odpovědi ze zóny: záznamy hledaného typu (přes CNAME řetězec), jinak NXDOMAIN
+    nebo prázdná odpověď se SOA. Přes UDP se odpověď nad limit klienta (nebo s -tc každá) zkrátí na
+    hlavičku a otázku s bitem TC. S -rcode je každá odpověď bez záznamů s daným RCODE.
+    @param data - Dotaz
+    @param len - Délka dotazu
+    @param tcp - true = dotaz přišel přes TCP
+    @param out - Buffer pro odpověď
+    @return - false pokud dotaz nejde zpracovat (odpověď se neposílá)
+*/
+bool DNS_mock::build_answer(const char* data, size_t len, bool tcp, std::vector<char>& out)
+{
+    DNS_MessageView message;
+    DNS_Response response;
+    if(!parse_message_view(data, len, message) || (message.flags & 0x8000) || message.qdcount != 1 ||
+       !decode_name(data, len, message.question_offset, response.qname))
+    {
+        return false;
+    }
+    response.id = message.id;
+    response.qdcount = 1;
+    response.flags = 0x8000 | 0x0400 | (message.flags & 0x0100) | 0x0080;
+    response.qtype = message.qtype;
+    response.qclass = message.qclass;
+    if(message.edns.present)
+    {
+        response.edns.present = true;
+        response.edns.payload = max_udp_payload;
+    }
+
+    if(options.rcode >= 0)
+    {
+        response.flags = (response.flags & ~0x0400) | options.rcode;
+        encode_response(response, out);
+        return true;
+    }
+
+    std::string name = zone_key(response.qname);
+    bool delegated = referral(name, response);
+    bool found = delegated;
+    for(int hop = 0; hop < max_chain && !delegated; hop++)
+    {
+        auto records = zone.find(name);
+        if(records == zone.end())
+        {
+            break;
+        }
+        found = true;
+        std::string target;
+        for(const DNS_Record& record : records->second)
+        {
+            if(record.type == response.qtype)
+            {
+                response.answers.push_back(record);
+            }
+            else if(record.type == 5)
+            {
+                response.answers.push_back(record);
+                target = zone_key(record.rdata);
+            }
+        }
+        if(target.empty() || response.qtype == 5)
+        {
+            break;
+        }
+        name = target;
+    }
+    if(response.answers.empty() && !delegated)
+    {
+        if(!found)
+        {
+            response.flags |= 3;
+        }
+        const DNS_Record* soa = find_soa(name);
+        if(soa)
+        {
+            response.authority.push_back(*soa);
+        }
+    }
+
+    encode_response(response, out);
+    uint16_t limit = message.edns.present ? std::min<uint16_t>(std::max<uint16_t>(message.edns.payload, 512), max_udp_payload) : 512;
+    if(!tcp && (options.truncate || out.size() > limit))
+    {
+        truncated++;
+        response.flags |= 0x0200;
+        response.answers.clear();
+        response.authority.clear();
+        response.additional.clear();
+        out.clear();
+        encode_response(response, out);
+    }
+    return true;
+}
+
+/**
+    Zařazení odpovědi do fronty podle času odeslání
+    @param reply - Odpověď (zpráva se přesune)
+*/
+void DNS_mock::schedule(Reply& reply)
+{
+    int delay_ms = options.delay_ms;
+    if(options.jitter_ms > 0)
+    {
+        delay_ms += std::uniform_int_distribution<int>(0, options.jitter_ms)(random);
+    }
+    reply.due = clock::now() + std::chrono::milliseconds(delay_ms);
+    reply.sequence = sequence++;
+    replies.push(std::move(reply));
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+static volatile sig_atomic_t stats_requested = 0;
+
+static void on_stop(int)
+{
+    stop_requested = 1;
+}
+
+static void on_stats(int)
+{
+    stats_requested = 1;
+}
+
+/**
+    Načtení číselného argumentu přepínače, při chybě se program ukončí
+    @param argc - Počet argumentů
+    @param argv - Argumenty
+    @param i - Index přepínače, posune se na hodnotu
+    @return - Hodnota
+*/
+static double number_argument(int argc, char* argv[], int& i)
+{
+    if(i + 1 >= argc)
+    {
+        std::cerr << "Argument " << argv[i] << " nemá hodnotu." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    i++;
+    char* end;
+    double value = strtod(argv[i], &end);
+    if(*end != '\0' || value < 0)
+    {
+        std::cerr << "Neplatná hodnota " << argv[i] << "." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(int argc, char* argv[])
+{
+    Mock_options options;
+    options.address = "127.0.0.1";
+    options.port = 5353;
+    options.delay_ms = 0;
+    options.jitter_ms = 0;
+    options.loss = 0;
+    options.truncate = false;
+    options.rcode = -1;
+    options.seed = 1;
+
+    // zpracování argumentů
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-z") == 0 && i + 1 < argc)
+        {
+            options.zone_file = argv[++i];
+        }
+        else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            options.address = argv[++i];
+        }
+        else if(strcmp(argv[i], "-p") == 0)
+        {
+            options.port = static_cast<uint16_t>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-delay") == 0)
+        {
+            options.delay_ms = static_cast<int>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-jitter") == 0)
+        {
+            options.jitter_ms = static_cast<int>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-loss") == 0)
+        {
+            options.loss = number_argument(argc, argv, i) / 100.0;
+        }
+        else if(strcmp(argv[i], "-seed") == 0)
+        {
+            options.seed = static_cast<unsigned>(number_argument(argc, argv, i));
+        }
+        else if(strcmp(argv[i], "-tc") == 0)
+        {
+            options.truncate = true;
+        }
+        else if(strcmp(argv[i], "-rcode") == 0)
+        {
+            options.rcode = static_cast<int>(number_argument(argc, argv, i)) & 0x0F;
+        }
+        else
+        {
+            std::cerr << "Použití: dns_mock -z zóna [-l adresa] [-p port] [-delay ms] [-jitter ms] [-loss procenta] [-seed n] [-tc] [-rcode n]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if(options.zone_file.empty())
+    {
+        std::cerr << "Není zadán zónový soubor (-z)." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    DNS_engine engine;
+    DNS_mock mock(engine, options);
+    if(!mock.load_zone(options.zone_file) || !mock.listen())
+    {
+        return EXIT_FAILURE;
+    }
+
+    // SIGINT/SIGTERM ukončí server, SIGUSR1 vypíše počty dotazů; obě jen nastaví příznak pro smyčku
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    action.sa_handler = on_stats;
+    sigaction(SIGUSR1, &action, nullptr);
+
+    while(!stop_requested)
+    {
+        int wait_ms = mock.next_wait_ms();
+        engine.run_once((wait_ms < 0 || wait_ms > 100) ? 100 : wait_ms);
+        mock.send_due();
+        if(stats_requested)
+        {
+            stats_requested = 0;
+            mock.print_stats(std::cerr);
+        }
+    }
+    mock.print_stats(std::cerr);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_output.h"
+#include "dns_engine.h"
+#include "dns_rdata.h"
+
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+const size_t DNS_output::buffer_limit;
+
+/**
+    Konstruktor výstupu
+    @param out - Proud, do kterého se výstup zapisuje
+*/
+DNS_output::DNS_output(std::ostream& out) : out(out)
+{
+    buffer.reserve(buffer_limit + 4096);
+}
+
+/**
+    Destruktor výstupu, zapíše zbytek bufferu
+*/
+DNS_output::~DNS_output()
+{
+    flush();
+}
+
+/**
+    Zapsání bufferu do proudu a jeho vyprázdnění
+*/
+void DNS_output::flush()
+{
+    if(!buffer.empty())
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    out.flush();
+}
+
+/**
+    Po dokončení výsledku se buffer zapíše, jen pokud přesáhl limit
+*/
+void DNS_output::commit()
+{
+    if(buffer.size() >= buffer_limit)
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+/**
+    Výpis jednoho záznamu ve tvaru "  jméno., TYP, IN, TTL, data"
+    @param record - Záznam
+*/
+void DNS_output_human::record(const DNS_Record& record)
+{
+    buffer += "  ";
+    buffer += record.name;
+    buffer += '.';
+    const DNS_type* info = find_type(record.type);
+    if(info)
+    {
+        buffer += ", ";
+        buffer += info->name;
+    }
+    if(record.dnsclass == 1)
+    {
+        buffer += ", IN";
+    }
+    buffer += ", ";
+    buffer += std::to_string(record.ttl);
+    buffer += ", ";
+    buffer += record.rdata;
+    if(info && info->name_rdata)
+    {
+        buffer += '.';
+    }
+    buffer += '\n';
+}
+
+/**
+    Výpis celé odpovědi (hlavička a všechny sekce)
+    @param name - Dotazovaná adresa, která se vypíše v question sectionu
+    @param response - Zpracovaná odpověď od serveru (nebo z cache)
+*/
+void DNS_output_human::response(const std::string& name, const DNS_Response& response)
+{
+    // zpracování flagů authority, recursive a truncated pro výstup
+    bool aa = response.flags & (1 << 10);
+    bool tc = response.flags & (1 << 9);
+    bool rd = response.flags & (1 << 8);
+    buffer += "Authoritative: ";
+    buffer += aa ? "Yes" : "No";
+    buffer += ", Recursive: ";
+    buffer += rd ? "Yes" : "No";
+    buffer += ", Truncated: ";
+    buffer += tc ? "Yes" : "No";
+    buffer += '\n';
+
+    buffer += "Question section (" + std::to_string(response.qdcount) + ")\n";
+    buffer += "  ";
+    buffer += name;
+    if(name.empty() || name.back() != '.')
+    {
+        buffer += '.';
+    }
+    const char* qtype = type_name(response.qtype);
+    if(qtype)
+    {
+        buffer += ", ";
+        buffer += qtype;
+    }
+    if(response.qclass == 1)
+    {
+        buffer += ", IN";
+    }
+    buffer += '\n';
+
+    const struct { const char* title; const std::vector<DNS_Record>& records; } sections[] = {
+        { "Answer", response.answers }, { "Authority", response.authority }, { "Additional", response.additional }
+    };
+    for(const auto& section : sections)
+    {
+        buffer += section.title;
+        buffer += " section (" + std::to_string(section.records.size()) + ")\n";
+        for(const DNS_Record& r : section.records)
+        {
+            record(r);
+        }
+    }
+    commit();
+}
+
+/**
+    Chybové hlášení jde jako dřív na stderr, výstup odpovědí zůstane čistý
+    @param name - Dotazovaná adresa
+    @param status - Stav dotazu (DNS_status)
+    @param message - Hlášení pro uživatele
+*/
+void DNS_output_human::error(const std::string&, int, const std::string& message)
+{
+    std::cerr << message << '\n';
+}
+
+/**
+    Zápis řetězce jako JSON string (uvozovky, escapování řídicích znaků)
+    @param value - Řetězec
+*/
+void DNS_output_jsonl::string(const std::string& value)
+{
+    buffer += '"';
+    for(unsigned char c : value)
+    {
+        if(c == '"' || c == '\\')
+        {
+            buffer += '\\';
+            buffer += c;
+        }
+        else if(c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            buffer += escaped;
+        }
+        else
+        {
+            buffer += c;
+        }
+    }
+    buffer += '"';
+}
+
+/**
+    Zápis sekce jako pole objektů {"name","type","class","ttl","data"}
+    @param key - Název sekce
+    @param records - Záznamy sekce
+*/
+void DNS_output_jsonl::section(const char* key, const std::vector<DNS_Record>& records)
+{
+    buffer += ",\"";
+    buffer += key;
+    buffer += "\":[";
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        const DNS_Record& record = records[i];
+        buffer += (i == 0) ? "{\"name\":" : ",{\"name\":";
+        string(record.name + ".");
+        buffer += ",\"type\":";
+        const DNS_type* info = find_type(record.type);
+        string(info ? info->name : "TYPE" + std::to_string(record.type));
+        buffer += ",\"class\":";
+        string(record.dnsclass == 1 ? "IN" : "CLASS" + std::to_string(record.dnsclass));
+        buffer += ",\"ttl\":";
+        buffer += std::to_string(record.ttl);
+        buffer += ",\"data\":";
+        string((info && info->name_rdata) ? record.rdata + "." : record.rdata);
+        buffer += '}';
+    }
+    buffer += ']';
+}
+
+/**
+    Odpověď jako jeden řádek JSON
+    @param name - Dotazovaná adresa
+    @param response - Zpracovaná odpověď
+*/
+void DNS_output_jsonl::response(const std::string& name, const DNS_Response& response)
+{
+    buffer += "{\"name\":";
+    string(name);
+    buffer += ",\"qtype\":";
+    const char* type = type_name(response.qtype);
+    string(type ? type : "TYPE" + std::to_string(response.qtype));
+    buffer += ",\"rcode\":";
+    string(rcode_name(response.flags & 0xF));
+    buffer += ",\"aa\":";
+    buffer += (response.flags & (1 << 10)) ? "true" : "false";
+    buffer += ",\"tc\":";
+    buffer += (response.flags & (1 << 9)) ? "true" : "false";
+    buffer += ",\"rd\":";
+    buffer += (response.flags & (1 << 8)) ? "true" : "false";
+    buffer += ",\"ra\":";
+    buffer += (response.flags & (1 << 7)) ? "true" : "false";
+    section("answers", response.answers);
+    section("authority", response.authority);
+    section("additional", response.additional);
+    buffer += "}\n";
+    commit();
+}
+
+/**
+    Chyba jako řádek JSON, aby zpracování výstupu vidělo i nezodpovězené dotazy
+    @param name - Dotazovaná adresa
+    @param status - Stav dotazu (DNS_status)
+    @param message - Hlášení pro uživatele
+*/
+void DNS_output_jsonl::error(const std::string& name, int status, const std::string& message)
+{
+    static const char* names[] = { "ok", "timeout", "send", "server", "name", "format" };
+    buffer += "{\"name\":";
+    string(name);
+    buffer += ",\"error\":";
+    string((status >= 0 && status <= DNS_ERR_FORMAT) ? names[status] : "unknown");
+    buffer += ",\"message\":";
+    string(message);
+    buffer += "}\n";
+    commit();
+}
+
+/**
+    Zápis jednoho binárního záznamu
+    @param status - Stav (0 = odpověď)
+    @param name - Dotazovaná adresa
+    @param message - DNS zpráva, prázdná u chyby
+*/
+void DNS_output_binary::entry(uint8_t status, const std::string& name, const std::vector<char>& message)
+{
+    uint16_t name_length = std::min<size_t>(name.size(), 0xFFFF);
+    uint32_t length = 1 + 2 + name_length + message.size();
+    const unsigned char header[7] = {
+        static_cast<unsigned char>(length >> 24), static_cast<unsigned char>(length >> 16),
+        static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length),
+        status, static_cast<unsigned char>(name_length >> 8), static_cast<unsigned char>(name_length)
+    };
+    buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+    buffer.append(name, 0, name_length);
+    buffer.append(message.data(), message.size());
+    commit();
+}
+
+/**
+    Odpověď jako binární záznam se zprávou v přenosovém tvaru
+    @param name - Dotazovaná adresa
+    @param response - Zpracovaná odpověď
+*/
+void DNS_output_binary::response(const std::string& name, const DNS_Response& response)
+{
+    message.clear();
+    encode_response(response, message);
+    entry(0, name, message);
+}
+
+/**
+    Chyba jako binární záznam bez zprávy
+    @param name - Dotazovaná adresa
+    @param status - Stav dotazu (DNS_status)
+    @param message - Hlášení (do binárního formátu se nezapisuje)
+*/
+void DNS_output_binary::error(const std::string& name, int status, const std::string&)
+{
+    entry(static_cast<uint8_t>(status), name, std::vector<char>());
+}
+
+/**
+    Vytvoření výstupu podle názvu formátu
+    @param format - human, jsonl nebo binary
+    @param out - Proud, do kterého se výstup zapisuje
+    @return - Výstup, nullptr pro neznámý formát
+*/
+std::unique_ptr<DNS_output> make_output(const std::string& format, std::ostream& out)
+{
+    if(format == "human")
+    {
+        return std::unique_ptr<DNS_output>(new DNS_output_human(out));
+    }
+    if(format == "jsonl")
+    {
+        return std::unique_ptr<DNS_output>(new DNS_output_jsonl(out));
+    }
+    if(format == "binary")
+    {
+        return std::unique_ptr<DNS_output>(new DNS_output_binary(out));
+    }
+    return nullptr;
+}
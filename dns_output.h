@@ -0,0 +1,92 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Formáty výstupu výsledků: čitelný text, JSON Lines a binární záznamy s délkou
+*/
+
+#ifndef DNS_OUTPUT_H
+#define DNS_OUTPUT_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <ostream>
+
+#include "dns_wire.h"
+
+/*
+    Výstup výsledků dotazů. Všechny formáty zapisují do vlastního bufferu,
+    který se předá do proudu až po naplnění (nebo při flush), nic se nezapisuje po řádcích.
+*/
+class DNS_output {
+public:
+    explicit DNS_output(std::ostream& out);
+    virtual ~DNS_output();
+    DNS_output(const DNS_output&) = delete;
+    DNS_output& operator=(const DNS_output&) = delete;
+
+    virtual void response(const std::string& name, const DNS_Response& response) = 0;
+    virtual void error(const std::string& name, int status, const std::string& message) = 0;
+    void flush();
+
+    static const size_t buffer_limit = 64 * 1024;
+
+protected:
+    std::string buffer;
+
+    void commit();
+
+private:
+    std::ostream& out;
+};
+
+/*
+    Původní čitelný výpis (hlavička, sekce a záznamy po řádcích), chyby jdou na stderr
+*/
+class DNS_output_human : public DNS_output {
+public:
+    using DNS_output::DNS_output;
+    void response(const std::string& name, const DNS_Response& response) override;
+    void error(const std::string& name, int status, const std::string& message) override;
+
+private:
+    void record(const DNS_Record& record);
+};
+
+/*
+    Jeden JSON objekt na řádek pro každý dotaz, chyby jsou objekty s klíčem "error"
+*/
+class DNS_output_jsonl : public DNS_output {
+public:
+    using DNS_output::DNS_output;
+    void response(const std::string& name, const DNS_Response& response) override;
+    void error(const std::string& name, int status, const std::string& message) override;
+
+private:
+    void string(const std::string& value);
+    void section(const char* key, const std::vector<DNS_Record>& records);
+};
+
+/*
+    Binární záznamy: délka zbytku záznamu (4 B), stav (1 B, 0 = odpověď, jinak DNS_status),
+    délka jména (2 B), jméno a u odpovědi DNS zpráva v přenosovém tvaru (bez komprese).
+    Čísla jsou v síťovém pořadí.
+*/
+class DNS_output_binary : public DNS_output {
+public:
+    using DNS_output::DNS_output;
+    void response(const std::string& name, const DNS_Response& response) override;
+    void error(const std::string& name, int status, const std::string& message) override;
+
+private:
+    std::vector<char> message;
+
+    void entry(uint8_t status, const std::string& name, const std::vector<char>& message);
+};
+
+std::unique_ptr<DNS_output> make_output(const std::string& format, std::ostream& out);
+
+#endif
@@ -0,0 +1,968 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_rdata.h"
+#include "dns_wire.h"
+
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/**
+    Jméno uvnitř rdata, offset se posune za jméno, jméno nesmí začínat za koncem rdata
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset jména, posune se za jméno
+    @param end - Konec rdata
+    @param name - Sem se uloží jméno bez koncové tečky
+    @return - false pokud je jméno poškozené nebo přesahuje rdata
+*/
+static bool rdata_name(const char* data, size_t size, size_t& offset, size_t end, std::string& name)
+{
+    return decode_name(data, size, offset, name) && skip_name(data, size, offset) && offset <= end;
+}
+
+/**
+    Zápis bajtů v textové podobě, netisknutelné znaky jako \DDD, znaky ze special jako \c
+    @param text - Text, na jehož konec se bajty zapíšou
+    @param bytes - Bajty
+    @param length - Počet bajtů
+    @param special - Tisknutelné znaky, které se musí escapovat (zpětné lomítko vždy)
+*/
+static void append_escaped(std::string& text, const char* bytes, size_t length, const char* special)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        unsigned char c = bytes[i];
+        if(c < 0x20 || c > 0x7E)
+        {
+            char escaped[5] = { '\\', static_cast<char>('0' + c / 100), static_cast<char>('0' + c / 10 % 10), static_cast<char>('0' + c % 10), '\0' };
+            text += escaped;
+        }
+        else if(c == '\\' || strchr(special, c))
+        {
+            text += '\\';
+            text += static_cast<char>(c);
+        }
+        else
+        {
+            text += static_cast<char>(c);
+        }
+    }
+}
+
+/**
+    Převod escapovaného textu (\DDD a \c) zpět na bajty, obklopující uvozovky se odstraní
+    @param token - Text
+    @param bytes - Sem se uloží bajty
+    @return - false pro neplatnou escape sekvenci
+*/
+static bool unescape(const std::string& token, std::string& bytes)
+{
+    size_t start = 0;
+    size_t end = token.size();
+    if(end >= 2 && token[0] == '"' && token[end - 1] == '"')
+    {
+        start++;
+        end--;
+    }
+    bytes.clear();
+    for(size_t i = start; i < end; i++)
+    {
+        if(token[i] != '\\')
+        {
+            bytes += token[i];
+            continue;
+        }
+        if(i + 1 >= end)
+        {
+            return false;
+        }
+        if(token[i + 1] >= '0' && token[i + 1] <= '9')
+        {
+            if(i + 3 >= end)
+            {
+                return false;
+            }
+            int value = 0;
+            for(size_t d = i + 1; d <= i + 3; d++)
+            {
+                if(token[d] < '0' || token[d] > '9')
+                {
+                    return false;
+                }
+                value = value * 10 + (token[d] - '0');
+            }
+            if(value > 255)
+            {
+                return false;
+            }
+            bytes += static_cast<char>(value);
+            i += 3;
+        }
+        else
+        {
+            bytes += token[++i];
+        }
+    }
+    return true;
+}
+
+/**
+    Rozdělení textové podoby rdata na slova podle mezer (mezery v uvozovkách a escapované se nedělí)
+    @param text - Textová podoba rdata
+    @param tokens - Sem se uloží slova (uvozovky i escape sekvence zůstanou)
+    @return - false pro neuzavřené uvozovky nebo lomítko na konci
+*/
+static bool split_tokens(const std::string& text, std::vector<std::string>& tokens)
+{
+    size_t i = 0;
+    while(true)
+    {
+        while(i < text.size() && text[i] == ' ')
+        {
+            i++;
+        }
+        if(i >= text.size())
+        {
+            return true;
+        }
+        size_t start = i;
+        bool quoted = false;
+        while(i < text.size() && (quoted || text[i] != ' '))
+        {
+            if(text[i] == '\\')
+            {
+                i++;
+            }
+            else if(text[i] == '"')
+            {
+                quoted = !quoted;
+            }
+            i++;
+        }
+        if(quoted || i > text.size())
+        {
+            return false;
+        }
+        tokens.push_back(text.substr(start, i - start));
+    }
+}
+
+/**
+    Rozdělení hodnoty na položky podle neescapovaných čárek
+    @param value - Hodnota (escape sekvence zůstanou)
+    @return - Položky seznamu
+*/
+static std::vector<std::string> split_list(const std::string& value)
+{
+    std::vector<std::string> items(1);
+    for(size_t i = 0; i < value.size(); i++)
+    {
+        if(value[i] == '\\' && i + 1 < value.size())
+        {
+            items.back() += value[i];
+            items.back() += value[++i];
+        }
+        else if(value[i] == ',')
+        {
+            items.emplace_back();
+        }
+        else
+        {
+            items.back() += value[i];
+        }
+    }
+    return items;
+}
+
+/**
+    Převod desítkového čísla s kontrolou rozsahu
+    @param token - Text čísla
+    @param max - Nejvyšší povolená hodnota
+    @param value - Sem se uloží číslo
+    @return - false pokud text není číslo v rozsahu
+*/
+static bool parse_number(const std::string& token, uint32_t max, uint32_t& value)
+{
+    if(token.empty() || token.size() > 10)
+    {
+        return false;
+    }
+    uint64_t number = 0;
+    for(char c : token)
+    {
+        if(c < '0' || c > '9')
+        {
+            return false;
+        }
+        number = number * 10 + (c - '0');
+    }
+    if(number > max)
+    {
+        return false;
+    }
+    value = static_cast<uint32_t>(number);
+    return true;
+}
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+    Zápis bajtů v kódování base64 (RFC 4648)
+    @param text - Text, na jehož konec se zapíše výsledek
+    @param bytes - Bajty
+    @param length - Počet bajtů
+*/
+static void base64_encode(std::string& text, const unsigned char* bytes, size_t length)
+{
+    for(size_t i = 0; i < length; i += 3)
+    {
+        uint32_t group = bytes[i] << 16;
+        if(i + 1 < length)
+        {
+            group |= bytes[i + 1] << 8;
+        }
+        if(i + 2 < length)
+        {
+            group |= bytes[i + 2];
+        }
+        text += base64_chars[group >> 18 & 0x3F];
+        text += base64_chars[group >> 12 & 0x3F];
+        text += (i + 1 < length) ? base64_chars[group >> 6 & 0x3F] : '=';
+        text += (i + 2 < length) ? base64_chars[group & 0x3F] : '=';
+    }
+}
+
+/**
+    Dekódování textu v base64
+    @param text - Text v base64 (s doplněním '=')
+    @param bytes - Sem se uloží bajty
+    @return - false pro neplatný text
+*/
+static bool base64_decode(const std::string& text, std::string& bytes)
+{
+    if(text.size() % 4 != 0)
+    {
+        return false;
+    }
+    bytes.clear();
+    for(size_t i = 0; i < text.size(); i += 4)
+    {
+        uint32_t group = 0;
+        int padding = 0;
+        for(size_t j = 0; j < 4; j++)
+        {
+            char c = text[i + j];
+            const char* position = (c == '\0') ? nullptr : strchr(base64_chars, c);
+            if(c == '=' && i + 4 == text.size() && j >= 2)
+            {
+                padding++;
+                group <<= 6;
+            }
+            else if(position && padding == 0)
+            {
+                group = group << 6 | static_cast<uint32_t>(position - base64_chars);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        bytes += static_cast<char>(group >> 16);
+        if(padding < 2)
+        {
+            bytes += static_cast<char>(group >> 8 & 0xFF);
+        }
+        if(padding < 1)
+        {
+            bytes += static_cast<char>(group & 0xFF);
+        }
+    }
+    return true;
+}
+
+/**
+    A záznam (RFC 1035): IPv4 adresa
+*/
+static bool decode_a(const char* data, size_t, size_t offset, size_t length, std::string& text)
+{
+    if(length != 4)
+    {
+        return false;
+    }
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, data + offset, address, INET_ADDRSTRLEN);
+    text = address;
+    return true;
+}
+
+static bool encode_a(const std::string& text, std::vector<char>& out)
+{
+    struct in_addr addr;
+    if(inet_pton(AF_INET, text.c_str(), &addr) != 1)
+    {
+        return false;
+    }
+    out.insert(out.end(), reinterpret_cast<char*>(&addr), reinterpret_cast<char*>(&addr) + 4);
+    return true;
+}
+
+/**
+    AAAA záznam (RFC 3596): IPv6 adresa
+*/
+static bool decode_aaaa(const char* data, size_t, size_t offset, size_t length, std::string& text)
+{
+    if(length != 16)
+    {
+        return false;
+    }
+    char address[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, data + offset, address, INET6_ADDRSTRLEN);
+    text = address;
+    return true;
+}
+
+static bool encode_aaaa(const std::string& text, std::vector<char>& out)
+{
+    struct in6_addr addr;
+    if(inet_pton(AF_INET6, text.c_str(), &addr) != 1)
+    {
+        return false;
+    }
+    out.insert(out.end(), reinterpret_cast<char*>(&addr), reinterpret_cast<char*>(&addr) + 16);
+    return true;
+}
+
+/**
+    NS, CNAME a PTR záznamy: jediné jméno (v textu bez koncové tečky)
+*/
+static bool decode_domain(const char* data, size_t size, size_t offset, size_t length, std::string& text)
+{
+    return rdata_name(data, size, offset, offset + length, text);
+}
+
+static bool encode_domain(const std::string& text, std::vector<char>& out)
+{
+    append_name(out, text);
+    return true;
+}
+
+/**
+    SOA záznam: "mname. rname. serial refresh retry expire minimum", za jmény musí být
+    přesně pět 32bitových čísel (kratší nebo delší rdata se odmítnou)
+*/
+static bool decode_soa(const char* data, size_t size, size_t offset, size_t length, std::string& text)
+{
+    size_t end = offset + length;
+    std::string mname, rname;
+    if(!rdata_name(data, size, offset, end, mname) || !rdata_name(data, size, offset, end, rname) || offset + 20 != end)
+    {
+        return false;
+    }
+    text = mname + ". " + rname + ".";
+    for(int i = 0; i < 5; i++)
+    {
+        text += " " + std::to_string(read32(data + offset));
+        offset += 4;
+    }
+    return true;
+}
+
+static bool encode_soa(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    if(!split_tokens(text, fields) || fields.size() != 7)
+    {
+        return false;
+    }
+    append_name(out, fields[0]);
+    append_name(out, fields[1]);
+    for(int i = 2; i < 7; i++)
+    {
+        uint32_t value;
+        if(!parse_number(fields[i], UINT32_MAX, value))
+        {
+            return false;
+        }
+        append32(out, value);
+    }
+    return true;
+}
+
+/**
+    MX záznam (RFC 1035): "preference exchange."
+*/
+static bool decode_mx(const char* data, size_t size, size_t offset, size_t length, std::string& text)
+{
+    size_t end = offset + length;
+    std::string exchange;
+    if(length < 3)
+    {
+        return false;
+    }
+    uint16_t preference = read16(data + offset);
+    offset += 2;
+    if(!rdata_name(data, size, offset, end, exchange))
+    {
+        return false;
+    }
+    text = std::to_string(preference) + " " + exchange + ".";
+    return true;
+}
+
+static bool encode_mx(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    uint32_t preference;
+    if(!split_tokens(text, fields) || fields.size() != 2 || !parse_number(fields[0], 0xFFFF, preference))
+    {
+        return false;
+    }
+    append16(out, preference);
+    append_name(out, fields[1]);
+    return true;
+}
+
+/**
+    TXT záznam (RFC 1035): řetězce v uvozovkách oddělené mezerou
+*/
+static bool decode_txt(const char* data, size_t, size_t offset, size_t length, std::string& text)
+{
+    size_t end = offset + length;
+    text.clear();
+    while(offset < end)
+    {
+        size_t string_length = static_cast<unsigned char>(data[offset]);
+        if(offset + 1 + string_length > end)
+        {
+            return false;
+        }
+        if(!text.empty())
+        {
+            text += ' ';
+        }
+        text += '"';
+        append_escaped(text, data + offset + 1, string_length, "\"");
+        text += '"';
+        offset += 1 + string_length;
+    }
+    return true;
+}
+
+static bool encode_txt(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> strings;
+    if(!split_tokens(text, strings))
+    {
+        return false;
+    }
+    std::string bytes;
+    for(const std::string& token : strings)
+    {
+        if(!unescape(token, bytes) || bytes.size() > 255)
+        {
+            return false;
+        }
+        out.push_back(static_cast<char>(bytes.size()));
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+    return true;
+}
+
+/**
+    SRV záznam (RFC 2782): "priority weight port target."
+*/
+static bool decode_srv(const char* data, size_t size, size_t offset, size_t length, std::string& text)
+{
+    size_t end = offset + length;
+    std::string target;
+    if(length < 7)
+    {
+        return false;
+    }
+    text = std::to_string(read16(data + offset)) + " " + std::to_string(read16(data + offset + 2)) + " " +
+           std::to_string(read16(data + offset + 4));
+    offset += 6;
+    if(!rdata_name(data, size, offset, end, target))
+    {
+        return false;
+    }
+    text += " " + target + ".";
+    return true;
+}
+
+static bool encode_srv(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    if(!split_tokens(text, fields) || fields.size() != 4)
+    {
+        return false;
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        uint32_t value;
+        if(!parse_number(fields[i], 0xFFFF, value))
+        {
+            return false;
+        }
+        append16(out, value);
+    }
+    append_name(out, fields[3]);
+    return true;
+}
+
+/**
+    DS záznam (RFC 4034): "key_tag algorithm digest_type DIGEST" (digest hexadecimálně)
+*/
+static bool decode_ds(const char* data, size_t, size_t offset, size_t length, std::string& text)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    if(length < 4)
+    {
+        return false;
+    }
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data + offset);
+    text = std::to_string(read16(data + offset)) + " " + std::to_string(bytes[2]) + " " + std::to_string(bytes[3]) + " ";
+    for(size_t i = 4; i < length; i++)
+    {
+        text += hex[bytes[i] >> 4];
+        text += hex[bytes[i] & 0xF];
+    }
+    return true;
+}
+
+static bool encode_ds(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    uint32_t key_tag, algorithm, digest_type;
+    if(!split_tokens(text, fields) || fields.size() < 4 || !parse_number(fields[0], 0xFFFF, key_tag) ||
+       !parse_number(fields[1], 0xFF, algorithm) || !parse_number(fields[2], 0xFF, digest_type))
+    {
+        return false;
+    }
+    // digest smí být v prezentačním tvaru rozdělený mezerami
+    std::string digest;
+    for(size_t i = 3; i < fields.size(); i++)
+    {
+        digest += fields[i];
+    }
+    if(digest.size() % 2 != 0)
+    {
+        return false;
+    }
+    append16(out, key_tag);
+    out.push_back(static_cast<char>(algorithm));
+    out.push_back(static_cast<char>(digest_type));
+    for(size_t i = 0; i < digest.size(); i += 2)
+    {
+        char pair[3] = { digest[i], digest[i + 1], '\0' };
+        char* end;
+        unsigned long value = strtoul(pair, &end, 16);
+        if(end != pair + 2 || !isxdigit(static_cast<unsigned char>(pair[0])))
+        {
+            return false;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+    return true;
+}
+
+// názvy klíčů SvcParam (RFC 9460), ostatní klíče se zapisují jako keyN
+static const char* svc_keys[] = { "mandatory", "alpn", "no-default-alpn", "port", "ipv4hint", "ech", "ipv6hint" };
+static const uint16_t svc_key_count = sizeof(svc_keys) / sizeof(svc_keys[0]);
+
+/**
+    Název klíče SvcParam
+    @param key - Číslo klíče
+    @return - Název klíče
+*/
+static std::string svc_key_name(uint16_t key)
+{
+    return key < svc_key_count ? svc_keys[key] : "key" + std::to_string(key);
+}
+
+/**
+    Číslo klíče SvcParam podle názvu
+    @param name - Název klíče (mandatory, alpn, ... nebo keyN)
+    @param key - Sem se uloží číslo klíče
+    @return - false pro neznámý název
+*/
+static bool svc_key_number(const std::string& name, uint16_t& key)
+{
+    for(uint16_t i = 0; i < svc_key_count; i++)
+    {
+        if(name == svc_keys[i])
+        {
+            key = i;
+            return true;
+        }
+    }
+    uint32_t value;
+    if(name.compare(0, 3, "key") == 0 && parse_number(name.substr(3), 65534, value))
+    {
+        key = value;
+        return true;
+    }
+    return false;
+}
+
+/**
+    Zápis hodnoty jednoho SvcParam v textové podobě
+    @param text - Text, na jehož konec se parametr zapíše
+    @param key - Číslo klíče
+    @param value - Hodnota v přenosovém tvaru
+    @param length - Délka hodnoty
+    @return - false pokud hodnota neodpovídá formátu klíče
+*/
+static bool format_svc_param(std::string& text, uint16_t key, const char* value, size_t length)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(value);
+    text += svc_key_name(key);
+    if(key == 2)
+    {
+        return length == 0;
+    }
+    if(length == 0 && key > 6)
+    {
+        return true;
+    }
+    text += '=';
+    if(key == 0)
+    {
+        if(length == 0 || length % 2 != 0)
+        {
+            return false;
+        }
+        for(size_t i = 0; i < length; i += 2)
+        {
+            text += (i ? "," : "") + svc_key_name(read16(value + i));
+        }
+    }
+    else if(key == 1)
+    {
+        for(size_t i = 0; i < length; i += 1 + bytes[i])
+        {
+            if(bytes[i] == 0 || i + 1 + bytes[i] > length)
+            {
+                return false;
+            }
+            if(i)
+            {
+                text += ',';
+            }
+            append_escaped(text, value + i + 1, bytes[i], "\",; ");
+        }
+    }
+    else if(key == 3)
+    {
+        if(length != 2)
+        {
+            return false;
+        }
+        text += std::to_string(read16(value));
+    }
+    else if(key == 4 || key == 6)
+    {
+        size_t address_length = (key == 4) ? 4 : 16;
+        if(length == 0 || length % address_length != 0)
+        {
+            return false;
+        }
+        for(size_t i = 0; i < length; i += address_length)
+        {
+            char address[INET6_ADDRSTRLEN];
+            inet_ntop(key == 4 ? AF_INET : AF_INET6, value + i, address, sizeof(address));
+            text += (i ? "," : "");
+            text += address;
+        }
+    }
+    else if(key == 5)
+    {
+        base64_encode(text, bytes, length);
+    }
+    else
+    {
+        append_escaped(text, value, length, "\",; ");
+    }
+    return true;
+}
+
+/**
+    Převod hodnoty jednoho SvcParam z textu do přenosového tvaru
+    @param key - Číslo klíče
+    @param text - Hodnota v textové podobě (bez "klíč=")
+    @param value - Sem se uloží hodnota
+    @return - false pro neplatnou hodnotu
+*/
+static bool parse_svc_param(uint16_t key, const std::string& text, std::string& value)
+{
+    value.clear();
+    std::string item;
+    if(key == 0 || key == 1 || key == 4 || key == 6)
+    {
+        std::string list = text;
+        if(list.size() >= 2 && list.front() == '"' && list.back() == '"')
+        {
+            list = list.substr(1, list.size() - 2);
+        }
+        for(const std::string& raw : split_list(list))
+        {
+            if(!unescape(raw, item) || item.empty())
+            {
+                return false;
+            }
+            if(key == 0)
+            {
+                uint16_t mandatory;
+                if(!svc_key_number(item, mandatory))
+                {
+                    return false;
+                }
+                value += static_cast<char>(mandatory >> 8);
+                value += static_cast<char>(mandatory & 0xFF);
+            }
+            else if(key == 1)
+            {
+                if(item.size() > 255)
+                {
+                    return false;
+                }
+                value += static_cast<char>(item.size());
+                value += item;
+            }
+            else
+            {
+                unsigned char address[16];
+                if(inet_pton(key == 4 ? AF_INET : AF_INET6, item.c_str(), address) != 1)
+                {
+                    return false;
+                }
+                value.append(reinterpret_cast<char*>(address), key == 4 ? 4 : 16);
+            }
+        }
+        return true;
+    }
+    if(key == 2)
+    {
+        return text.empty();
+    }
+    if(key == 3)
+    {
+        uint32_t port;
+        if(!parse_number(text, 0xFFFF, port))
+        {
+            return false;
+        }
+        value += static_cast<char>(port >> 8);
+        value += static_cast<char>(port & 0xFF);
+        return true;
+    }
+    if(key == 5)
+    {
+        return unescape(text, item) && base64_decode(item, value);
+    }
+    return unescape(text, value);
+}
+
+/**
+    SVCB a HTTPS záznamy (RFC 9460): "priority target. klíč=hodnota ..."
+*/
+static bool decode_svcb(const char* data, size_t size, size_t offset, size_t length, std::string& text)
+{
+    size_t end = offset + length;
+    std::string target;
+    if(length < 3)
+    {
+        return false;
+    }
+    uint16_t priority = read16(data + offset);
+    offset += 2;
+    if(!rdata_name(data, size, offset, end, target))
+    {
+        return false;
+    }
+    text = std::to_string(priority) + " " + target + ".";
+    while(offset < end)
+    {
+        if(offset + 4 > end)
+        {
+            return false;
+        }
+        uint16_t key = read16(data + offset);
+        uint16_t value_length = read16(data + offset + 2);
+        offset += 4;
+        if(offset + value_length > end)
+        {
+            return false;
+        }
+        text += ' ';
+        if(!format_svc_param(text, key, data + offset, value_length))
+        {
+            return false;
+        }
+        offset += value_length;
+    }
+    return true;
+}
+
+static bool encode_svcb(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    uint32_t priority;
+    if(!split_tokens(text, fields) || fields.size() < 2 || !parse_number(fields[0], 0xFFFF, priority))
+    {
+        return false;
+    }
+    append16(out, priority);
+    append_name(out, fields[1]);
+
+    // parametry musí být v přenosovém tvaru seřazené podle klíče a bez opakování
+    std::vector<std::pair<uint16_t, std::string>> params;
+    for(size_t i = 2; i < fields.size(); i++)
+    {
+        size_t equals = fields[i].find('=');
+        std::pair<uint16_t, std::string> param;
+        if(!svc_key_number(fields[i].substr(0, equals), param.first) ||
+           !parse_svc_param(param.first, equals == std::string::npos ? "" : fields[i].substr(equals + 1), param.second) ||
+           param.second.size() > 0xFFFF)
+        {
+            return false;
+        }
+        params.push_back(std::move(param));
+    }
+    std::sort(params.begin(), params.end(), [](const std::pair<uint16_t, std::string>& a, const std::pair<uint16_t, std::string>& b)
+    {
+        return a.first < b.first;
+    });
+    for(size_t i = 0; i < params.size(); i++)
+    {
+        if(i > 0 && params[i].first == params[i - 1].first)
+        {
+            return false;
+        }
+        append16(out, params[i].first);
+        append16(out, params[i].second.size());
+        out.insert(out.end(), params[i].second.begin(), params[i].second.end());
+    }
+    return true;
+}
+
+/**
+    CAA záznam (RFC 8659): "flags tag "value""
+*/
+static bool decode_caa(const char* data, size_t, size_t offset, size_t length, std::string& text)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data + offset);
+    if(length < 2 || bytes[1] == 0 || 2 + static_cast<size_t>(bytes[1]) > length)
+    {
+        return false;
+    }
+    text = std::to_string(bytes[0]) + " ";
+    append_escaped(text, data + offset + 2, bytes[1], "\" ");
+    text += " \"";
+    append_escaped(text, data + offset + 2 + bytes[1], length - 2 - bytes[1], "\"");
+    text += '"';
+    return true;
+}
+
+static bool encode_caa(const std::string& text, std::vector<char>& out)
+{
+    std::vector<std::string> fields;
+    uint32_t flags;
+    std::string tag, value;
+    if(!split_tokens(text, fields) || fields.size() != 3 || !parse_number(fields[0], 0xFF, flags) ||
+       !unescape(fields[1], tag) || tag.empty() || tag.size() > 255 || !unescape(fields[2], value))
+    {
+        return false;
+    }
+    out.push_back(static_cast<char>(flags));
+    out.push_back(static_cast<char>(tag.size()));
+    out.insert(out.end(), tag.begin(), tag.end());
+    out.insert(out.end(), value.begin(), value.end());
+    return true;
+}
+
+// tabulka typů, nové typy stačí přidat sem
+static constexpr DNS_type types[] = {
+    { 1, "A", false, decode_a, encode_a },
+    { 2, "NS", true, decode_domain, encode_domain },
+    { 5, "CNAME", true, decode_domain, encode_domain },
+    { 6, "SOA", false, decode_soa, encode_soa },
+    { 12, "PTR", true, decode_domain, encode_domain },
+    { 15, "MX", false, decode_mx, encode_mx },
+    { 16, "TXT", false, decode_txt, encode_txt },
+    { 28, "AAAA", false, decode_aaaa, encode_aaaa },
+    { 33, "SRV", false, decode_srv, encode_srv },
+    { 43, "DS", false, decode_ds, encode_ds },
+    { 64, "SVCB", false, decode_svcb, encode_svcb },
+    { 65, "HTTPS", false, decode_svcb, encode_svcb },
+    { 257, "CAA", false, decode_caa, encode_caa },
+};
+static constexpr size_t type_count = sizeof(types) / sizeof(types[0]);
+
+/**
+    Sestavení přímého indexu pro typy 0-255 při překladu (index do types + 1, 0 = neznámý typ)
+    @return - Index
+*/
+static constexpr std::array<uint8_t, 256> build_type_index()
+{
+    std::array<uint8_t, 256> index{};
+    for(size_t i = 0; i < type_count; i++)
+    {
+        if(types[i].type < 256)
+        {
+            index[types[i].type] = static_cast<uint8_t>(i + 1);
+        }
+    }
+    return index;
+}
+static constexpr std::array<uint8_t, 256> type_index = build_type_index();
+
+/**
+    Vyhledání typu podle čísla, běžné typy jedním přístupem do indexu
+    @param type - Číselný typ záznamu
+    @return - Popis typu, nullptr pro nepodporovaný typ
+*/
+const DNS_type* find_type(uint16_t type)
+{
+    if(type < 256)
+    {
+        uint8_t position = type_index[type];
+        return position ? &types[position - 1] : nullptr;
+    }
+    for(const DNS_type& info : types)
+    {
+        if(info.type == type)
+        {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+/**
+    Vyhledání typu podle názvu (bez ohledu na velikost písmen)
+    @param name - Název typu
+    @return - Popis typu, nullptr pro nepodporovaný typ
+*/
+const DNS_type* find_type(const std::string& name)
+{
+    for(const DNS_type& info : types)
+    {
+        if(strcasecmp(info.name, name.c_str()) == 0)
+        {
+            return &info;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,33 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Tabulka podporovaných typů záznamů: název, převod rdata do textu a zpět
+*/
+
+#ifndef DNS_RDATA_H
+#define DNS_RDATA_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Popis jednoho typu záznamu. decode převede rdata z odpovědi do textové podoby
+    (data je celá zpráva kvůli komprimovaným jménům), encode zapíše text zpět do
+    přenosového tvaru. Obě vrací false pro poškozená nebo neplatná data.
+*/
+struct DNS_type {
+    uint16_t type;
+    const char* name;
+    bool name_rdata;   // rdata je jediné jméno, ukládá se a vypisuje bez koncové tečky
+    bool (*decode)(const char* data, size_t size, size_t offset, size_t length, std::string& text);
+    bool (*encode)(const std::string& text, std::vector<char>& out);
+};
+
+const DNS_type* find_type(uint16_t type);
+const DNS_type* find_type(const std::string& name);
+
+#endif
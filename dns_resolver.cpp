@@ -0,0 +1,361 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_resolver.h"
+#include "dns_metrics.h"
+
+#include <memory>
+
+const size_t DNS_resolver::default_cache_capacity;
+
+/**
+    Konstruktor rezolveru
+    @param port - Port serverů (upstream i kořenových v iterativním režimu)
+    @param cache_capacity - Počet odpovědí, které se vejdou do cache
+*/
+DNS_resolver::DNS_resolver(uint16_t port, size_t cache_capacity)
+    : iterative_resolver(engine, port), cache(cache_capacity), port(port), iterative(false), recursion(true), caching(true), timeout_ms(5000),
+      metrics(nullptr)
+{
+}
+
+/**
+    Přidání upstream serveru, dotaz se posílá všem serverům a platí nejrychlejší odpověď
+    @param address - Adresa serveru (IPv4 nebo IPv6)
+    @return - Index serveru, -1 při chybě (neplatná adresa, příliš mnoho serverů, socket)
+*/
+int DNS_resolver::add_server(const std::string& address)
+{
+    int server = engine.add_server(address, port);
+    if(server != -1)
+    {
+        servers.push_back(server);
+    }
+    return server;
+}
+
+/**
+    Náhrada vestavěných kořenových serverů pro iterativní režim
+    @param addresses - Adresy kořenových serverů
+*/
+void DNS_resolver::set_root_hints(const std::vector<std::string>& addresses)
+{
+    iterative_resolver.set_root_hints(addresses);
+}
+
+/**
+    Zapnutí iterativního režimu (od kořenových serverů, bez upstream serverů)
+    @param iterative - true = iterativní rezoluce
+*/
+void DNS_resolver::set_iterative(bool iterative)
+{
+    this->iterative = iterative;
+}
+
+/**
+    Nastavení bitu RD v dotazech, odpovědi se ukládají do cache jen u rekurzivních dotazů
+    @param recursion - true = rekurzivní dotazy
+*/
+void DNS_resolver::set_recursion(bool recursion)
+{
+    this->recursion = recursion;
+}
+
+/**
+    Zapnutí cache odpovědí (výchozí zapnuto), bez cache jde každý dotaz na server
+    @param caching - false = cache se nepoužívá (např. při zátěžovém měření serveru)
+*/
+void DNS_resolver::set_caching(bool caching)
+{
+    this->caching = caching;
+}
+
+/**
+    Nastavení přenosu, předává se enginu
+    @param retries - Počet opakování dotazu
+*/
+void DNS_resolver::set_retries(int retries)
+{
+    engine.set_retries(retries);
+}
+
+void DNS_resolver::set_tcp(bool tcp)
+{
+    engine.set_tcp(tcp);
+}
+
+void DNS_resolver::set_edns_payload(uint16_t payload)
+{
+    engine.set_edns_payload(payload);
+}
+
+void DNS_resolver::set_max_in_flight(size_t max)
+{
+    engine.set_max_in_flight(max);
+}
+
+void DNS_resolver::set_coalescing(bool coalescing)
+{
+    engine.set_coalescing(coalescing);
+}
+
+/**
+    Vydávání prošlých odpovědí z cache při nedostupném serveru (RFC 8767)
+    @param window - Jak dlouho po vypršení TTL se odpověď smí vydat (sekundy), 0 = vypnuto
+*/
+void DNS_resolver::set_stale(uint32_t window)
+{
+    cache.set_stale(window);
+}
+
+/**
+    Obnova často používaných odpovědí na pozadí před vypršením TTL
+    @param hits - Počet zásahů, od kterého se odpověď obnovuje, 0 = vypnuto
+*/
+void DNS_resolver::set_prefetch(uint32_t hits)
+{
+    cache.set_prefetch(hits);
+}
+
+/**
+    Nastavení celkového limitu jednoho dotazu (včetně opakování)
+    @param timeout_ms - Limit v milisekundách
+*/
+void DNS_resolver::set_timeout(int timeout_ms)
+{
+    this->timeout_ms = timeout_ms;
+}
+
+/**
+    Nastavení metrik (engine i zásahy do cache), nullptr = bez metrik
+    @param metrics - Metriky, musí žít déle než rezolver
+*/
+void DNS_resolver::set_metrics(DNS_metrics* metrics)
+{
+    this->metrics = metrics;
+    engine.set_metrics(metrics);
+}
+
+/**
+    Načtení cache ze souboru, chybějící nebo poškozený soubor znamená prázdnou cache
+    @param path - Cesta k souboru
+    @return - false pokud se soubor nepodařilo načíst
+*/
+bool DNS_resolver::load_cache(const std::string& path)
+{
+    return cache.load(path);
+}
+
+/**
+    Uložení cache do souboru
+    @param path - Cesta k souboru
+    @return - false pokud se soubor nepodařilo zapsat
+*/
+bool DNS_resolver::save_cache(const std::string& path) const
+{
+    return cache.save(path);
+}
+
+/**
+    Zahájení rezoluce, výsledek přijde do callbacku (z cache hned, jinak z run_once)
+    Odpověď blízko vypršení se vrátí z cache a zároveň se obnoví na pozadí, prošlá odpověď
+    v okně set_stale() se vrátí, jen když server neodpoví včas nebo selže.
+    @param name - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param callback - Funkce (stav DNS_status, zpracovaná odpověď)
+*/
+void DNS_resolver::resolve_async(const std::string& name, uint16_t qtype, DNS_resolve_callback callback)
+{
+    bool cached = caching && (recursion || iterative);
+    if(cached)
+    {
+        DNS_Response response;
+        DNS_cache_state state = cache.lookup(name, qtype, 1, response);
+        if(state == DNS_CACHE_EXPIRED)
+        {
+            refresh_expired(name, qtype, response, callback);
+            return;
+        }
+        if(state != DNS_CACHE_MISS)
+        {
+            if(metrics)
+            {
+                metrics->cache_hits.add();
+                if(state == DNS_CACHE_STALE)
+                {
+                    metrics->stale_answers.add();
+                }
+            }
+            callback(DNS_OK, response);
+            if(state == DNS_CACHE_PREFETCH)
+            {
+                if(metrics)
+                {
+                    metrics->prefetches.add();
+                }
+                fetch(name, qtype, true, [](int, DNS_Response&) {});
+            }
+            return;
+        }
+        if(metrics)
+        {
+            metrics->cache_misses.add();
+        }
+    }
+    fetch(name, qtype, cached, callback);
+}
+
+/**
+    Dotaz na servery (nebo iterativní rezoluce) bez ohledu na cache
+    @param name - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param store - Zda se má odpověď uložit do cache
+    @param callback - Funkce (stav DNS_status, zpracovaná odpověď)
+*/
+void DNS_resolver::fetch(const std::string& name, uint16_t qtype, bool store, DNS_resolve_callback callback)
+{
+    if(iterative)
+    {
+        iterative_resolver.resolve(name, qtype, [this, name, qtype, store, callback](int status, DNS_Response& response)
+        {
+            // odpověď s typem mimo tabulku typů by se do snapshotu zapsala s prázdnými rdata
+            if(status == DNS_OK && store && encodable(response))
+            {
+                cache.store(name, qtype, 1, response);
+            }
+            callback(status, response);
+        });
+        return;
+    }
+    engine.submit(servers, name, qtype, recursion, timeout_ms, [this, name, qtype, store, callback](DNS_result& result)
+    {
+        DNS_Response response;
+        int status = result.status;
+        if(status == DNS_OK && !parse_response(result.response, response))
+        {
+            status = DNS_ERR_FORMAT;
+        }
+        if(status == DNS_OK && store && encodable(response))
+        {
+            cache.store(name, qtype, 1, response, result.response);
+        }
+        callback(status, response);
+    });
+}
+
+/**
+    Obnova prošlé odpovědi (RFC 8767): klient dostane čerstvou odpověď, pokud přijde do
+    DNS_cache::stale_timeout_ms, jinak (nebo při selhání serveru) prošlou s TTL DNS_cache::stale_ttl.
+    Obnova po vydání prošlé odpovědi pokračuje a její výsledek se uloží do cache.
+    @param name - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param stale - Prošlá odpověď z cache
+    @param callback - Funkce (stav DNS_status, zpracovaná odpověď)
+*/
+void DNS_resolver::refresh_expired(const std::string& name, uint16_t qtype, DNS_Response& stale, DNS_resolve_callback callback)
+{
+    std::shared_ptr<DNS_stale_answer> pending = std::make_shared<DNS_stale_answer>();
+    pending->answered = false;
+    pending->response = std::move(stale);
+    auto serve_stale = [this, pending, callback]()
+    {
+        if(pending->answered)
+        {
+            return;
+        }
+        pending->answered = true;
+        if(metrics)
+        {
+            metrics->stale_answers.add();
+        }
+        callback(DNS_OK, pending->response);
+    };
+    engine.defer(DNS_cache::stale_timeout_ms, serve_stale);
+    fetch(name, qtype, true, [pending, callback, serve_stale](int status, DNS_Response& response)
+    {
+        if(status != DNS_OK || server_failure(response.flags))
+        {
+            serve_stale();
+            return;
+        }
+        if(!pending->answered)
+        {
+            pending->answered = true;
+            callback(status, response);
+        }
+    });
+}
+
+/**
+    Rezoluce více typů pro jedno jméno, všechny dotazy jdou najednou a čeká se na všechny
+    @param name - Dotazovaná adresa
+    @param qtypes - Typy dotazů
+    @param responses - Zpracované odpovědi, ve stejném pořadí jako qtypes
+    @return - Stavy dotazů (DNS_OK nebo chyba z DNS_status), ve stejném pořadí jako qtypes
+*/
+std::vector<int> DNS_resolver::resolve(const std::string& name, const std::vector<uint16_t>& qtypes, std::vector<DNS_Response>& responses)
+{
+    std::vector<int> statuses(qtypes.size(), DNS_ERR_TIMEOUT);
+    responses.assign(qtypes.size(), DNS_Response());
+    size_t remaining = qtypes.size();
+    for(size_t i = 0; i < qtypes.size(); i++)
+    {
+        resolve_async(name, qtypes[i], [&statuses, &responses, &remaining, i](int status, DNS_Response& response)
+        {
+            statuses[i] = status;
+            responses[i] = std::move(response);
+            remaining--;
+        });
+    }
+    // obnovy na pozadí (prefetch, prošlé odpovědi) se nečekají, doběhnou při dalších voláních
+    while(remaining > 0)
+    {
+        engine.run_once(-1);
+    }
+    return statuses;
+}
+
+/**
+    Rezoluce jednoho typu
+    @param name - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param response - Zpracovaná odpověď
+    @return - Stav dotazu (DNS_OK nebo chyba z DNS_status)
+*/
+int DNS_resolver::resolve(const std::string& name, uint16_t qtype, DNS_Response& response)
+{
+    std::vector<DNS_Response> responses;
+    int status = resolve(name, std::vector<uint16_t>{ qtype }, responses)[0];
+    response = std::move(responses[0]);
+    return status;
+}
+
+/**
+    Jedna iterace smyčky událostí pro asynchronní dotazy
+    @param max_wait_ms - Nejdelší čekání na událost (-1 = bez limitu)
+*/
+void DNS_resolver::run_once(int max_wait_ms)
+{
+    engine.run_once(max_wait_ms);
+}
+
+/**
+    Běh smyčky událostí, dokud nejsou vyřízeny všechny dotazy
+*/
+void DNS_resolver::run()
+{
+    engine.run();
+}
+
+/**
+    Počet rozpracovaných dotazů (včetně čekajících ve frontě a připojených ke stejnému dotazu)
+    @return - Počet dotazů
+*/
+size_t DNS_resolver::pending() const
+{
+    return engine.pending();
+}
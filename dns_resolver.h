@@ -0,0 +1,78 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Rezolver jako knihovna (libdnsresolver), program dns je jen rozhraní příkazové řádky nad ním
+*/
+
+#ifndef DNS_RESOLVER_H
+#define DNS_RESOLVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dns_wire.h"
+#include "dns_engine.h"
+#include "dns_cache.h"
+#include "dns_iterative.h"
+
+struct DNS_metrics;
+
+/*
+    Rezolver pro vložení do jiných programů. Instance drží engine (sockety, předalokované
+    buffery a časové kolo), iterativní rezolver i cache a používá se opakovaně pro libovolný
+    počet dotazů bez nastavování při každém volání. Chyby se vrací jako DNS_status, proces
+    se nikdy neukončuje. Instance není sdílená mezi vlákny (každé vlákno má vlastní).
+*/
+class DNS_resolver {
+public:
+    explicit DNS_resolver(uint16_t port = 53, size_t cache_capacity = default_cache_capacity);
+    DNS_resolver(const DNS_resolver&) = delete;
+    DNS_resolver& operator=(const DNS_resolver&) = delete;
+
+    int add_server(const std::string& address);
+    void set_root_hints(const std::vector<std::string>& addresses);
+    void set_iterative(bool iterative);
+    void set_recursion(bool recursion);
+    void set_caching(bool caching);
+    void set_retries(int retries);
+    void set_tcp(bool tcp);
+    void set_edns_payload(uint16_t payload);
+    void set_timeout(int timeout_ms);
+    void set_max_in_flight(size_t max);
+    void set_coalescing(bool coalescing);
+    void set_stale(uint32_t window);
+    void set_prefetch(uint32_t hits);
+    void set_metrics(DNS_metrics* metrics);
+    bool load_cache(const std::string& path);
+    bool save_cache(const std::string& path) const;
+
+    int resolve(const std::string& name, uint16_t qtype, DNS_Response& response);
+    std::vector<int> resolve(const std::string& name, const std::vector<uint16_t>& qtypes, std::vector<DNS_Response>& responses);
+    void resolve_async(const std::string& name, uint16_t qtype, DNS_resolve_callback callback);
+    void run_once(int max_wait_ms);
+    void run();
+    size_t pending() const;
+
+    static const size_t default_cache_capacity = 65536;
+
+private:
+    DNS_engine engine;
+    DNS_iterative iterative_resolver;
+    DNS_cache cache;
+    std::vector<int> servers;
+    uint16_t port;
+    bool iterative;
+    bool recursion;
+    bool caching;
+    int timeout_ms;
+    DNS_metrics* metrics;
+
+    void fetch(const std::string& name, uint16_t qtype, bool store, DNS_resolve_callback callback);
+    void refresh_expired(const std::string& name, uint16_t qtype, DNS_Response& stale, DNS_resolve_callback callback);
+};
+
+#endif
@@ -0,0 +1,733 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_server.h"
+#include "dns_rdata.h"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+const size_t DNS_server::max_connections;
+const int DNS_server::upstream_timeout_ms;
+const uint16_t DNS_server::max_udp_payload;
+const size_t DNS_server::io_batch;
+const size_t DNS_server::max_udp_query;
+
+/**
+    Konstruktor serveru
+    @param engine - Engine, v jehož smyčce server běží a přes který posílá dotazy upstream
+    @param cache - Cache odpovědí (může ji sdílet víc serverů v různých vláknech)
+*/
+DNS_server::DNS_server(DNS_engine& engine, DNS_shared_cache& cache)
+    : engine(engine), cache(cache), resolver(nullptr), metrics(nullptr), udp_fd(-1), tcp_fd(-1), next_connection(1),
+      receive_buffers(io_batch, std::vector<char>(max_udp_query)), reply_buffers(io_batch), replies(0), batching(false),
+      query_count(0), hit_count(0)
+{
+}
+
+/**
+    Destruktor serveru, uzavře naslouchající sockety i spojení klientů
+*/
+DNS_server::~DNS_server()
+{
+    while(!connections.empty())
+    {
+        close_connection(connections.begin()->first);
+    }
+    for(int fd : { udp_fd, tcp_fd })
+    {
+        if(fd != -1)
+        {
+            engine.unwatch(fd);
+            close(fd);
+        }
+    }
+}
+
+/**
+    Otevření naslouchajících socketů (UDP i TCP na stejné adrese a portu)
+    @param address - Adresa, na které se naslouchá (IPv4 nebo IPv6)
+    @param port - Port
+    @param reuse_port - Nastavit SO_REUSEPORT, na stejném portu pak naslouchá víc serverů
+                        (jeden na vlákno) a jádro mezi ně rozděluje dotazy i spojení
+    @return - false při chybě (chyba se vypíše)
+*/
+bool DNS_server::listen(const std::string& address, uint16_t port, bool reuse_port)
+{
+    sockaddr_storage addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+    struct sockaddr_in* addr4 = reinterpret_cast<struct sockaddr_in*>(&addr);
+    struct sockaddr_in6* addr6 = reinterpret_cast<struct sockaddr_in6*>(&addr);
+    if(inet_pton(AF_INET6, address.c_str(), &addr6->sin6_addr) == 1)
+    {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+    else if(inet_pton(AF_INET, address.c_str(), &addr4->sin_addr) == 1)
+    {
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        std::cerr << "Neplatná adresa pro naslouchání." << std::endl;
+        return false;
+    }
+
+    int one = 1;
+    udp_fd = socket(addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    tcp_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(udp_fd == -1 || tcp_fd == -1)
+    {
+        std::cerr << "Socket serveru se nepodařil vytvořit." << std::endl;
+        return false;
+    }
+    setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if(reuse_port &&
+       (setsockopt(udp_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1 ||
+        setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1))
+    {
+        std::cerr << "SO_REUSEPORT nelze nastavit: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(bind(udp_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+       bind(tcp_fd, reinterpret_cast<struct sockaddr*>(&addr), addr_len) == -1 ||
+       ::listen(tcp_fd, 128) == -1)
+    {
+        std::cerr << "Na " << address << " port " << port << " nelze naslouchat: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(!engine.watch(udp_fd, EPOLLIN, [this](uint32_t) { receive_udp(); }) ||
+       !engine.watch(tcp_fd, EPOLLIN, [this](uint32_t) { accept_tcp(); }))
+    {
+        std::cerr << "Socket serveru se nepodařilo zaregistrovat do epoll." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+    Nastavení upstream serverů, kterým se přeposílají dotazy mimo cache
+    @param servers - Indexy serverů v enginu (dotaz jde všem, platí nejrychlejší odpověď)
+*/
+void DNS_server::set_upstream(const std::vector<int>& servers)
+{
+    upstream = servers;
+}
+
+/**
+    Nastavení iterativního rezolveru místo přeposílání upstream serverům
+    @param resolver - Rezolver (musí žít déle než server), nullptr = přeposílání
+*/
+void DNS_server::set_resolver(DNS_iterative* resolver)
+{
+    this->resolver = resolver;
+}
+
+/**
+    Nastavení metrik, do kterých server zapisuje zásahy a výpadky cache
+    @param metrics - Metriky vlákna, ve kterém server běží (nullptr = bez metrik)
+*/
+void DNS_server::set_metrics(DNS_metrics* metrics)
+{
+    this->metrics = metrics;
+}
+
+/**
+    Počet přijatých dotazů
+    @return - Počet dotazů
+*/
+uint64_t DNS_server::queries() const
+{
+    return query_count;
+}
+
+/**
+    Počet dotazů zodpovězených z cache
+    @return - Počet dotazů
+*/
+uint64_t DNS_server::cache_hits() const
+{
+    return hit_count;
+}
+
+/**
+    Přečtení všech čekajících UDP dotazů po dávkách (recvmmsg), odpovědi z cache se během
+    zpracování dávky hromadí a odešlou jedním sendmmsg
+*/
+void DNS_server::receive_udp()
+{
+    while(true)
+    {
+        for(size_t i = 0; i < io_batch; i++)
+        {
+            io_vecs[i].iov_base = receive_buffers[i].data();
+            io_vecs[i].iov_len = receive_buffers[i].size();
+            memset(&io_msgs[i], 0, sizeof(struct mmsghdr));
+            io_msgs[i].msg_hdr.msg_name = &io_addrs[i];
+            io_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            io_msgs[i].msg_hdr.msg_iov = &io_vecs[i];
+            io_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(udp_fd, io_msgs, io_batch, MSG_DONTWAIT, nullptr);
+        if(received == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        batching = true;
+        for(int i = 0; i < received; i++)
+        {
+            if(io_msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                continue;
+            }
+            Client client;
+            client.tcp = false;
+            client.connection = 0;
+            client.addr = io_addrs[i];
+            client.addr_len = io_msgs[i].msg_hdr.msg_namelen;
+            handle_query(client, receive_buffers[i].data(), io_msgs[i].msg_len);
+        }
+        batching = false;
+        flush_replies();
+        if(received < static_cast<int>(io_batch))
+        {
+            break;
+        }
+    }
+}
+
+/**
+    Odeslání nahromaděných UDP odpovědí jedním voláním sendmmsg
+*/
+void DNS_server::flush_replies()
+{
+    for(size_t i = 0; i < replies; i++)
+    {
+        reply_vecs[i].iov_base = reply_buffers[i].data();
+        reply_vecs[i].iov_len = reply_buffers[i].size();
+        memset(&reply_msgs[i], 0, sizeof(struct mmsghdr));
+        reply_msgs[i].msg_hdr.msg_name = &reply_addrs[i];
+        reply_msgs[i].msg_hdr.msg_namelen = (reply_addrs[i].ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        reply_msgs[i].msg_hdr.msg_iov = &reply_vecs[i];
+        reply_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t pos = 0;
+    while(pos < replies)
+    {
+        int sent = sendmmsg(udp_fd, reply_msgs + pos, replies - pos, MSG_DONTWAIT);
+        if(sent == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        // odpověď, kterou se nepodařilo odeslat, se zahodí (klient dotaz zopakuje)
+        pos += (sent > 0) ? sent : 1;
+    }
+    replies = 0;
+}
+
+/**
+    Přijetí nových TCP spojení
+*/
+void DNS_server::accept_tcp()
+{
+    while(true)
+    {
+        int fd = accept4(tcp_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if(connections.size() >= max_connections)
+        {
+            close(fd);
+            continue;
+        }
+        uint64_t id = next_connection++;
+        if(!engine.watch(fd, EPOLLIN, [this, id](uint32_t events) { handle_connection(id, events); }))
+        {
+            close(fd);
+            continue;
+        }
+        Connection& connection = connections[id];
+        connection.fd = fd;
+        connection.in.resize(sizeof(uint16_t) + 65535);
+        connection.in_len = 0;
+        connection.out_pos = 0;
+        connection.want_write = false;
+    }
+}
+
+/**
+    Obsloužení události na spojení klienta: čtení dotazů a zápis odpovědí
+    @param id - Číslo spojení
+    @param events - Události z epoll
+*/
+void DNS_server::handle_connection(uint64_t id, uint32_t events)
+{
+    auto it = connections.find(id);
+    if(it == connections.end())
+    {
+        return;
+    }
+    Connection& connection = it->second;
+    if((events & EPOLLOUT) && !flush_connection(connection))
+    {
+        close_connection(id);
+        return;
+    }
+    if(!(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        return;
+    }
+    bool closed = false;
+    while(true)
+    {
+        ssize_t len = recv(connection.fd, connection.in.data() + connection.in_len, connection.in.size() - connection.in_len, MSG_DONTWAIT);
+        if(len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if(len <= 0)
+        {
+            closed = (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+            break;
+        }
+        connection.in_len += len;
+
+        // každý celý dotaz (dvoubajtová délka + zpráva) se zpracuje hned
+        size_t pos = 0;
+        while(connection.in_len - pos >= sizeof(uint16_t))
+        {
+            uint16_t message_len;
+            memcpy(&message_len, connection.in.data() + pos, sizeof(uint16_t));
+            message_len = ntohs(message_len);
+            if(connection.in_len - pos - sizeof(uint16_t) < message_len)
+            {
+                break;
+            }
+            Client client;
+            client.tcp = true;
+            client.connection = id;
+            client.addr_len = 0;
+            handle_query(client, connection.in.data() + pos + sizeof(uint16_t), message_len);
+            pos += sizeof(uint16_t) + message_len;
+        }
+        memmove(connection.in.data(), connection.in.data() + pos, connection.in_len - pos);
+        connection.in_len -= pos;
+    }
+    if(closed)
+    {
+        close_connection(id);
+    }
+}
+
+/**
+    Zapsání čekajících odpovědí do spojení, zbytek počká na EPOLLOUT
+    @param connection - Spojení klienta
+    @return - false při chybě spojení
+*/
+bool DNS_server::flush_connection(Connection& connection)
+{
+    while(connection.out_pos < connection.out.size())
+    {
+        ssize_t sent = ::send(connection.fd, connection.out.data() + connection.out_pos, connection.out.size() - connection.out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(sent == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+            if(!connection.want_write)
+            {
+                engine.modify_watch(connection.fd, EPOLLIN | EPOLLOUT);
+                connection.want_write = true;
+            }
+            return true;
+        }
+        connection.out_pos += sent;
+    }
+    connection.out.clear();
+    connection.out_pos = 0;
+    if(connection.want_write)
+    {
+        engine.modify_watch(connection.fd, EPOLLIN);
+        connection.want_write = false;
+    }
+    return true;
+}
+
+/**
+    Uzavření spojení klienta, odpovědi, které na něj ještě čekají, se zahodí
+    @param id - Číslo spojení
+*/
+void DNS_server::close_connection(uint64_t id)
+{
+    auto it = connections.find(id);
+    if(it == connections.end())
+    {
+        return;
+    }
+    engine.unwatch(it->second.fd);
+    close(it->second.fd);
+    connections.erase(it);
+}
+
+/**
+    Zpracování dotazu klienta: kontrola, odpověď z cache nebo přeposlání
+    @param client - Klient (doplní se ID, otázka a EDNS z dotazu)
+    @param data - Dotaz
+    @param len - Délka dotazu
+*/
+void DNS_server::handle_query(Client& client, const char* data, size_t len)
+{
+    if(len < sizeof(DNS_header))
+    {
+        return;
+    }
+    DNS_MessageView message;
+    bool valid = parse_message_view(data, len, message);
+    uint16_t id;
+    memcpy(&id, data, sizeof(uint16_t));
+    uint16_t flags;
+    memcpy(&flags, data + sizeof(uint16_t), sizeof(uint16_t));
+    flags = ntohs(flags);
+    if(flags & 0x8000)
+    {
+        // odpovědi se ignorují
+        return;
+    }
+    query_count++;
+    client.id = ntohs(id);
+    client.recursion = flags & 0x0100;
+    client.edns = valid && message.edns.present;
+    client.udp_limit = client.edns ? std::min<uint16_t>(std::max<uint16_t>(message.edns.payload, 512), max_udp_payload) : 512;
+    client.qtype = 0;
+    client.qclass = 0;
+    if(!valid || message.qdcount != 1 || !decode_name(data, len, message.question_offset, client.qname))
+    {
+        client.qname.clear();
+        answer_error(client, 1);
+        return;
+    }
+    if(client.qname.empty())
+    {
+        // kořen, prázdné qname znamená dotaz bez otázky
+        client.qname = ".";
+    }
+    client.qtype = message.qtype;
+    client.qclass = message.qclass;
+    if(((flags >> 11) & 0xF) != 0)
+    {
+        answer_error(client, 4);
+        return;
+    }
+    if(client.qclass != 1)
+    {
+        answer_error(client, 5);
+        return;
+    }
+
+    // z cache se vydává zpráva od serveru, jen s upraveným ID, flagy a TTL (nic se nezpracovává)
+    DNS_cache_state state = cache.lookup_wire(client.qname, client.qtype, client.qclass, send_buffer);
+    if(state == DNS_CACHE_EXPIRED)
+    {
+        if(metrics)
+        {
+            metrics->cache_misses.add();
+        }
+        // prošlá odpověď se vydá, pokud server neodpoví včas nebo selže
+        std::shared_ptr<DNS_stale_answer> stale = std::make_shared<DNS_stale_answer>();
+        stale->answered = false;
+        stale->message = send_buffer;
+        engine.defer(DNS_cache::stale_timeout_ms, [this, client, stale]() { answer_stale(client, *stale); });
+        forward(client, stale);
+        return;
+    }
+    if(state != DNS_CACHE_MISS)
+    {
+        hit_count++;
+        if(metrics)
+        {
+            metrics->cache_hits.add();
+            if(state == DNS_CACHE_STALE)
+            {
+                metrics->stale_answers.add();
+            }
+        }
+        answer_cached(client, send_buffer);
+        if(state == DNS_CACHE_PREFETCH)
+        {
+            if(metrics)
+            {
+                metrics->prefetches.add();
+            }
+            // klient už odpověď dostal, obnova jde jen do cache
+            std::shared_ptr<DNS_stale_answer> done = std::make_shared<DNS_stale_answer>();
+            done->answered = true;
+            forward(client, done);
+        }
+        return;
+    }
+    if(metrics)
+    {
+        metrics->cache_misses.add();
+    }
+    forward(client, nullptr);
+}
+
+/**
+    Dotaz mimo cache: přeposlání upstream serverům (nebo iterativní rezoluce), odpověď jde klientovi
+    a do cache
+    @param client - Klient
+    @param stale - Prošlá odpověď pro případ selhání serveru (nullptr = žádná), pokud už byla
+                   vydaná (answered), výsledek dotazu jde jen do cache
+*/
+void DNS_server::forward(const Client& client, std::shared_ptr<DNS_stale_answer> stale)
+{
+    if(resolver != nullptr)
+    {
+        resolver->resolve(client.qname, client.qtype, [this, client, stale](int status, DNS_Response& response)
+        {
+            if(stale && (status != DNS_OK || server_failure(response.flags)))
+            {
+                answer_stale(client, *stale);
+                return;
+            }
+            if(status != DNS_OK)
+            {
+                answer_error(client, 2);
+                return;
+            }
+            if(encodable(response))
+            {
+                cache.store(client.qname, client.qtype, client.qclass, response);
+            }
+            if(stale && stale->answered)
+            {
+                return;
+            }
+            if(stale)
+            {
+                stale->answered = true;
+            }
+            answer(client, response);
+        });
+        return;
+    }
+    engine.submit(upstream, client.qname, client.qtype, true, upstream_timeout_ms, [this, client, stale](DNS_result& result)
+    {
+        if(stale && (result.status != DNS_OK || result.response.size() < sizeof(DNS_header) ||
+                     server_failure(read16(result.response.data() + 2))))
+        {
+            answer_stale(client, *stale);
+            return;
+        }
+        if(result.status != DNS_OK)
+        {
+            answer_error(client, 2);
+            return;
+        }
+        if(stale && stale->answered)
+        {
+            DNS_Response response;
+            if(parse_response(result.response, response) && encodable(response))
+            {
+                cache.store(client.qname, client.qtype, client.qclass, response, result.response);
+            }
+            return;
+        }
+        if(stale)
+        {
+            stale->answered = true;
+        }
+        relay(client, result.response);
+    });
+}
+
+/**
+    Vydání prošlé odpovědi z cache (nejvýše jednou, podruhé se nic nestane)
+    @param client - Klient
+    @param stale - Prošlá odpověď s TTL DNS_cache::stale_ttl
+*/
+void DNS_server::answer_stale(const Client& client, DNS_stale_answer& stale)
+{
+    if(stale.answered)
+    {
+        return;
+    }
+    stale.answered = true;
+    if(metrics)
+    {
+        metrics->stale_answers.add();
+    }
+    answer_cached(client, stale.message);
+}
+
+/**
+    Odeslání odpovědi sestavené ze zpracované odpovědi (z cache nebo z iterativní rezoluce)
+    @param client - Klient
+    @param response - Odpověď, upraví se ID, flagy a EDNS podle klienta; AA, AD, CD a RCODE
+                      zůstanou z odpovědi upstream serveru, QR a RA se nastaví, RD je podle klienta
+                      a TC podle velikosti při odeslání
+*/
+void DNS_server::answer(const Client& client, DNS_Response& response)
+{
+    response.id = client.id;
+    response.flags = (response.flags & ~(0x0200 | 0x0100)) | 0x8000 | (client.recursion ? 0x0100 : 0) | 0x0080;
+    response.qdcount = client.qname.empty() ? 0 : 1;
+    response.qname = client.qname;
+    response.qtype = client.qtype;
+    response.qclass = client.qclass;
+    response.edns = DNS_Edns();
+    if(client.edns)
+    {
+        response.edns.present = true;
+        response.edns.payload = max_udp_payload;
+    }
+    send_buffer.clear();
+    encode_response(response, send_buffer);
+    send(client, send_buffer);
+}
+
+/**
+    Odeslání odpovědi z cache v přenosovém tvaru (bez OPT, TTL už upravené cache)
+    @param client - Klient
+    @param message - Zpráva, upraví se ID a flagy stejně jako v answer() a přidá se OPT podle klienta
+*/
+void DNS_server::answer_cached(const Client& client, std::vector<char>& message)
+{
+    uint16_t id = htons(client.id);
+    memcpy(message.data(), &id, sizeof(uint16_t));
+    message[2] = static_cast<char>((message[2] & ~(0x02 | 0x01)) | 0x80 | (client.recursion ? 0x01 : 0));
+    message[3] = static_cast<char>(message[3] | 0x80);
+    if(client.edns)
+    {
+        append_opt(message, max_udp_payload);
+    }
+    send(client, message);
+}
+
+/**
+    Odeslání chybové odpovědi (jen hlavička a otázka)
+    @param client - Klient
+    @param rcode - Návratový kód (1 = FORMERR, 2 = SERVFAIL, 4 = NOTIMP, 5 = REFUSED)
+*/
+void DNS_server::answer_error(const Client& client, uint16_t rcode)
+{
+    DNS_Response response;
+    response.flags = rcode;
+    answer(client, response);
+}
+
+/**
+    Předání odpovědi upstream serveru klientovi s přepsaným ID, odpověď se zároveň uloží do cache
+    @param client - Klient
+    @param message - Odpověď upstream serveru v přenosovém tvaru
+*/
+void DNS_server::relay(const Client& client, std::vector<char>& message)
+{
+    DNS_Response response;
+    if(!parse_response(message, response))
+    {
+        answer_error(client, 2);
+        return;
+    }
+    if(encodable(response))
+    {
+        cache.store(client.qname, client.qtype, client.qclass, response, message);
+    }
+    // klient bez EDNS nesmí dostat OPT záznam, bývá poslední a odřízne se, jinak se odpověď sestaví znovu
+    if(!client.edns && response.edns.present && !strip_opt(message))
+    {
+        if(encodable(response))
+        {
+            answer(client, response);
+            return;
+        }
+        answer_error(client, 2);
+        return;
+    }
+    uint16_t id = htons(client.id);
+    memcpy(message.data(), &id, sizeof(uint16_t));
+    message[2] = static_cast<char>((message[2] & ~0x01) | (client.recursion ? 0x01 : 0));
+    send(client, message);
+}
+
+/**
+    Odeslání zprávy klientovi, přes UDP se zpráva větší než limit klienta zkrátí na hlavičku s TC
+    @param client - Klient
+    @param message - Zpráva v přenosovém tvaru
+*/
+void DNS_server::send(const Client& client, std::vector<char>& message)
+{
+    if(client.tcp)
+    {
+        auto it = connections.find(client.connection);
+        if(it == connections.end())
+        {
+            return;
+        }
+        Connection& connection = it->second;
+        uint16_t length = htons(message.size());
+        const char* prefix = reinterpret_cast<const char*>(&length);
+        connection.out.insert(connection.out.end(), prefix, prefix + sizeof(uint16_t));
+        connection.out.insert(connection.out.end(), message.begin(), message.end());
+        if(!flush_connection(connection))
+        {
+            // spojení se uzavře při další události, kdy ho nikdo nepoužívá
+            shutdown(connection.fd, SHUT_RDWR);
+        }
+        return;
+    }
+    if(message.size() > client.udp_limit)
+    {
+        size_t offset = sizeof(DNS_header);
+        if(!skip_name(message.data(), message.size(), offset))
+        {
+            return;
+        }
+        message.resize(offset + 4);
+        message[2] |= 0x02;
+        memset(message.data() + 6, 0, 3 * sizeof(uint16_t));
+    }
+    if(batching)
+    {
+        // odpověď během zpracování dávky počká na společný sendmmsg
+        if(replies == io_batch)
+        {
+            flush_replies();
+        }
+        reply_buffers[replies].assign(message.begin(), message.end());
+        reply_addrs[replies] = client.addr;
+        replies++;
+        return;
+    }
+    sendto(udp_fd, message.data(), message.size(), 0, reinterpret_cast<const struct sockaddr*>(&client.addr), client.addr_len);
+}
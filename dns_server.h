@@ -0,0 +1,122 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Režim démona: lokální cachující stub rezolver na UDP a TCP
+*/
+
+#ifndef DNS_SERVER_H
+#define DNS_SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <sys/socket.h>
+
+#include "dns_wire.h"
+#include "dns_engine.h"
+#include "dns_cache.h"
+#include "dns_iterative.h"
+#include "dns_metrics.h"
+
+/*
+    Server přijímá dotazy klientů na UDP i TCP ve stejné smyčce událostí jako DNS_engine
+    (bez vlákna na dotaz). Odpovídá z cache, jinak dotaz přepošle upstream serverům
+    (nebo ho vyřeší iterativně) a odpověď vrátí klientovi s jeho původním ID.
+    Často používané odpovědi blízko vypršení obnovuje na pozadí, prošlé odpovědi z cache
+    vydá, když server selže nebo neodpoví včas (RFC 8767, podle nastavení cache).
+*/
+class DNS_server {
+public:
+    DNS_server(DNS_engine& engine, DNS_shared_cache& cache);
+    ~DNS_server();
+    DNS_server(const DNS_server&) = delete;
+    DNS_server& operator=(const DNS_server&) = delete;
+
+    bool listen(const std::string& address, uint16_t port, bool reuse_port);
+    void set_upstream(const std::vector<int>& servers);
+    void set_resolver(DNS_iterative* resolver);
+    void set_metrics(DNS_metrics* metrics);
+    uint64_t queries() const;
+    uint64_t cache_hits() const;
+
+    static const size_t max_connections = 1024;
+    static const int upstream_timeout_ms = 5000;
+    static const uint16_t max_udp_payload = 1232;
+    static const size_t io_batch = 32;
+    static const size_t max_udp_query = 4096;
+
+private:
+    /*
+        Klient, kterému se má poslat odpověď (adresa u UDP, číslo spojení u TCP)
+    */
+    struct Client {
+        bool tcp;
+        uint64_t connection;
+        sockaddr_storage addr;
+        socklen_t addr_len;
+        uint16_t id;
+        bool recursion;
+        bool edns;
+        uint16_t udp_limit;
+        std::string qname;
+        uint16_t qtype;
+        uint16_t qclass;
+    };
+
+    /*
+        TCP spojení klienta, dotazy můžou chodit za sebou (pipelining)
+    */
+    struct Connection {
+        int fd;
+        std::vector<char> in;
+        size_t in_len;
+        std::vector<char> out;
+        size_t out_pos;
+        bool want_write;
+    };
+
+    DNS_engine& engine;
+    DNS_shared_cache& cache;
+    std::vector<int> upstream;
+    DNS_iterative* resolver;
+    DNS_metrics* metrics;
+    int udp_fd;
+    int tcp_fd;
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t next_connection;
+    std::vector<std::vector<char>> receive_buffers;
+    std::vector<char> send_buffer;
+    std::vector<std::vector<char>> reply_buffers;
+    sockaddr_storage reply_addrs[io_batch];
+    struct mmsghdr reply_msgs[io_batch];
+    struct iovec reply_vecs[io_batch];
+    size_t replies;
+    bool batching;
+    struct mmsghdr io_msgs[io_batch];
+    struct iovec io_vecs[io_batch];
+    sockaddr_storage io_addrs[io_batch];
+    uint64_t query_count;
+    uint64_t hit_count;
+
+    void receive_udp();
+    void flush_replies();
+    void accept_tcp();
+    void handle_connection(uint64_t id, uint32_t events);
+    bool flush_connection(Connection& connection);
+    void close_connection(uint64_t id);
+    void handle_query(Client& client, const char* data, size_t len);
+    void forward(const Client& client, std::shared_ptr<DNS_stale_answer> stale);
+    void answer_stale(const Client& client, DNS_stale_answer& stale);
+    void answer(const Client& client, DNS_Response& response);
+    void answer_cached(const Client& client, std::vector<char>& message);
+    void answer_error(const Client& client, uint16_t rcode);
+    void relay(const Client& client, std::vector<char>& message);
+    void send(const Client& client, std::vector<char>& message);
+};
+
+#endif
@@ -0,0 +1,990 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+*/
+
+#include "dns_wire.h"
+#include "dns_rdata.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+#include <random>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+// nejdelší jméno v přenosovém tvaru včetně koncové nuly (RFC 1035)
+static const size_t max_name_length = 255;
+
+/**
+    Vygenerování náhodného ID dotazu (každé vlákno má vlastní generátor)
+    @return - Náhodné 16bitové ID
+*/
+uint16_t random_id()
+{
+    thread_local std::mt19937 generator{std::random_device{}()};
+    return static_cast<uint16_t>(generator() & 0xFFFF);
+}
+
+/**
+    Konstruktor hlavičky, všechna pole jsou po návratu v síťovém pořadí a dál se nemění
+    @param header - Hlavička pro kterou se mají vyplnit hodnoty
+    @param id - ID dotazu, podle kterého se páruje odpověď
+    @param recursion - Zda se nastaví bit RD (rekurzivní dotaz)
+*/
+void header_constr(DNS_header* header, uint16_t id, bool recursion)
+{
+    header->DNS_ID = htons(id);
+    header->DNS_FLAGS = htons(recursion ? 0b0000000100000000 : 0);
+    header->DNS_QDCOUNT = htons(1);
+    header->DNS_ANCOUNT = htons(0);
+    header->DNS_NSCOUNT = htons(0);
+    header->DNS_ARCOUNT = htons(0);
+}
+
+/**
+    Konstruktor těla otázky
+    @param question - Struktura otázky k vyplnění
+    @param name - Dotazovaný domain name (nebo IPv4/IPv6)
+*/
+void question_constr(DNS_question* question, std::string& name)
+{
+    question->QNAME = name;
+    question->QTYPE = htons(1);
+    question->QCLASS = htons(1);
+}
+
+/**
+    Převedení domain name na tvar vhodný pro DNS otázku, zápis přímo do bufferu volajícího
+    Label musí mít 1 až 63 znaků a celé jméno nejvýše 255 bajtů (RFC 1035),
+    koncová tečka je nepovinná a samotná tečka (nebo prázdné jméno) je kořen.
+    @param address - Převáděná adresa
+    @param out - Buffer, do kterého se jméno zapíše
+    @param capacity - Velikost bufferu
+    @return - Počet zapsaných bajtů, 0 pokud je jméno neplatné nebo se nevejde
+*/
+size_t Convert_question(const std::string& address, char* out, size_t capacity)
+{
+    size_t length = address.size();
+    if(length > 0 && address[length - 1] == '.')
+    {
+        length--; // koncová tečka
+    }
+    // délka v přenosovém tvaru: délka prvního labelu + text + koncová nula
+    size_t wire_length = (length == 0) ? 1 : length + 2;
+    if(wire_length > max_name_length || wire_length > capacity)
+    {
+        return 0;
+    }
+
+    size_t label_start = 0;
+    size_t i = 0;
+    if(length > 0)
+    {
+        for(size_t pos = 0; pos <= length; pos++)
+        {
+            if(pos == length || address[pos] == '.')
+            {
+                size_t label_length = pos - label_start;
+                if(label_length == 0 || label_length > 63)
+                {
+                    return 0;
+                }
+                out[i++] = static_cast<char>(label_length); // zapsání délky segmentu před segment
+                memcpy(out + i, address.data() + label_start, label_length);
+                i += label_length;
+                label_start = pos + 1;
+            }
+        }
+    }
+    out[i++] = '\0'; // přidání nulového bajtu na konec jména
+    return i;
+}
+
+/**
+    Rozšíření IPv6 do její celé formy
+    @param ip - IPv6 adresa k rozšíření
+    @return - Kompletní verze IPv6
+ */
+std::string extend_ipv6(const std::string& ip)
+{
+    std::string expanded;
+    int colonCount = 0;
+    bool doubleColonFound = false;
+
+    // počítání dvoj teček a kontrola použití shorthand notace (:)
+    for (size_t i = 0; i < ip.size(); ++i) {
+        if (ip[i] == ':') {
+            colonCount++;
+            if (i > 0 && ip[i - 1] == ':') {
+                doubleColonFound = true;
+            }
+        }
+    }
+
+    // počítání chybějících hex sekcí
+    int missingSections = 8 - colonCount - 1 + (doubleColonFound ? 1 : 0);
+    size_t lastColon = -1;
+
+    for (size_t i = 0; i < ip.size(); ++i) {
+        if (ip[i] == ':') {
+            if (i == lastColon + 1) {
+                while (missingSections-- > 0) {
+                    expanded += "0000:";
+                }
+            }
+            lastColon = i;
+        } else if (lastColon == i - 1 || i == 0) {
+            size_t nextColon = ip.find(':', i);
+            if (nextColon == std::string::npos) {
+                nextColon = ip.size();
+            }
+
+            std::string section = ip.substr(i, nextColon - i);
+            expanded += std::string(4 - section.size(), '0') + section;
+            i = nextColon - 1;
+
+            if (i < ip.size() - 1) {
+                expanded += ":";
+            }
+        }
+    }
+
+    // jestli adresa končí shorthand notací tak za ní doplnit nuly
+    if (doubleColonFound && lastColon == ip.size() - 1) {
+        while (missingSections-- > 0) {
+            expanded += ":0000";
+        }
+    }
+
+    return expanded;
+}
+
+/**
+    Obrácení IPv4 adresy pro PTR záznam
+    @param ip - Adresa kterou je třeba obrátit
+    @return - Obrácená adresa
+*/
+std::string reverse_address(const std::string& ip)
+{
+    std::string reversed_ip;
+    int len = ip.length();
+    int start = len;
+
+    for(int i = len - 1; i >= -1; i--) 
+    {
+        if(i == -1 || ip[i] == '.') 
+        {
+            if(!reversed_ip.empty()) 
+            {
+                reversed_ip += ".";
+            }
+            reversed_ip += ip.substr(i + 1, start - (i + 1));
+            start = i;
+        }
+    }
+
+    return reversed_ip += ".in-addr.arpa";
+}
+
+/**
+    Obrácení IPv6 adresy pro PTR záznam
+    @param ip - IPv6 adresa kterou je třeba obrátit
+    @return - Obrácená IPv6 adresa
+*/
+std::string reverse_ipv6_address(const std::string& ip)
+{
+    std::string reversed_ip, tmp;
+    tmp = extend_ipv6(ip);
+    int len = tmp.length();
+
+    for(int i = len - 1; i >= 0; i--)
+    {
+        if(tmp[i] != ':')
+        {
+            reversed_ip += tmp[i];
+            reversed_ip += ".";
+        }
+    }
+    return reversed_ip += "ip6.arpa";
+}
+
+/**
+    Jméno pro PTR dotaz (in-addr.arpa nebo ip6.arpa) z binární adresy, zapisuje se přímo
+    do bufferu volajícího po bajtech a nibblech, bez mezilehlých řetězců
+    @param family - AF_INET nebo AF_INET6
+    @param address - Adresa v síťovém pořadí (4 nebo 16 bajtů, např. z inet_pton)
+    @param out - Buffer, do kterého se jméno zapíše (bez koncové tečky a bez nuly)
+    @param capacity - Velikost bufferu (stačí max_arpa_length)
+    @return - Délka jména, 0 pro neznámou rodinu nebo malý buffer
+*/
+size_t arpa_name(int family, const void* address, char* out, size_t capacity)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = static_cast<const unsigned char*>(address);
+    char* writer = out;
+    if(family == AF_INET && capacity >= 4 * 4 + 12)
+    {
+        for(int i = 3; i >= 0; i--)
+        {
+            unsigned char value = bytes[i];
+            if(value >= 100)
+            {
+                *writer++ = '0' + value / 100;
+            }
+            if(value >= 10)
+            {
+                *writer++ = '0' + value / 10 % 10;
+            }
+            *writer++ = '0' + value % 10;
+            *writer++ = '.';
+        }
+        memcpy(writer, "in-addr.arpa", 12);
+        return writer + 12 - out;
+    }
+    if(family == AF_INET6 && capacity >= max_arpa_length)
+    {
+        for(int i = 15; i >= 0; i--)
+        {
+            writer[0] = hex[bytes[i] & 0xF];
+            writer[1] = '.';
+            writer[2] = hex[bytes[i] >> 4];
+            writer[3] = '.';
+            writer += 4;
+        }
+        memcpy(writer, "ip6.arpa", 8);
+        return writer + 8 - out;
+    }
+    return 0;
+}
+
+/**
+    Funkce na výběr verze IP adresy (4/6) a převod na jméno pro PTR dotaz
+    Platná adresa se převede přes inet_pton a arpa_name, jinak se použije původní
+    textový převod (adresy, které inet_pton nepřijme, se obrací tak, jak byly zadány).
+    @param ip - Adresa kterou je třeba obrátit
+    @return - Obrácená adresa
+*/
+std::string get_ip_version(const std::string& ip)
+{
+    unsigned char address[16];
+    char name[max_arpa_length];
+    int family = (ip.find(':') != std::string::npos) ? AF_INET6 : AF_INET;
+    if(inet_pton(family, ip.c_str(), address) == 1)
+    {
+        return std::string(name, arpa_name(family, address, name, sizeof(name)));
+    }
+    if(family == AF_INET6)
+    {
+        return reverse_ipv6_address(ip);
+    }
+    return reverse_address(ip);
+}
+
+/**
+    Sestavení celého dotazu (hlavička, otázka a případně OPT záznam EDNS) do bufferu volajícího
+    Nic se nealokuje, buffer lze používat opakovaně.
+    @param buffer - Buffer, do kterého se dotaz zapíše
+    @param capacity - Velikost bufferu
+    @param header - Hlavička DNS (ARCOUNT se při EDNS nastaví na 1)
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @param qclass - Třída dotazu
+    @param edns_payload - Inzerovaná velikost UDP odpovědi pro EDNS(0), 0 = bez OPT záznamu
+    @return - Délka sestaveného dotazu v bajtech, 0 pokud je jméno neplatné nebo se dotaz nevejde
+*/
+size_t build_query(char* buffer, size_t capacity, const DNS_header& header, const std::string& qname, uint16_t qtype, uint16_t qclass, uint16_t edns_payload)
+{
+    const size_t opt_size = 11;
+    if(capacity < sizeof(DNS_header) + 1 + 2 * sizeof(uint16_t) + (edns_payload ? opt_size : 0))
+    {
+        return 0;
+    }
+    char* current_position = buffer;
+
+    // vložení celé hlavičky a dotazu do bufferu
+    memcpy(current_position, &header, sizeof(DNS_header));
+    if(edns_payload)
+    {
+        uint16_t arcount = htons(1);
+        memcpy(current_position + 10, &arcount, sizeof(uint16_t));
+    }
+    current_position += sizeof(DNS_header);
+    size_t tail = 2 * sizeof(uint16_t) + (edns_payload ? opt_size : 0);
+    size_t name_length = Convert_question(qname, current_position, capacity - sizeof(DNS_header) - tail);
+    if(name_length == 0)
+    {
+        return 0;
+    }
+    current_position += name_length;
+    uint16_t value = htons(qtype);
+    memcpy(current_position, &value, sizeof(uint16_t));
+    current_position += sizeof(uint16_t);
+    value = htons(qclass);
+    memcpy(current_position, &value, sizeof(uint16_t));
+    current_position += sizeof(uint16_t);
+
+    // OPT pseudo-záznam: kořenové jméno, typ 41, třída = velikost payloadu, TTL = 0, bez rdata
+    if(edns_payload)
+    {
+        const char opt[opt_size] = { 0, 0, 41, static_cast<char>(edns_payload >> 8), static_cast<char>(edns_payload & 0xFF), 0, 0, 0, 0, 0, 0 };
+        memcpy(current_position, opt, opt_size);
+        current_position += opt_size;
+    }
+
+    return current_position - buffer;
+}
+
+// nejvyšší počet ukazatelů v jednom jménu
+static const size_t max_name_jumps = 64;
+
+/**
+    Průchod jménem v odpovědi včetně ukazatelů, pro každý label se zavolá funkce label
+    Každý label i ukazatel se kontroluje proti konci odpovědi. Ukazatel smí mířit jen
+    před sebe (dopředné a samy na sebe mířící ukazatele se odmítnou) a každý ukazatel
+    se smí projít jen jednou (smyčka ukazatelů se odmítne hned, ne až po limitu skoků);
+    navíc je omezen počet skoků a celková délka jména na 255 bajtů.
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset začátku jména
+    @param end - Sem se uloží offset za jménem na původním místě (může být nullptr)
+    @param label - Funkce (ukazatel na label, délka), vrací false pro ukončení průchodu
+    @return - false pokud je jméno poškozené
+*/
+template<typename Label>
+static inline bool walk_name(const char* data, size_t size, size_t offset, size_t* end, Label&& label)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t jumps = 0;
+    size_t visited[max_name_jumps];
+    size_t name_length = 1; // koncová nula
+    bool jumped = false;
+    while(true)
+    {
+        if(offset >= size)
+        {
+            return false;
+        }
+        uint8_t length = bytes[offset];
+        if(length == 0)
+        {
+            if(!jumped && end)
+            {
+                *end = offset + 1;
+            }
+            return true;
+        }
+        if(length < 64)
+        {
+            name_length += length + 1;
+            if(name_length > max_name_length || offset + 1 + length > size)
+            {
+                return false;
+            }
+            if(!label(data + offset + 1, length))
+            {
+                return true;
+            }
+            offset += length + 1;
+            continue;
+        }
+        // 0x40 a 0x80 jsou rezervované typy labelů
+        if((length & 0xC0) != 0xC0 || offset + 1 >= size || jumps >= max_name_jumps)
+        {
+            return false;
+        }
+        size_t target = (length & 0x3F) << 8 | bytes[offset + 1];
+        if(target >= offset || std::find(visited, visited + jumps, offset) != visited + jumps)
+        {
+            return false;
+        }
+        visited[jumps++] = offset;
+        if(!jumped && end)
+        {
+            *end = offset + 2;
+        }
+        jumped = true;
+        offset = target;
+    }
+}
+
+/**
+    Přeskočení jména bez jeho dekódování
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset jména, posune se za jméno
+    @return - false pokud je jméno poškozené
+*/
+bool skip_name(const char* data, size_t size, size_t& offset)
+{
+    return walk_name(data, size, offset, &offset, [](const char*, uint8_t) { return true; });
+}
+
+/**
+    Dekódování jména až ve chvíli, kdy je opravdu potřeba (např. při výpisu)
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset jména
+    @param name - Sem se uloží jméno s labely oddělenými tečkou (bez koncové tečky)
+    @return - false pokud je jméno poškozené
+*/
+bool decode_name(const char* data, size_t size, size_t offset, std::string& name)
+{
+    name.clear();
+    return walk_name(data, size, offset, nullptr, [&name](const char* label, uint8_t length)
+    {
+        if(!name.empty())
+        {
+            name += '.';
+        }
+        name.append(label, length);
+        return true;
+    });
+}
+
+/**
+    Funkce na zpracování ukazatelů v DNS odpovědi
+    @param reader - Aktuální pozice buffer v odpovědi, posune se za jméno
+    (u poškozeného jména na konec bufferu)
+    @param buffer - Buffer s celou odpovědí
+    @return - Zpracovaný domain name, prázdný u poškozeného jména
+*/
+std::string read_domain_name(char*& reader, const std::vector<char>& buffer)
+{
+    std::string domainName;
+    size_t offset = reader - buffer.data();
+    bool valid = walk_name(buffer.data(), buffer.size(), offset, &offset, [&domainName](const char* label, uint8_t length)
+    {
+        if(!domainName.empty())
+        {
+            domainName += '.';
+        }
+        domainName.append(label, length);
+        return true;
+    });
+    if(!valid)
+    {
+        domainName.clear();
+        offset = buffer.size();
+    }
+    reader = const_cast<char*>(buffer.data()) + offset;
+    return domainName;
+}
+
+/**
+    Porovnání jména v odpovědi s textovým jménem bez dekódování a alokace
+    Velikost písmen se nerozlišuje, koncová tečka je nepovinná, kořen je "." nebo "".
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset jména
+    @param name - Textové jméno
+    @return - true pokud jsou jména stejná
+*/
+bool name_equals(const char* data, size_t size, size_t offset, const std::string& name)
+{
+    size_t name_size = (name == ".") ? 0 : name.size();
+    size_t pos = 0;
+    bool equal = true;
+    bool valid = walk_name(data, size, offset, nullptr, [&](const char* label, uint8_t length)
+    {
+        if(pos + length > name_size || (pos + length < name_size && name[pos + length] != '.') ||
+           strncasecmp(label, name.data() + pos, length) != 0)
+        {
+            equal = false;
+            return false;
+        }
+        pos += length + 1;
+        return true;
+    });
+    return valid && equal && pos >= name_size;
+}
+
+/**
+    Přečtení jednoho záznamu jako pohledu (jen offsety, nic se nekopíruje)
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param offset - Offset záznamu, posune se za záznam
+    @param view - Pohled na záznam
+    @return - false pokud je záznam poškozený nebo přesahuje odpověď
+*/
+bool read_record_view(const char* data, size_t size, size_t& offset, DNS_RecordView& view)
+{
+    view.name_offset = offset;
+    if(!skip_name(data, size, offset) || offset + 10 > size)
+    {
+        return false;
+    }
+    view.type = read16(data + offset);
+    view.dnsclass = read16(data + offset + 2);
+    view.ttl = read32(data + offset + 4);
+    view.rdata_length = read16(data + offset + 8);
+    offset += 10;
+    view.rdata_offset = offset;
+    if(offset + view.rdata_length > size)
+    {
+        return false;
+    }
+    offset += view.rdata_length;
+    return true;
+}
+
+/**
+    Zpracování celé odpovědi do pohledů, pole pohledů se při opakovaném volání znovu použijí
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param message - Pohled na odpověď
+    @return - false pokud je odpověď poškozená
+*/
+bool parse_message_view(const char* data, size_t size, DNS_MessageView& message)
+{
+    message.data = data;
+    message.size = size;
+    message.answers.clear();
+    message.authority.clear();
+    message.additional.clear();
+    if(size < sizeof(DNS_header) || size > 0xFFFF)
+    {
+        return false;
+    }
+    message.id = read16(data);
+    message.flags = read16(data + 2);
+    message.qdcount = read16(data + 4);
+    message.question_offset = sizeof(DNS_header);
+    message.qtype = 0;
+    message.qclass = 0;
+    message.edns = DNS_Edns();
+
+    size_t offset = sizeof(DNS_header);
+    for(int q = 0; q < message.qdcount; q++)
+    {
+        size_t name_offset = offset;
+        if(!skip_name(data, size, offset) || offset + 4 > size)
+        {
+            return false;
+        }
+        // uloží se jen první otázka
+        if(q == 0)
+        {
+            message.question_offset = name_offset;
+            message.qtype = read16(data + offset);
+            message.qclass = read16(data + offset + 2);
+        }
+        offset += 4;
+    }
+
+    std::vector<DNS_RecordView>* sections[3] = { &message.answers, &message.authority, &message.additional };
+    uint16_t counts[3] = { read16(data + 6), read16(data + 8), read16(data + 10) };
+    for(int s = 0; s < 3; s++)
+    {
+        for(int r = 0; r < counts[s]; r++)
+        {
+            DNS_RecordView view;
+            if(!read_record_view(data, size, offset, view))
+            {
+                return false;
+            }
+            // OPT v additional sectionu nese EDNS(0): třída = velikost payloadu, TTL = rozšířený rcode, verze a flagy
+            if(s == 2 && view.type == 41)
+            {
+                if(message.edns.present || data[view.name_offset] != 0)
+                {
+                    return false;
+                }
+                message.edns.present = true;
+                message.edns.payload = view.dnsclass;
+                message.edns.ext_rcode = view.ttl >> 24;
+                message.edns.version = (view.ttl >> 16) & 0xFF;
+                message.edns.flags = view.ttl & 0xFFFF;
+                continue;
+            }
+            sections[s]->push_back(view);
+        }
+    }
+    return true;
+}
+
+/**
+    Rdata záznamu jako surové bajty (bez kopírování)
+    @param data - Začátek odpovědi
+    @param view - Pohled na záznam
+    @return - Bajty rdata
+*/
+std::string_view rdata_bytes(const char* data, const DNS_RecordView& view)
+{
+    return std::string_view(data + view.rdata_offset, view.rdata_length);
+}
+
+/**
+    Převod rdata záznamu do textové podoby pro výstup
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param view - Pohled na záznam
+    @return - Textová podoba rdata, prázdná u nepodporovaných typů
+*/
+std::string format_rdata(const char* data, size_t size, const DNS_RecordView& view)
+{
+    std::string rdata;
+    const DNS_type* info = find_type(view.type);
+    if(info && !info->decode(data, size, view.rdata_offset, view.rdata_length, rdata))
+    {
+        rdata.clear();
+    }
+    return rdata;
+}
+
+/**
+    Převod pohledu na záznam do struktury DNS_Record pro výpis a cache
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param view - Pohled na záznam
+    @return - Struktura DNS_Record s dekódovaným jménem a textovými rdata
+*/
+DNS_Record make_record(const char* data, size_t size, const DNS_RecordView& view)
+{
+    DNS_Record record;
+    decode_name(data, size, view.name_offset, record.name);
+    record.type = view.type;
+    record.dnsclass = view.dnsclass;
+    record.ttl = view.ttl;
+    record.rdata = format_rdata(data, size, view);
+    return record;
+}
+
+/**
+    Funkce na zpracování odpovědi na výstup
+    @param reader - Aktuální místo v bufferu, posune se za záznam (u poškozeného záznamu na konec bufferu)
+    @param buffer - Celý buffer z odpovědí
+    @param record - Struktura DNS_Record s hodnotami, které se mají vypsat na výstup
+    @return - false pokud je záznam poškozený nebo přesahuje odpověď
+*/
+bool parseDNS_Record(char*& reader, const std::vector<char>& buffer, DNS_Record& record)
+{
+    size_t offset = reader - buffer.data();
+    DNS_RecordView view;
+    if(!read_record_view(buffer.data(), buffer.size(), offset, view))
+    {
+        reader = const_cast<char*>(buffer.data()) + buffer.size();
+        record = DNS_Record();
+        return false;
+    }
+    reader = const_cast<char*>(buffer.data()) + offset;
+    record = make_record(buffer.data(), buffer.size(), view);
+    return true;
+}
+
+/**
+    Kontrola, zda odpověď patří k danému dotazu (ID a otázka), bez alokace
+    @param data - Začátek odpovědi
+    @param size - Velikost odpovědi
+    @param id - ID dotazu
+    @param qname - Dotazovaná adresa
+    @param qtype - Typ dotazu
+    @return - true pokud odpověď odpovídá dotazu
+*/
+bool response_matches(const char* data, size_t size, uint16_t id, const std::string& qname, uint16_t qtype)
+{
+    if(size < sizeof(DNS_header) + 5)
+    {
+        return false;
+    }
+    if(read16(data) != id || !(read16(data + 2) & (1 << 15)) || read16(data + 4) < 1)
+    {
+        return false;
+    }
+    size_t offset = sizeof(DNS_header);
+    if(!name_equals(data, size, offset, qname) || !skip_name(data, size, offset) || offset + 4 > size)
+    {
+        return false;
+    }
+    return read16(data + offset) == qtype;
+}
+
+/**
+    Převedení názvu typu záznamu ze vstupního souboru na číselný typ
+    @param type - Název typu (A, AAAA, PTR, MX, TXT, ...), číslo nebo TYPEn (RFC 3597)
+    @return - Číselný typ záznamu, 0 pokud typ není platný
+*/
+uint16_t parse_type(const std::string& type)
+{
+    const DNS_type* info = find_type(type);
+    if(info)
+    {
+        return info->type;
+    }
+    size_t start = (strncasecmp(type.c_str(), "TYPE", 4) == 0) ? 4 : 0;
+    if(type.size() <= start || type.size() - start > 5 || type.find_first_not_of("0123456789", start) != std::string::npos)
+    {
+        return 0;
+    }
+    unsigned long number = strtoul(type.c_str() + start, nullptr, 10);
+    // OPT a meta typy (AXFR, IXFR, ...) nejsou běžné dotazy
+    if(number == 0 || number == 41 || number > 0xFFFF || (number >= 251 && number <= 254))
+    {
+        return 0;
+    }
+    return static_cast<uint16_t>(number);
+}
+
+/**
+    Název typu záznamu pro výpis
+    @param type - Číselný typ záznamu
+    @return - Název typu, nullptr pokud typ nemá název
+*/
+const char* type_name(uint16_t type)
+{
+    const DNS_type* info = find_type(type);
+    return info ? info->name : nullptr;
+}
+
+/**
+    Název návratového kódu odpovědi
+    @param rcode - Návratový kód (0-15)
+    @return - Název kódu (NOERROR, NXDOMAIN, ...)
+*/
+const char* rcode_name(uint16_t rcode)
+{
+    static const char* names[16] = {
+        "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET",
+        "NXRRSET", "NOTAUTH", "NOTZONE", "DSOTYPENI", "RCODE12", "RCODE13", "RCODE14", "RCODE15"
+    };
+    return names[rcode & 0xF];
+}
+
+/**
+    TTL negativní odpovědi podle SOA v authority sectionu, MINIMUM se čte přímo z rdata
+    SOA se bere v úvahu jen tehdy, když za oběma jmény následuje přesně 20 bajtů čísel.
+    @param message - Pohled na odpověď
+    @return - Menší z TTL záznamu a pole MINIMUM prvního platného SOA, 0 pokud žádné není
+*/
+static uint32_t negative_ttl(const DNS_MessageView& message)
+{
+    for(const DNS_RecordView& view : message.authority)
+    {
+        if(view.type != 6)
+        {
+            continue;
+        }
+        size_t offset = view.rdata_offset;
+        size_t end = offset + view.rdata_length;
+        if(skip_name(message.data, message.size, offset) && offset <= end &&
+           skip_name(message.data, message.size, offset) && offset + 20 == end)
+        {
+            return std::min(view.ttl, read32(message.data + offset + 16));
+        }
+    }
+    return 0;
+}
+
+/**
+    Zpracování celé odpovědi do struktury DNS_Response
+    @param buffer - Buffer s celou odpovědí
+    @param response - Struktura, do které se odpověď uloží
+    @return - false pokud odpověď není kompletní
+*/
+bool parse_response(const std::vector<char>& buffer, DNS_Response& response)
+{
+    DNS_MessageView message;
+    if(!parse_message_view(buffer.data(), buffer.size(), message))
+    {
+        return false;
+    }
+    response.id = message.id;
+    response.flags = message.flags;
+    response.qdcount = message.qdcount;
+    response.qname.clear();
+    response.qtype = message.qtype;
+    response.qclass = message.qclass;
+    response.edns = message.edns;
+    response.negative_ttl = negative_ttl(message);
+    if(message.qdcount > 0)
+    {
+        decode_name(message.data, message.size, message.question_offset, response.qname);
+    }
+
+    const std::vector<DNS_RecordView>* views[3] = { &message.answers, &message.authority, &message.additional };
+    std::vector<DNS_Record>* sections[3] = { &response.answers, &response.authority, &response.additional };
+    for(int s = 0; s < 3; s++)
+    {
+        sections[s]->clear();
+        sections[s]->reserve(views[s]->size());
+        for(const DNS_RecordView& view : *views[s])
+        {
+            sections[s]->push_back(make_record(message.data, message.size, view));
+        }
+    }
+    return true;
+}
+
+/**
+    Zápis domain name v nekomprimovaném tvaru (délka labelu + label) na konec bufferu
+    @param out - Buffer, do kterého se jméno zapíše
+    @param name - Domain name (tečka na konci je nepovinná)
+*/
+void append_name(std::vector<char>& out, const std::string& name)
+{
+    size_t start = out.size();
+    out.resize(start + max_name_length);
+    size_t length = Convert_question(name, out.data() + start, max_name_length);
+    if(length == 0)
+    {
+        // neplatné jméno se zapíše jako kořen
+        out[start] = '\0';
+        length = 1;
+    }
+    out.resize(start + length);
+}
+
+/**
+    Zápis záznamu zpět do tvaru pro přenos (bez komprese jmen)
+    Rdata se skládají z textové podoby, u nepodporovaných typů zůstanou prázdná.
+    @param out - Buffer, do kterého se záznam zapíše
+    @param record - Zapisovaný záznam
+*/
+void encode_record(std::vector<char>& out, const DNS_Record& record)
+{
+    append_name(out, record.name);
+    append16(out, record.type);
+    append16(out, record.dnsclass);
+    append32(out, record.ttl);
+    size_t length_pos = out.size();
+    append16(out, 0);
+
+    const DNS_type* info = find_type(record.type);
+    if(info && !info->encode(record.rdata, out))
+    {
+        out.resize(length_pos + 2);
+    }
+
+    uint16_t length = out.size() - length_pos - 2;
+    out[length_pos] = static_cast<char>(length >> 8);
+    out[length_pos + 1] = static_cast<char>(length & 0xFF);
+}
+
+/**
+    Odstranění OPT záznamu ze zprávy v přenosovém tvaru, ARCOUNT se sníží
+    @param message - Zpráva
+    @return - true, pokud zpráva OPT nemá nebo byl odstraněn; false u poškozené zprávy
+              nebo když za OPT následují další záznamy (zkrácení by rozbilo komprimovaná jména)
+*/
+bool strip_opt(std::vector<char>& message)
+{
+    if(message.size() < sizeof(DNS_header))
+    {
+        return false;
+    }
+    const char* data = message.data();
+    size_t offset = sizeof(DNS_header);
+    for(uint16_t q = 0; q < read16(data + 4); q++)
+    {
+        if(!skip_name(data, message.size(), offset) || offset + 4 > message.size())
+        {
+            return false;
+        }
+        offset += 4;
+    }
+    size_t records = read16(data + 6) + read16(data + 8) + read16(data + 10);
+    size_t opt_offset = 0;
+    for(size_t r = 0; r < records; r++)
+    {
+        DNS_RecordView view;
+        size_t start = offset;
+        if(!read_record_view(data, message.size(), offset, view))
+        {
+            return false;
+        }
+        if(view.type == 41)
+        {
+            if(r + 1 != records)
+            {
+                return false;
+            }
+            opt_offset = start;
+        }
+    }
+    if(opt_offset == 0)
+    {
+        return true;
+    }
+    uint16_t arcount = read16(data + 10) - 1;
+    message.resize(opt_offset);
+    message[10] = static_cast<char>(arcount >> 8);
+    message[11] = static_cast<char>(arcount & 0xFF);
+    return true;
+}
+
+/**
+    Připojení OPT záznamu (EDNS(0)) na konec zprávy bez OPT, ARCOUNT se zvýší
+    @param message - Zpráva
+    @param payload - Inzerovaná velikost UDP payloadu
+*/
+void append_opt(std::vector<char>& message, uint16_t payload)
+{
+    uint16_t arcount = read16(message.data() + 10) + 1;
+    message[10] = static_cast<char>(arcount >> 8);
+    message[11] = static_cast<char>(arcount & 0xFF);
+    message.push_back(0);
+    append16(message, 41);
+    append16(message, payload);
+    append32(message, 0);
+    append16(message, 0);
+}
+
+/**
+    Zda lze zpracovanou odpověď znovu sestavit (rdata se ukládají v textové podobě)
+    @param response - Zpracovaná odpověď
+    @return - true, pokud jsou všechny typy záznamů v tabulce typů (umí je zapsat encode_record)
+*/
+bool encodable(const DNS_Response& response)
+{
+    for(const std::vector<DNS_Record>* section : { &response.answers, &response.authority, &response.additional })
+    {
+        for(const DNS_Record& record : *section)
+        {
+            if(!find_type(record.type))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+    Zápis celé zpracované odpovědi zpět do tvaru DNS zprávy
+    Otázka se zapíše, pokud má odpověď qdcount > 0, prázdné qname i "." je kořen.
+    @param response - Zpracovaná odpověď
+    @param out - Buffer, do kterého se zpráva zapíše
+*/
+void encode_response(const DNS_Response& response, std::vector<char>& out)
+{
+    append16(out, response.id);
+    append16(out, response.flags);
+    append16(out, response.qdcount > 0 ? 1 : 0);
+    append16(out, response.answers.size());
+    append16(out, response.authority.size());
+    append16(out, response.additional.size() + (response.edns.present ? 1 : 0));
+    if(response.qdcount > 0)
+    {
+        append_name(out, response.qname);
+        append16(out, response.qtype);
+        append16(out, response.qclass);
+    }
+    for(const std::vector<DNS_Record>* section : { &response.answers, &response.authority, &response.additional })
+    {
+        for(const DNS_Record& record : *section)
+        {
+            encode_record(out, record);
+        }
+    }
+    if(response.edns.present)
+    {
+        out.push_back('\0');
+        append16(out, 41);
+        append16(out, response.edns.payload);
+        append32(out, static_cast<uint32_t>(response.edns.ext_rcode) << 24 | static_cast<uint32_t>(response.edns.version) << 16 | response.edns.flags);
+        append16(out, 0);
+    }
+}
@@ -0,0 +1,174 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Struktury DNS zprávy a funkce pro sestavení dotazu a zpracování odpovědi
+*/
+
+#ifndef DNS_WIRE_H
+#define DNS_WIRE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// nejdelší jméno pro PTR dotaz (32 nibblů IPv6 s tečkami a "ip6.arpa")
+const size_t max_arpa_length = 16 * 4 + 8;
+
+/*
+    Hlavička DNS
+*/
+struct DNS_header {
+    uint16_t DNS_ID;
+    uint16_t DNS_FLAGS;
+    uint16_t DNS_QDCOUNT;
+    uint16_t DNS_ANCOUNT;
+    uint16_t DNS_NSCOUNT;
+    uint16_t DNS_ARCOUNT;
+};
+
+/*
+    Tělo otázky DNS
+*/
+struct DNS_question {
+    std::string QNAME;
+    uint16_t QTYPE;
+    uint16_t QCLASS;
+};
+
+/*
+    Struktura pro uložení hodnot na výstup
+*/
+struct DNS_Record {
+    std::string name;
+    uint16_t type;
+    uint16_t dnsclass;
+    uint32_t ttl;
+    std::string rdata;
+};
+/*
+    Údaje z OPT pseudo-záznamu EDNS(0) (RFC 6891), OPT se nepočítá do additional sectionu
+*/
+struct DNS_Edns {
+    bool present = false;
+    uint16_t payload = 0;
+    uint8_t ext_rcode = 0;
+    uint8_t version = 0;
+    uint16_t flags = 0;
+};
+
+/*
+    Zpracovaná odpověď (hlavička, první otázka a všechny sekce)
+*/
+struct DNS_Response {
+    uint16_t id;
+    uint16_t flags;
+    uint16_t qdcount;
+    std::string qname;
+    uint16_t qtype;
+    uint16_t qclass;
+    std::vector<DNS_Record> answers;
+    std::vector<DNS_Record> authority;
+    std::vector<DNS_Record> additional;
+    DNS_Edns edns;
+    uint32_t negative_ttl = 0;   // menší z TTL a pole MINIMUM prvního platného SOA v authority (RFC 2308), 0 = bez SOA
+};
+/*
+    Pohled na záznam v bufferu odpovědi, drží jen offsety (nic se nekopíruje)
+*/
+struct DNS_RecordView {
+    uint16_t name_offset;
+    uint16_t type;
+    uint16_t dnsclass;
+    uint32_t ttl;
+    uint16_t rdata_offset;
+    uint16_t rdata_length;
+};
+
+/*
+    Pohled na celou odpověď, buffer musí žít déle než pohled
+*/
+struct DNS_MessageView {
+    const char* data;
+    size_t size;
+    uint16_t id;
+    uint16_t flags;
+    uint16_t qdcount;
+    uint16_t question_offset;
+    uint16_t qtype;
+    uint16_t qclass;
+    std::vector<DNS_RecordView> answers;
+    std::vector<DNS_RecordView> authority;
+    std::vector<DNS_RecordView> additional;
+    DNS_Edns edns;
+};
+
+/**
+    Čtení 16bitové a 32bitové hodnoty v síťovém pořadí z bufferu
+    @param data - Ukazatel na první bajt hodnoty
+    @return - Hodnota v pořadí hostitele
+*/
+inline uint16_t read16(const char* data)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+inline uint32_t read32(const char* data)
+{
+    return static_cast<uint32_t>(read16(data)) << 16 | read16(data + 2);
+}
+
+/**
+    Zápis 16bitové a 32bitové hodnoty v síťovém pořadí na konec bufferu
+    @param out - Buffer
+    @param value - Zapisovaná hodnota
+*/
+inline void append16(std::vector<char>& out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value & 0xFF));
+}
+
+inline void append32(std::vector<char>& out, uint32_t value)
+{
+    append16(out, value >> 16);
+    append16(out, value & 0xFFFF);
+}
+
+uint16_t random_id();
+void header_constr(DNS_header* header, uint16_t id, bool recursion = true);
+void question_constr(DNS_question* question, std::string& name);
+size_t Convert_question(const std::string& address, char* out, size_t capacity);
+std::string extend_ipv6(const std::string& ip);
+std::string reverse_address(const std::string& ip);
+std::string reverse_ipv6_address(const std::string& ip);
+std::string get_ip_version(const std::string& ip);
+size_t arpa_name(int family, const void* address, char* out, size_t capacity);
+size_t build_query(char* buffer, size_t capacity, const DNS_header& header, const std::string& qname, uint16_t qtype, uint16_t qclass, uint16_t edns_payload);
+std::string read_domain_name(char*& reader, const std::vector<char>& buffer);
+bool skip_name(const char* data, size_t size, size_t& offset);
+bool decode_name(const char* data, size_t size, size_t offset, std::string& name);
+bool name_equals(const char* data, size_t size, size_t offset, const std::string& name);
+bool read_record_view(const char* data, size_t size, size_t& offset, DNS_RecordView& view);
+bool parse_message_view(const char* data, size_t size, DNS_MessageView& message);
+std::string_view rdata_bytes(const char* data, const DNS_RecordView& view);
+std::string format_rdata(const char* data, size_t size, const DNS_RecordView& view);
+DNS_Record make_record(const char* data, size_t size, const DNS_RecordView& view);
+bool parseDNS_Record(char*& reader, const std::vector<char>& buffer, DNS_Record& record);
+bool response_matches(const char* data, size_t size, uint16_t id, const std::string& qname, uint16_t qtype);
+uint16_t parse_type(const std::string& type);
+const char* type_name(uint16_t type);
+const char* rcode_name(uint16_t rcode);
+bool parse_response(const std::vector<char>& buffer, DNS_Response& response);
+void append_name(std::vector<char>& out, const std::string& name);
+void encode_record(std::vector<char>& out, const DNS_Record& record);
+void encode_response(const DNS_Response& response, std::vector<char>& out);
+bool encodable(const DNS_Response& response);
+bool strip_opt(std::vector<char>& message);
+void append_opt(std::vector<char>& message, uint16_t payload);
+
+#endif
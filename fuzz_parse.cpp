@@ -0,0 +1,180 @@
+/*
+    Projekt: DNS rezolver
+    Autor: David Zahálka
+    Login: xzahal03
+    Datum: 20.11.2023
+
+    Fuzz harness pro zpracování odpovědí (parseDNS_Record a spol.)
+    S libFuzzerem: make fuzz, spuštění ./fuzz_parse [korpus]
+    Bez libFuzzeru: make fuzz-standalone, spuštění ./fuzz_parse_standalone [-runs=N] [soubory]
+    (vlastní mutační smyčka nad zadanými soubory nebo vestavěnou ukázkovou odpovědí)
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <arpa/inet.h>
+
+#include "dns_wire.h"
+
+/**
+    Jeden vstup fuzzeru: zpracování bufferu všemi cestami parseru
+    @param data - Vstupní data
+    @param size - Velikost vstupu
+    @return - Vždy 0
+*/
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    std::vector<char> buffer(reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data) + size);
+
+    // původní rozhraní: otázky přes read_domain_name, záznamy přes parseDNS_Record
+    if(buffer.size() >= sizeof(DNS_header))
+    {
+        DNS_header header;
+        memcpy(&header, buffer.data(), sizeof(DNS_header));
+        const char* end = buffer.data() + buffer.size();
+        char* reader = buffer.data() + sizeof(DNS_header);
+        for(int q = 0; q < ntohs(header.DNS_QDCOUNT) && reader + 4 <= end; q++)
+        {
+            read_domain_name(reader, buffer);
+            reader += 4;
+        }
+        int records = ntohs(header.DNS_ANCOUNT) + ntohs(header.DNS_NSCOUNT) + ntohs(header.DNS_ARCOUNT);
+        DNS_Record record;
+        for(int r = 0; r < records && reader < end; r++)
+        {
+            if(!parseDNS_Record(reader, buffer, record))
+            {
+                break;
+            }
+        }
+    }
+
+    // pohledy a převod do DNS_Response
+    DNS_MessageView message;
+    if(parse_message_view(buffer.data(), buffer.size(), message))
+    {
+        for(const std::vector<DNS_RecordView>* section : { &message.answers, &message.authority, &message.additional })
+        {
+            for(const DNS_RecordView& view : *section)
+            {
+                std::string name;
+                decode_name(buffer.data(), buffer.size(), view.name_offset, name);
+                name_equals(buffer.data(), buffer.size(), view.name_offset, name);
+                format_rdata(buffer.data(), buffer.size(), view);
+
+                // textová podoba rdata se musí dát bezpečně zapsat zpět (cache démona)
+                std::vector<char> encoded;
+                encode_record(encoded, make_record(buffer.data(), buffer.size(), view));
+            }
+        }
+    }
+    DNS_Response response;
+    parse_response(buffer, response);
+    response_matches(buffer.data(), buffer.size(), 70, "www.fit.vut.cz", 1);
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <cstdlib>
+
+/**
+    Vestavěná ukázková odpověď (A záznam s ukazatelem na otázku, SOA a OPT záznam EDNS)
+    @return - Buffer s odpovědí
+*/
+static std::vector<char> sample_response()
+{
+    const unsigned char sample[] = {
+        0x00, 0x46, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x01,
+        0x03, 'w', 'w', 'w', 0x03, 'f', 'i', 't', 0x03, 'v', 'u', 't', 0x02, 'c', 'z', 0x00,
+        0x00, 0x01, 0x00, 0x01,
+        0xC0, 0x0C, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x0E, 0x10, 0x00, 0x02, 0xC0, 0x10,
+        0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x38, 0x40, 0x00, 0x04, 0x93, 0xE5, 0x09, 0x1A,
+        0xC0, 0x14, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3C, 0x00, 0x1B,
+        0x02, 'n', 's', 0xC0, 0x14, 0xC0, 0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x1E,
+        0x00, 0x00, 0x29, 0x04, 0xD0, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00
+    };
+    return std::vector<char>(sample, sample + sizeof(sample));
+}
+
+/**
+    Náhodná úprava vstupu (překlopení bitů, přepis bajtů, ukazatele, zkrácení)
+    @param input - Upravovaný vstup
+    @param generator - Generátor náhodných čísel
+*/
+static void mutate(std::vector<char>& input, std::mt19937& generator)
+{
+    int changes = 1 + generator() % 4;
+    for(int i = 0; i < changes && !input.empty(); i++)
+    {
+        size_t pos = generator() % input.size();
+        switch(generator() % 5)
+        {
+            case 0: input[pos] ^= static_cast<char>(1 << (generator() % 8));
+            break;
+            case 1: input[pos] = static_cast<char>(generator());
+            break;
+            case 2:
+                // ukazatel na náhodné místo
+                input[pos] = static_cast<char>(0xC0 | (generator() % 4));
+                if(pos + 1 < input.size())
+                {
+                    input[pos + 1] = static_cast<char>(generator());
+                }
+            break;
+            case 3: input.resize(pos);
+            break;
+            case 4: input.insert(input.begin() + pos, static_cast<char>(generator() % 64));
+            break;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long runs = 1000000;
+    std::vector<std::vector<char>> corpus;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "-runs=", 6) == 0)
+        {
+            runs = atol(argv[i] + 6);
+            continue;
+        }
+        std::ifstream file(argv[i], std::ios::binary);
+        if(!file)
+        {
+            std::cerr << "Soubor " << argv[i] << " nelze otevřít." << std::endl;
+            return EXIT_FAILURE;
+        }
+        corpus.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if(corpus.empty())
+    {
+        corpus.push_back(sample_response());
+    }
+
+    // vstupy z korpusu beze změny, pak deterministická mutační smyčka
+    for(const std::vector<char>& input : corpus)
+    {
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    }
+    std::mt19937 generator(12345);
+    for(long run = 0; run < runs; run++)
+    {
+        std::vector<char> input = corpus[generator() % corpus.size()];
+        mutate(input, generator);
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    }
+    std::cout << "Provedeno " << runs << " běhů bez chyby." << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,193 @@
+# Offline testy proti lokálnímu testovacímu serveru dns_mock (bez přístupu k síti)
+# Spuštění: make test-offline, při chybě končí nenulovým kódem
+
+PORT=${MOCK_PORT:-5454}
+failures=0
+
+start_mock()
+{
+    ./dns_mock -z test_zone.txt -p $PORT "$@" 2> mock_stats.txt &
+    mock_pid=$!
+    sleep 0.3
+}
+
+stop_mock()
+{
+    kill $mock_pid
+    wait $mock_pid 2> /dev/null
+}
+
+check()
+{
+    if [[ "$2" == "$3" ]]; then
+        echo "$1: Výstup je správně."
+    else
+        echo "$1: Výstup se liší:"
+        echo "Očekávaný: $2"
+        echo "Dostáno: $3"
+        failures=$((failures + 1))
+    fi
+}
+
+start_mock
+
+output=$(./dns -s 127.0.0.1 -p $PORT www.fit.vut.cz -r)
+check "Test 1: A záznam" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Question section (1)
+  www.fit.vut.cz., A, IN
+Answer section (1)
+  www.fit.vut.cz., A, IN, 14400, 147.229.9.26
+Authority section (0)
+Additional section (0)" "$output"
+
+output=$(./dns -s 127.0.0.1 -p $PORT 147.229.9.26 -x -r)
+check "Test 2: PTR záznam" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Question section (1)
+  26.9.229.147.in-addr.arpa., PTR, IN
+Answer section (1)
+  26.9.229.147.in-addr.arpa., PTR, IN, 14400, www.fit.vut.cz.
+Authority section (0)
+Additional section (0)" "$output"
+
+output=$(./dns -s 127.0.0.1 -p $PORT alias.test -6 -r)
+check "Test 3: CNAME a AAAA" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Question section (1)
+  alias.test., AAAA, IN
+Answer section (2)
+  alias.test., CNAME, IN, 60, www.fit.vut.cz.
+  www.fit.vut.cz., AAAA, IN, 14400, 2001:67c:1220:809::93e5:91a
+Authority section (0)
+Additional section (0)" "$output"
+
+output=$(./dns -s 127.0.0.1 -p $PORT nope.test -r)
+check "Test 4: NXDOMAIN se SOA" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Question section (1)
+  nope.test., A, IN
+Answer section (0)
+Authority section (1)
+  test., SOA, IN, 3600, ns.test. admin.test. 1 7200 3600 1209600 30
+Additional section (0)" "$output"
+
+# jméno serveru se zjistí přes -b (místo 1.1.1.1) od stejného mock serveru
+output=$(./dns -s ns.test -b 127.0.0.1 -p $PORT mx.test -t MX -r -o jsonl | grep -c '"MX"')
+check "Test 5: server zadaný jménem přes -b" "1" "$output"
+
+# 60 záznamů se nevejde do UDP odpovědi, dotaz se zopakuje přes TCP
+output=$(./dns -s 127.0.0.1 -p $PORT big.test -r | grep -c "big.test., A, IN, 60")
+check "Test 6: zkrácená odpověď a TCP" "60" "$output"
+
+output=$(printf 'h1.test\nh2.test A,AAAA\nh1.test\n' | ./dns -s 127.0.0.1 -p $PORT -f - -r -o jsonl | wc -l)
+check "Test 7: dávkový režim" "4" "$output"
+
+./dns_load -s 127.0.0.1 -p $PORT -n 2000 -q 2000 h1.test h2.test h3.test > load.txt
+check "Test 8: zátěžový generátor" "Odpovědi: 2000, chyby: 0 (timeout 0, odeslání 0, poškozené 0)" "$(grep '^Odpovědi' load.txt)"
+cat load.txt
+stop_mock
+
+# zpoždění 50 ms, ztráta 30 % a zkracování všech UDP odpovědí, dotazy se opakují a přejdou na TCP
+start_mock -delay 50 -loss 30 -tc -seed 7
+output=$(printf 'h1.test\nh2.test\nh3.test\nh4.test\nh5.test\nh6.test\nh7.test\nh8.test\n' | ./dns -s 127.0.0.1 -p $PORT -f - -r -n 4 | grep -c "A, IN, 60")
+check "Test 9: ztráta, zpoždění a zkracování" "8" "$output"
+stop_mock
+cat mock_stats.txt
+
+# 400 dotazů na 8 jmen během jednoho RTT, na server smí jít jen 8 (ostatní se připojí k rozpracovaným)
+start_mock -delay 100
+output=$(for i in $(seq 50); do printf 'h1.test\nh2.test\nh3.test\nh4.test\nh5.test\nh6.test\nh7.test\nh8.test\n'; done | ./dns -s 127.0.0.1 -p $PORT -f - -r -o jsonl | wc -l)
+stop_mock
+check "Test 10: slučování stejných dotazů" "400 Dotazy: UDP 8, TCP 0" "$output $(cut -d, -f1,2 mock_stats.txt)"
+
+# prošlá odpověď z perzistentní cache (TTL 2 s) se při nedostupném serveru vydá s TTL 30 (RFC 8767)
+start_mock
+./dns -s 127.0.0.1 -p $PORT -c stale_cache.bin -stale 60 short.test -r > /dev/null
+sleep 2.5
+stop_mock
+output=$(./dns -s 127.0.0.1 -p $PORT -c stale_cache.bin -stale 60 short.test -r | grep "A, IN,")
+check "Test 11: prošlá odpověď při nedostupném serveru" "  short.test., A, IN, 30, 10.3.0.1" "$output"
+
+# dotaz na kořen: jméno "." se musí shodovat s kořenem v odpovědi
+start_mock
+output=$(./dns -s 127.0.0.1 -p $PORT . -t NS -r)
+stop_mock
+check "Test 12: dotaz na kořen" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Question section (1)
+  ., NS, IN
+Answer section (1)
+  ., NS, IN, 3600, ns.test.
+Authority section (0)
+Additional section (0)" "$output"
+
+# dotaz na dva servery: jeden vrátí SERVFAIL, druhý neodpoví, výsledkem je SERVFAIL (ne timeout)
+start_mock -rcode 2
+./dns_mock -z test_zone.txt -l 127.0.0.2 -p $PORT -loss 100 2> /dev/null &
+silent_pid=$!
+sleep 0.3
+output=$(./dns -s 127.0.0.1 -s 127.0.0.2 -p $PORT h1.test -r -n 0 -o jsonl | grep -o '"rcode":"[A-Z]*"')
+kill $silent_pid
+wait $silent_pid 2> /dev/null
+stop_mock
+check "Test 13: SERVFAIL z prohraného závodu" '"rcode":"SERVFAIL"' "$output"
+
+# démon: odpověď z cache musí zachovat bit AA z odpovědi upstream serveru
+start_mock
+./dns -d $((PORT + 1)) -s 127.0.0.1 -p $PORT -w 1 -r > /dev/null 2>&1 &
+daemon_pid=$!
+sleep 0.3
+output=$(./dns -s 127.0.0.1 -p $((PORT + 1)) h1.test -r | head -1; ./dns -s 127.0.0.1 -p $((PORT + 1)) h1.test -r | head -1)
+kill -INT $daemon_pid
+wait $daemon_pid 2> /dev/null
+stop_mock
+check "Test 14: flagy odpovědi démona" "Authoritative: Yes, Recursive: Yes, Truncated: No
+Authoritative: Yes, Recursive: Yes, Truncated: No" "$output"
+
+# iterativní rezoluce přes 70 delegací, každá na jiném serveru (víc, než má engine slotů)
+rm -f referral_zone.txt leaf_zone.txt
+for n in $(seq 1 70); do
+    echo "z$n.deleg NS 60 ns.z$n.deleg." >> referral_zone.txt
+    echo "ns.z$n.deleg A 60 127.0.1.$n" >> referral_zone.txt
+    echo "h$n.z$n.deleg A 60 10.9.0.$n" >> leaf_zone.txt
+done
+./dns_mock -z referral_zone.txt -p $PORT 2> /dev/null &
+leaf_pids=$!
+for n in $(seq 1 70); do
+    ./dns_mock -z leaf_zone.txt -l 127.0.1.$n -p $PORT 2> /dev/null &
+    leaf_pids="$leaf_pids $!"
+done
+sleep 0.5
+output=$(for n in $(seq 1 70) $(seq 1 70); do echo "h$n.z$n.deleg"; done | ./dns -i -s 127.0.0.1 -p $PORT -f - -o jsonl | grep -c '"data":"10.9.0.')
+kill $leaf_pids
+wait $leaf_pids 2> /dev/null
+check "Test 15: iterativně přes víc serverů, než je slotů" "140" "$output"
+
+# s -c se adresa serveru zadaného jménem i odpověď při druhém běhu vezmou z cache
+rm -f bootstrap_cache.bin
+start_mock
+./dns -s ns.test -b 127.0.0.1 -p $PORT h1.test -r -c bootstrap_cache.bin > /dev/null
+stop_mock
+start_mock
+output=$(./dns -s ns.test -b 127.0.0.1 -p $PORT h1.test -r -c bootstrap_cache.bin | grep -c "h1.test., A, IN, [0-9]*, 10.1.0.1")
+stop_mock
+check "Test 16: server zadaný jménem z cache" "1 Dotazy: UDP 0, TCP 0" "$output $(cut -d, -f1,2 mock_stats.txt)"
+
+# server zóny z1.deleg přidá k CNAME do z2.deleg i podvrženou adresu cíle, ta se musí zahodit
+# a cíl se musí zjistit od serveru z2.deleg
+printf 'z1.deleg NS 60 ns.z1.deleg.\nns.z1.deleg A 60 127.0.1.1\nz2.deleg NS 60 ns.z2.deleg.\nns.z2.deleg A 60 127.0.1.2\n' > referral_zone.txt
+printf 'alias.z1.deleg CNAME 60 h2.z2.deleg.\nh2.z2.deleg A 60 10.66.6.6\n' > leaf_zone.txt
+printf 'h2.z2.deleg A 60 10.9.0.2\n' > leaf2_zone.txt
+./dns_mock -z referral_zone.txt -p $PORT 2> /dev/null &
+leaf_pids=$!
+./dns_mock -z leaf_zone.txt -l 127.0.1.1 -p $PORT 2> /dev/null &
+leaf_pids="$leaf_pids $!"
+./dns_mock -z leaf2_zone.txt -l 127.0.1.2 -p $PORT 2> /dev/null &
+leaf_pids="$leaf_pids $!"
+sleep 0.3
+output=$(./dns -i -s 127.0.0.1 -p $PORT alias.z1.deleg | grep ", IN, ")
+kill $leaf_pids
+wait $leaf_pids 2> /dev/null
+check "Test 17: data mimo zónu serveru" "  alias.z1.deleg., CNAME, IN, 60, h2.z2.deleg.
+  h2.z2.deleg., A, IN, 60, 10.9.0.2" "$output"
+
+rm -f mock_stats.txt load.txt stale_cache.bin referral_zone.txt leaf_zone.txt leaf2_zone.txt bootstrap_cache.bin
+echo ""
+echo "Chyb: $failures"
+[[ $failures -eq 0 ]]